@@ -1,9 +1,22 @@
+#include <algorithm>    //std::upper_bound, std::min, std::max, std::copy_n
 #include <array>        //std::array
 #include <cstdint>      //uint8_t, uint16_t
-#include <cstring>      //std::memcpy, size_t
+#include <cstring>      //std::memcpy, std::memcmp, size_t
 #include <exception>    //std::out_of_range
+#include <memory>       //std::shared_ptr, std::make_shared, std::make_unique
+#include <random>       //std::random_device
+#include <utility>      //std::move
 
 #include "chip8.h"
+#include "chip8_aot.h"
+#include "chip8_jit.h"
+#include "chip8_profile.h"
+#include "chip8_trace.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>  //__m128i, _mm_set1_epi32, _mm_cmpeq_epi32, ...
+#define CHIP8_EXPAND_SSE2
+#endif
 
 using namespace chip8;
 
@@ -19,6 +32,32 @@ namespace
         0xF0, 0x80, 0x80, 0x80, 0xF0,       0xE0, 0x90, 0x90, 0x90, 0xE0, //C,D
         0xF0, 0x80, 0xF0, 0x80, 0xF0,       0xF0, 0x80, 0xF0, 0x80, 0x80  //E,F
     };
+
+    //SUPER-CHIP (0-9) and XO-CHIP (A-F), following the small font in RAM
+    constexpr uint8_t big_font[0x10 * BYTES_PER_BIG_CHAR_SPRITE] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,     //0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,     //1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,     //2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,     //3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,     //4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,     //5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,     //6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,     //7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,     //8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,     //9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,     //A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,     //B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,     //C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,     //D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,     //E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0      //F
+    };
+
+    //Of which the first COLOURS are used
+    constexpr uint32_t default_palette[4] = {
+        DEFAULT_ARGB_NO_PIXEL, DEFAULT_ARGB_PIXEL, 
+        DEFAULT_ARGB_PLANE_1, DEFAULT_ARGB_PLANES
+    };
 }
 
 uint16_t chip8::font_address(unsigned int ch)
@@ -26,39 +65,85 @@ uint16_t chip8::font_address(unsigned int ch)
     return BYTES_PER_CHAR_SPRITE * ch;
 }
 
-CPU::CPU(const void* program, size_t size, Flags flags)
-        : i_{}, delay_timer_{}, sound_timer_{}, pc_{PROGRAM_BEGIN}, opcode_{},
-          sp_{}, paused_{}, is_held_{},
-          argb_pixel_       {DEFAULT_ARGB_PIXEL}, 
-          argb_no_pixel_    {DEFAULT_ARGB_NO_PIXEL}, 
-          clock_speed_hz_   {DEFAULT_CLOCK_SPEED_HZ},
-          new_8XYU_         (flags & NEW_8XYU),
-          new_FXU5_         (flags & NEW_FXU5),
-          key_up_FX0A_      (flags & KEY_UP_FX0A),
-          old_press_FX0A_   (flags & NEW_PRESS_FX0A)
+uint16_t chip8::big_font_address(unsigned int ch)
+{
+    return sizeof(font) + BYTES_PER_BIG_CHAR_SPRITE * ch;
+}
+
+template<unsigned int Quirks>
+const CPU::Handler CPU::quirk_handlers_[QUANTITY_OF_OPS] = {
+    &CPU::op_decode_,   &CPU::op_invalid_,  &CPU::op_nop_,
+    &CPU::op_00E0_,     &CPU::op_00EE_,     &CPU::op_1nnn_,     &CPU::op_2nnn_,
+    &CPU::op_3xkk_,     &CPU::op_4xkk_,     &CPU::op_5xy0_,     &CPU::op_6xkk_,
+    &CPU::op_7xkk_,     &CPU::op_8xy0_,     &CPU::op_8xy1_,     &CPU::op_8xy2_,
+    &CPU::op_8xy3_,     &CPU::op_8xy4_,     &CPU::op_8xy5_,     
+    &CPU::op_8xy6_<Quirks & NEW_8XYU>,      &CPU::op_8xy7_,
+    &CPU::op_8xyE_<Quirks & NEW_8XYU>,      &CPU::op_9xy0_,     &CPU::op_Annn_,
+    &CPU::op_Bnnn_,     &CPU::op_Cxkk_,     &CPU::op_Dxyz_,     &CPU::op_Ex9E_,
+    &CPU::op_ExA1_,     &CPU::op_Fx07_,     
+    &CPU::op_Fx0A_<Quirks & (KEY_UP_FX0A | OLD_PRESS_FX0A)>,    &CPU::op_Fx15_,
+    &CPU::op_Fx18_,     &CPU::op_Fx1E_,     &CPU::op_Fx29_,     &CPU::op_Fx33_,
+    &CPU::op_Fx55_<Quirks & NEW_FXU5>,      &CPU::op_Fx65_<Quirks & NEW_FXU5>,
+    &CPU::op_00Cn_,     &CPU::op_00FB_,     &CPU::op_00FC_,     &CPU::op_00FD_,
+    &CPU::op_00FE_,     &CPU::op_00FF_,     &CPU::op_Fx30_,     &CPU::op_Fx75_,
+    &CPU::op_Fx85_,
+    &CPU::op_00Dn_,     &CPU::op_5xy2_,     &CPU::op_5xy3_,     &CPU::op_F000_,
+    &CPU::op_Fn01_,     &CPU::op_F002_,     &CPU::op_Fx3A_,
+    &CPU::op_3xkk_1nnn_,        &CPU::op_4xkk_1nnn_,
+    &CPU::op_Ex9E_1nnn_,        &CPU::op_ExA1_1nnn_,
+    &CPU::op_6xkk_xN_<2>,       &CPU::op_6xkk_xN_<3>,
+    &CPU::op_6xkk_xN_<4>,
+    &CPU::op_1nnn_idle_,        &CPU::op_Fx07_3xkk_1nnn_
+};
+
+const CPU::Handler* const CPU::handler_tables_[QUIRK_FLAGS + 1] = {
+    quirk_handlers_<0x0>,   quirk_handlers_<0x1>,   quirk_handlers_<0x2>,
+    quirk_handlers_<0x3>,   quirk_handlers_<0x4>,   quirk_handlers_<0x5>,
+    quirk_handlers_<0x6>,   quirk_handlers_<0x7>,   quirk_handlers_<0x8>,
+    quirk_handlers_<0x9>,   quirk_handlers_<0xA>,   quirk_handlers_<0xB>,
+    quirk_handlers_<0xC>,   quirk_handlers_<0xD>,   quirk_handlers_<0xE>,
+    quirk_handlers_<0xF>
+};
+
+std::shared_ptr<const Snapshot> chip8::boot_image(const void* program, 
+                                                  size_t size, Flags flags)
 {
     if(size > PROGRAM_SIZE) 
-        throw cpu_exception("CHIP-8 program too large", pc_);
+        throw cpu_exception("CHIP-8 program too large", PROGRAM_BEGIN);
 
-    //Populate interpreter RAM with font sprites at appropriate locations
-    for(int ch = 0x0; ch < 0x10; ++ch)
-    {
-        unsigned int addr = font_address(ch);
+    //Value-initialised: RAM, display, registers, stack, keys and timers clear
+    auto image = std::make_shared<Snapshot>();
 
-        for(int b = 0; b < BYTES_PER_CHAR_SPRITE; ++b)
-        {
-            ram_[addr + b] = font[ch * BYTES_PER_CHAR_SPRITE + b];
-        }
-    }
+    //Fonts are laid out contiguously from 0x0 (see font_address())
+    std::memcpy(image->ram + font_address(0), font, sizeof(font));
+    if(HAS_SCHIP)
+        std::memcpy(image->ram + big_font_address(0), big_font, 
+                    sizeof(big_font));
+    std::memcpy(image->ram + PROGRAM_BEGIN, program, size);
 
-    //Copy CHIP-8 program
-    std::memcpy(ram_ + PROGRAM_BEGIN, program, size * sizeof(uint8_t));
+    image->pc = PROGRAM_BEGIN;
+    image->flags = flags;
+    image->clock_speed_hz = DEFAULT_CLOCK_SPEED_HZ;
+    std::memcpy(image->palette, default_palette, sizeof(image->palette));
+    image->planes = 0x1;
+    image->audio_pitch = DEFAULT_AUDIO_PITCH;
 
-    //Clear framebuffer
-    for(uint32_t& pixel : framebuffer_)
-    {
-        pixel = argb_no_pixel_;
-    }
+    return image;
+}
+
+CPU::CPU(const void* program, size_t size, Flags flags)
+        : CPU(boot_image(program, size, flags))
+{
+    rng_.seed((std::random_device{})());
+}
+
+CPU::CPU(std::shared_ptr<const Snapshot> boot)
+        : dirty_rows_{}, display_generation_{}, events_{}, stop_on_{}, 
+          limit_{}, decoded_size_{}, profiler_{}, tracer_{}, 
+          boot_{std::move(boot)}
+{
+    //Set first, so that all of RAM is shared with it
+    load(*boot_);
 }
 
 CPU& CPU::pump_input(Keys key_pressed, bool is_held)
@@ -69,8 +154,9 @@ CPU& CPU::pump_input(Keys key_pressed, bool is_held)
        (is_held_[key] == key_up_FX0A_) && 
        (is_held       != key_up_FX0A_))
     {
+        //pc_ remains at the awaiting Fx0A
         paused_ = false;
-        v_[x()] = key;
+        v_[0xF & peek(pc_)] = key;
         pc_ += BYTES_PER_OPCODE;
     }
 
@@ -79,48 +165,565 @@ CPU& CPU::pump_input(Keys key_pressed, bool is_held)
     return *this;
 }
 
-CPU& CPU::execute() 
+CPU& CPU::set_keys(uint16_t mask)
 {
-    static constexpr double d_s_timer_tick_speed_hz = 60.0;
-    double ticks = d_s_timer_tick_speed_hz / clock_speed_hz_;
-    delay_timer_ -= ticks;
-    sound_timer_ -= ticks;
-    if(delay_timer_ < 0) delay_timer_ = 0;
-    if(sound_timer_ < 0) sound_timer_ = 0;
+    //In increasing order of key, as if each were pumped in turn
+    const uint16_t changed = mask ^ get_keys();
+    for(unsigned int key = 0; key < 0x10; ++key)
+    {
+        if((changed >> key) & 0x1)
+            pump_input(static_cast<Keys>(key), (mask >> key) & 0x1);
+    }
+
+    return *this;
+}
+
+uint16_t CPU::get_keys() const
+{
+    uint16_t mask = 0;
+    for(unsigned int key = 0; key < 0x10; ++key)
+        mask |= is_held_[key] << key;
+    return mask;
+}
+
+CPU& CPU::queue_input(const InputEvent& event)
+{
+    if(static_cast<unsigned int>(event.key) >= 0x10)
+        throw cpu_exception("Queued input of an invalid key");
+
+    auto later = [](const InputEvent& a, const InputEvent& b)
+        { return a.cycle < b.cycle; };
+    input_.insert(std::upper_bound(input_.begin(), input_.end(), event, later),
+                  event);
+
+    return *this;
+}
+
+uint64_t CPU::apply_input(uint64_t end)
+{
+    while(!input_.empty() && input_.front().cycle <= scheduler_.cycle())
+    {
+        pump_input(input_.front().key, input_.front().is_held);
+        input_.pop_front();
+    }
+
+    return (!input_.empty() && input_.front().cycle < end) 
+        ? input_.front().cycle : end;
+}
+
+CPU::Instr CPU::decode(unsigned int addr) const
+{
+    auto opcode_at = [this](unsigned int a) -> uint16_t
+        { return (peek(a) << 8) + peek(a + 1); };
 
-    if(!paused_)
+    const uint16_t opcode = opcode_at(addr);
+    const uint8_t x  = 0xF  & (opcode >> 8);
+    const uint8_t kk = 0xFF &  opcode;
+    const uint8_t z  = 0xF  &  opcode;
+
+    uint8_t op = OP_INVALID;
+    switch(0xF & (opcode >> 12))
     {
-        //Fetch instructions
-        if((pc_ >= RAM_SIZE - 1) || (pc_ < PROGRAM_BEGIN))
+    case(0x0):
+        if(x == 0x0 && kk == 0xE0) op = OP_00E0;
+        if(x == 0x0 && kk == 0xEE) op = OP_00EE;
+        if(HAS_SCHIP && x == 0x0)
+        {
+            if((kk & 0xF0) == 0xC0) op = OP_00Cn;
+            if(HAS_XOCHIP && (kk & 0xF0) == 0xD0) op = OP_00Dn;
+            if(kk == 0xFB) op = OP_00FB;
+            if(kk == 0xFC) op = OP_00FC;
+            if(kk == 0xFD) op = OP_00FD;
+            if(kk == 0xFE) op = OP_00FE;
+            if(kk == 0xFF) op = OP_00FF;
+        }
+        break;
+    case(0x1): op = OP_1nnn; break;
+    case(0x2): op = OP_2nnn; break;
+    case(0x3): op = OP_3xkk; break;
+    case(0x4): op = OP_4xkk; break;
+    case(0x5): 
+        if(z == 0x0) op = OP_5xy0; 
+        if(HAS_XOCHIP && z == 0x2) op = OP_5xy2;
+        if(HAS_XOCHIP && z == 0x3) op = OP_5xy3;
+        break;
+    case(0x6): op = OP_6xkk; break;
+    case(0x7): op = OP_7xkk; break;
+    case(0x8):
+        switch(z)
         {
-            throw cpu_exception("PC address is invalid, opcode can't be fetched", 
-                                pc_);
+        case(0x0): op = OP_8xy0; break;
+        case(0x1): op = OP_8xy1; break;
+        case(0x2): op = OP_8xy2; break;
+        case(0x3): op = OP_8xy3; break;
+        case(0x4): op = OP_8xy4; break;
+        case(0x5): op = OP_8xy5; break;
+        case(0x6): op = OP_8xy6; break;
+        case(0x7): op = OP_8xy7; break;
+        case(0xE): op = OP_8xyE; break;
+        default:   op = OP_NOP;  break;
         }
-        opcode_ = (ram_[pc_] << 8) + ram_[pc_ + 1];
-        pc_ += BYTES_PER_OPCODE; 
+        break;
+    case(0x9): if(z == 0x0) op = OP_9xy0; break;
+    case(0xA): op = OP_Annn; break;
+    case(0xB): op = OP_Bnnn; break;
+    case(0xC): op = OP_Cxkk; break;
+    case(0xD): op = OP_Dxyz; break;
+    case(0xE):
+        if(kk == 0x9E) op = OP_Ex9E;
+        if(kk == 0xA1) op = OP_ExA1;
+        break;
+    case(0xF):
+        switch(kk)
+        {
+        case(0x07): op = OP_Fx07; break;
+        case(0x0A): op = OP_Fx0A; break;
+        case(0x15): op = OP_Fx15; break;
+        case(0x18): op = OP_Fx18; break;
+        case(0x1E): op = OP_Fx1E; break;
+        case(0x29): op = OP_Fx29; break;
+        case(0x33): op = OP_Fx33; break;
+        case(0x55): op = OP_Fx55; break;
+        case(0x65): op = OP_Fx65; break;
+        case(0x30): if(HAS_SCHIP) op = OP_Fx30; break;
+        case(0x75): if(HAS_SCHIP) op = OP_Fx75; break;
+        case(0x85): if(HAS_SCHIP) op = OP_Fx85; break;
+        case(0x3A): if(HAS_XOCHIP) op = OP_Fx3A; break;
+        case(0x00): if(HAS_XOCHIP && x == 0x0) op = OP_F000; break;
+        case(0x01): if(HAS_XOCHIP) op = OP_Fn01; break;
+        case(0x02): if(HAS_XOCHIP && x == 0x0) op = OP_F002; break;
+        }
+        break;
+    }
+
+    //Superinstructions: a conditional skip over a jump, a run of loads, or an
+    //idle loop (a jump to itself, or a wait until the delay timer reads kk)
+    uint8_t fused = op;
+    auto fits = [addr](unsigned int n) 
+        { return addr + n * BYTES_PER_OPCODE <= RAM_SIZE; };
+    auto is_jump_at = [&](unsigned int a) 
+        { return (opcode_at(a) >> 12) == 0x1; };
+
+    if(fits(2) && is_jump_at(addr + BYTES_PER_OPCODE))
+    {
+        switch(op)
+        {
+        case(OP_3xkk): fused = OP_3xkk_1nnn; break;
+        case(OP_4xkk): fused = OP_4xkk_1nnn; break;
+        case(OP_Ex9E): fused = OP_Ex9E_1nnn; break;
+        case(OP_ExA1): fused = OP_ExA1_1nnn; break;
+        }
+    }
+    else if(op == OP_6xkk)
+    {
+        unsigned int n = 1;
+        while(n < MAX_FUSED_LEN && fits(n + 1) && 
+              (opcode_at(addr + n * BYTES_PER_OPCODE) >> 12) == 0x6)
+        {
+            ++n;
+        }
+        if(n > 1) fused = OP_6xkk_x2 + (n - 2);
+    }
+    else if(op == OP_1nnn && (0xFFF & opcode) == addr)
+    {
+        fused = OP_1nnn_idle;
+    }
+    else if(op == OP_Fx07 && fits(3) && 
+            (opcode_at(addr + BYTES_PER_OPCODE) >> 8) == (0x30 | x) &&
+            opcode_at(addr + 2 * BYTES_PER_OPCODE) == (0x1000 | addr))
+    {
+        fused = OP_Fx07_3xkk_1nnn;
+    }
+
+    return {fused, op, x, kk};
+}
+
+void CPU::grow_decoded(unsigned int addr)
+{
+    //To the end of addr's page, value-initialised (all OP_DECODE)
+    const unsigned int size = (addr / RAM_PAGE_SIZE + 1) * RAM_PAGE_SIZE;
+    std::unique_ptr<Instr[]> grown = std::make_unique<Instr[]>(size);
+    std::copy_n(decoded_.get(), decoded_size_, grown.get());
+    decoded_ = std::move(grown);
+    decoded_size_ = size;
+}
+
+void CPU::invalidate(unsigned int begin, unsigned int end)
+{
+    //Any instruction, or superinstruction, overlapping [begin, end] is reset
+    static constexpr unsigned int reach = 
+        MAX_FUSED_LEN * BYTES_PER_OPCODE - 1;
 
-        //Jump table: a (large) switch statement in execute() would be an
-        //alternative, but a jump table is chosen for consistency with
-        //other emulators (with more complicated opcodes)
-        using chip8_func_ptr = void(CPU::*)();
-        constexpr static chip8_func_ptr func_table_[0x10] = {
-            &CPU::op_0nnn_, &CPU::op_1nnn_, 
-            &CPU::op_2nnn_, &CPU::op_3xkk_,
-            &CPU::op_4xkk_, &CPU::op_5xy0_, 
-            &CPU::op_6xkk_, &CPU::op_7xkk_,
-            &CPU::op_8xyz_, &CPU::op_9xy0_,
-            &CPU::op_Annn_, &CPU::op_Bnnn_,
-            &CPU::op_Cxkk_, &CPU::op_Dxyz_, 
-            &CPU::op_Exkk_, &CPU::op_Fxkk_
-        };
+    if(end >= RAM_SIZE) end = RAM_SIZE - 1;
 
-        chip8_func_ptr op = func_table_[first_nibble()];
-        (this->*op)();
+    for(unsigned int addr = (begin > reach) ? begin - reach : 0; 
+        addr <= end && addr < decoded_size_; ++addr)
+    {
+        decoded_[addr] = Instr{};
+    }
+
+    if(jit_) jit_->invalidate(begin, end);
+    if(aot_) aot_->invalidate(begin, end);
+}
+
+const uint8_t* CPU::gather(unsigned int addr, unsigned int size, 
+                           uint8_t* scratch) const
+{
+    //Across two pages, one shared and one the instance's own
+    const unsigned int page = addr / RAM_PAGE_SIZE;
+    const unsigned int head = RAM_PAGE_SIZE - addr % RAM_PAGE_SIZE;
+    std::memcpy(scratch, pages_[page] + addr % RAM_PAGE_SIZE, head);
+    std::memcpy(scratch + head, pages_[page + 1], size - head);
+    return scratch;
+}
+
+void CPU::own_page(unsigned int page)
+{
+    uint8_t* own = ram_ + page * RAM_PAGE_SIZE;
+    std::memcpy(own, pages_[page], RAM_PAGE_SIZE);
+    pages_[page] = own;
+}
+
+void CPU::copy_ram(uint8_t* out) const
+{
+    for(unsigned int page = 0; page < RAM_PAGES; ++page)
+        std::memcpy(out + page * RAM_PAGE_SIZE, pages_[page], RAM_PAGE_SIZE);
+}
+
+void CPU::load_ram(const uint8_t* in)
+{
+    for(unsigned int page = 0; page < RAM_PAGES; ++page)
+    {
+        const unsigned int offset = page * RAM_PAGE_SIZE;
+        const uint8_t* shared = boot_ ? boot_->ram + offset : nullptr;
+        if(shared && (in + offset == shared || 
+                      !std::memcmp(in + offset, shared, RAM_PAGE_SIZE)))
+        {
+            pages_[page] = shared;
+        }
+        else
+        {
+            std::memcpy(ram_ + offset, in + offset, RAM_PAGE_SIZE);
+            pages_[page] = ram_ + offset;
+        }
     }
+}
+
+Scheduler::Scheduler(unsigned int clock_speed_hz, uint64_t cycle,
+    uint64_t frame, unsigned int phase)
+        : cycle_{cycle}, frame_{frame}, clock_speed_hz_{clock_speed_hz}
+{
+    if(clock_speed_hz_ == 0)
+        throw cpu_exception("Clock speed set to zero");
+    if(phase >= clock_speed_hz_)
+        throw cpu_exception("Frame phase exceeds clock speed");
+
+    schedule(cycle_, phase);
+}
+
+void Scheduler::schedule(uint64_t cycle, unsigned int phase)
+{
+    //Cycles until phase, accumulating 60 per cycle, reaches the clock speed
+    const unsigned int cycles =
+        (clock_speed_hz_ - phase + FRAMES_PER_SECOND - 1) / FRAMES_PER_SECOND;
+    next_frame_ = cycle + cycles;
+    next_phase_ = phase + FRAMES_PER_SECOND * cycles;
+}
+
+void Scheduler::begin_frame()
+{
+    //Below 60 Hz, several frames begin on some cycles
+    unsigned int phase = next_phase_;
+    while(phase >= clock_speed_hz_)
+    {
+        phase -= clock_speed_hz_;
+        ++frame_;
+    }
+    schedule(next_frame_, phase);
+}
+
+bool Scheduler::advance(uint64_t n)
+{
+    cycle_ += n;
+    if(cycle_ < next_frame_) return false;
+
+    //Phase accumulated from next_frame_ onwards, however many frames it spans
+    const uint64_t phase = 
+        next_phase_ + FRAMES_PER_SECOND * (cycle_ - next_frame_);
+    frame_ += phase / clock_speed_hz_;
+    schedule(cycle_, static_cast<unsigned int>(phase % clock_speed_hz_));
+    return true;
+}
+
+uint64_t Scheduler::frame_cycle(uint64_t frame) const
+{
+    if(frame <= frame_) return cycle_;
+
+    //First cycle from next_frame_ onwards by which phase has accumulated 
+    //enough for (frame - frame_) frames
+    const uint64_t needed = (frame - frame_) * clock_speed_hz_;
+    const uint64_t cycles = (needed > next_phase_) 
+        ? (needed - next_phase_ + FRAMES_PER_SECOND - 1) / FRAMES_PER_SECOND 
+        : 0;
+    return next_frame_ + cycles;
+}
+
+unsigned int Scheduler::phase() const
+{
+    return next_phase_ - FRAMES_PER_SECOND *
+        static_cast<unsigned int>(next_frame_ - cycle_);
+}
+
+Scheduler& Scheduler::set_clock_speed_hz(unsigned int set)
+{
+    if(set == 0) throw cpu_exception("Clock speed set to zero");
+
+    const unsigned int current = phase();
+    clock_speed_hz_ = set;
+    schedule(cycle_, (current < set) ? current : set - 1);
+    return *this;
+}
+
+CPU& CPU::execute()
+{
+    run_cycles(1);
 
     return *this;
 }
 
+RunResult CPU::run_cycles(unsigned long n, unsigned int stop_on)
+{
+    const uint64_t begin = scheduler_.cycle();
+    const uint64_t end = (n < UINT64_MAX - begin) ? begin + n : UINT64_MAX;
+
+    //Superinstructions execute several cycles at once, so are only used where
+    //they can't overrun the end of the run, queued input or a requested event
+    //(including a frame boundary on the cycle they begin)
+    const bool stop_on_frame = (stop_on & STOP_FRAME);
+
+    //Queued input is applied on its cycle, so execution stops short of it
+    uint64_t limit = limit_ = apply_input(end);
+
+    events_ = STOP_NONE;
+    stop_on_ = stop_on;
+    const bool is_breaking = debug_ && (stop_on & STOP_BREAK);
+    while(scheduler_.cycle() < end)
+    {
+        if(scheduler_.cycle() == limit) limit = limit_ = apply_input(end);
+
+        if(paused_)
+        {
+            //Awaiting a key, which only input (applied at limit) can press
+            skip_to(idle_bound());
+        }
+        else if(is_breaking && is_break())
+        {
+            //Stopped before executing the instruction at pc_
+            events_ |= STOP_BREAK;
+        }
+        else if(aot_ && !debug_ && !is_instrumented() &&
+                aot_->run(*this, limit, stop_on))
+        {
+            //Static block executed
+        }
+        else if(!is_instrumented() && jit_ && 
+                jit_->run(*this, limit, stop_on))
+        {
+            //Block executed
+        }
+        else
+        {
+            tick();
+
+            //Fetch instructions
+            if(static_cast<uint16_t>(pc_ - PROGRAM_BEGIN) >= PROGRAM_SIZE - 1)
+            {
+                throw cpu_exception(
+                    "PC address is invalid, opcode can't be fetched", pc_);
+            }
+            if(pc_ >= decoded_size_) grow_decoded(pc_);
+            Instr instr = decoded_[pc_];
+            pc_ += BYTES_PER_OPCODE; 
+
+            if((instr.op >= OP_FUSED) && 
+               (is_traced() || debug_ ||
+                (limit - scheduler_.cycle() < MAX_FUSED_LEN - 1) ||
+                (events_ & stop_on) ||
+                (stop_on_frame && 
+                 scheduler_.cycles_to_frame() < MAX_FUSED_LEN)))
+            {
+                instr.op = instr.base;
+            }
+
+            //Jump table: a (large) switch statement would be an alternative, 
+            //but a jump table is chosen for consistency with other emulators 
+            //(with more complicated opcodes)
+            if(is_instrumented())
+            {
+                const uint8_t sp = sp_;
+                const uint16_t addr = pc_ - BYTES_PER_OPCODE;
+                if(instr.op == OP_DECODE)
+                {
+                    //Counted as the handler decoded, unfused (see op_decode_)
+                    instr = predecode(addr);
+                    instr.op = instr.base;
+                }
+                if(is_profiled()) profiler_->count(addr, instr);
+                if(is_traced()) tracer_->begin(addr);
+                (this->*handlers_[instr.op])(instr);
+                if(is_traced()) tracer_->end();
+                if(is_profiled() && sp_ != sp) profiler_->call_or_return();
+            }
+            else (this->*handlers_[instr.op])(instr);
+        }
+
+        if(events_ & stop_on)
+        {
+            return {static_cast<unsigned long>(scheduler_.cycle() - begin), 
+                    static_cast<StopReason>(events_ & stop_on)};
+        }
+    }
+
+    return {static_cast<unsigned long>(scheduler_.cycle() - begin), 
+            STOP_CYCLES};
+}
+
+uint64_t CPU::idle_bound() const
+{
+    const uint64_t now = scheduler_.cycle();
+    if(events_ & stop_on_) return now;
+
+    return (stop_on_ & STOP_FRAME) 
+        ? std::min(limit_, now + scheduler_.cycles_to_frame()) : limit_;
+}
+
+uint64_t CPU::idle_until() const
+{
+    const uint64_t now = scheduler_.cycle();
+    if(paused_)
+    {
+        return input_.empty() ? UINT64_MAX 
+                              : std::max(now, input_.front().cycle);
+    }
+    if(static_cast<uint16_t>(pc_ - PROGRAM_BEGIN) >= PROGRAM_SIZE - 1)
+        return now;
+
+    switch(decode(pc_).op)
+    {
+    case(OP_1nnn_idle): 
+    case(OP_00FD):
+        return UINT64_MAX;
+    case(OP_Fx07_3xkk_1nnn):
+    {
+        //The delay timer only decreases, so may never read kk
+        const uint8_t until = peek(pc_ + BYTES_PER_OPCODE + 1);
+        const uint8_t value = scheduler_.timer_value(delay_end_);
+        if(value < until) return UINT64_MAX;
+        return (value > until) ? scheduler_.frame_cycle(delay_end_ - until) 
+                               : now;
+    }
+    default:
+        return now;
+    }
+}
+
+RunResult CPU::run_until_frame(unsigned int stop_on)
+{
+    static constexpr unsigned long unbounded = -1;
+    return run_cycles(unbounded, stop_on | STOP_FRAME);
+}
+
+const uint32_t* CPU::framebuffer(uint32_t* argb, uint64_t rows) const
+{
+    return expand_display(display_, palette_, argb, rows);
+}
+
+const uint32_t* chip8::expand_display(const uint64_t* display, 
+    const uint32_t* palette, uint32_t* argb, uint64_t rows)
+{
+    if(PLANES == 1)
+        return expand_display(display, palette[1], palette[0], argb, rows);
+
+    //Each pixel's colour gathers its bit of each plane's row
+    for(unsigned int y = 0; y < HEIGHT; ++y)
+    {
+        if(!((rows >> y) & 0x1)) continue;
+        uint32_t* out = argb + y * WIDTH;
+        for(unsigned int w = 0; w < ROW_WORDS; ++w)
+        {
+            uint64_t words[PLANES];
+            for(unsigned int plane = 0; plane < PLANES; ++plane)
+                words[plane] = display[(plane * HEIGHT + y) * ROW_WORDS + w];
+            for(int shift = 63; shift >= 0; --shift)
+            {
+                unsigned int colour = 0;
+                for(unsigned int plane = 0; plane < PLANES; ++plane)
+                    colour |= ((words[plane] >> shift) & 0x1) << plane;
+                *out++ = palette[colour];
+            }
+        }
+    }
+
+    return argb;
+}
+
+const uint32_t* chip8::expand_display(const uint64_t* display, 
+    uint32_t argb_pixel, uint32_t argb_no_pixel, uint32_t* argb, 
+    uint64_t rows)
+{
+    //A pixel is set if set in any plane
+    uint64_t merged[PLANES > 1 ? HEIGHT * ROW_WORDS : 1];
+    if(PLANES > 1)
+    {
+        for(unsigned int word = 0; word < HEIGHT * ROW_WORDS; ++word)
+        {
+            merged[word] = 0;
+            for(unsigned int plane = 0; plane < PLANES; ++plane)
+                merged[word] |= display[plane * HEIGHT * ROW_WORDS + word];
+        }
+        display = merged;
+    }
 
+#ifdef CHIP8_EXPAND_SSE2
+    //Four pixels per store: each lane selects its bit of the broadcast nibble
+    const __m128i bits = _mm_set_epi32(0x1, 0x2, 0x4, 0x8);
+    const __m128i set = _mm_set1_epi32(static_cast<int>(argb_pixel));
+    const __m128i unset = _mm_set1_epi32(static_cast<int>(argb_no_pixel));
 
+    for(unsigned int y = 0; y < HEIGHT; ++y)
+    {
+        if(!((rows >> y) & 0x1)) continue;
+        uint32_t* out = argb + y * WIDTH;
+        for(unsigned int w = 0; w < ROW_WORDS; ++w)
+        {
+            const uint64_t row = display[y * ROW_WORDS + w];
+            for(int shift = 64 - 4; shift >= 0; shift -= 4, out += 4)
+            {
+                const __m128i nibble = 
+                    _mm_set1_epi32(static_cast<int>((row >> shift) & 0xF));
+                const __m128i mask = 
+                    _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), 
+                    _mm_or_si128(_mm_and_si128(mask, set), 
+                                 _mm_andnot_si128(mask, unset)));
+            }
+        }
+    }
+#else
+    for(unsigned int y = 0; y < HEIGHT; ++y)
+    {
+        if(!((rows >> y) & 0x1)) continue;
+        uint32_t* out = argb + y * WIDTH;
+        for(unsigned int w = 0; w < ROW_WORDS; ++w)
+        {
+            const uint64_t row = display[y * ROW_WORDS + w];
+            for(int shift = 64 - 1; shift >= 0; --shift)
+            {
+                *out++ = ((row >> shift) & 0x1) ? argb_pixel : argb_no_pixel;
+            }
+        }
+    }
+#endif
 
+    return argb;
+}
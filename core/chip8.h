@@ -1,8 +1,35 @@
 #ifndef CHIP8_H_OLIVECC
 #define CHIP8_H_OLIVECC
 
-#include <cstdint>      //uint8_t, uint16_t, uint32_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <deque>        //std::deque
+#include <memory>       //std::unique_ptr, std::shared_ptr
+#include <random>       //std::minstd_rand
 #include <stdexcept>    //std::runtime_error
+#include <vector>       //std::vector
+
+//Variant of CHIP-8 the core is built for, chosen at compile time (e.g. 
+//-DCHIP8_VARIANT=CHIP8_XOCHIP), as it sets the size of the display and RAM,
+//and so of CPU, Snapshot, etc.: builds of different variants don't share
+//snapshots or movies.
+#define CHIP8_CHIP8     0
+#define CHIP8_SCHIP     1   //SUPER-CHIP 1.1: 128x64, scrolling, 16x16 sprites
+#define CHIP8_XOCHIP    2   //XO-CHIP: SUPER-CHIP, 64 KB RAM, two bitplanes
+#ifndef CHIP8_VARIANT
+#define CHIP8_VARIANT   CHIP8_CHIP8
+#endif
+
+//Guest profiling (see chip8_profile.h), built with -DCHIP8_PROFILE=1: 
+//otherwise compiled out of the run loop entirely
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE   0
+#endif
+
+//Execution tracing (see chip8_trace.h), built with -DCHIP8_TRACE=1, which 
+//then requires thread support: otherwise compiled out as profiling is
+#ifndef CHIP8_TRACE
+#define CHIP8_TRACE     0
+#endif
 
 namespace chip8
 {
@@ -24,25 +51,44 @@ namespace chip8
         QUANTITY_OF_KEYS
     };
     
+    //Instruction set extensions built (see CHIP8_VARIANT)
+    constexpr bool HAS_SCHIP = (CHIP8_VARIANT >= CHIP8_SCHIP);
+    constexpr bool HAS_XOCHIP = (CHIP8_VARIANT == CHIP8_XOCHIP);
+    constexpr bool HAS_PROFILE = (CHIP8_PROFILE != 0);
+    constexpr bool HAS_TRACE = (CHIP8_TRACE != 0);
+
     enum : unsigned int //CHIP-8 constants
     {
-        //Dimensions
-        WIDTH = 64,
-        HEIGHT = 32,
+        //Dimensions: SUPER-CHIP's low resolution is drawn at half scale
+        WIDTH = HAS_SCHIP ? 128 : 64,
+        HEIGHT = HAS_SCHIP ? 64 : 32,
+        PLANES = HAS_XOCHIP ? 2 : 1,
+        COLOURS = 1U << PLANES,
+        ROW_WORDS = WIDTH / 64,     //uint64_t per row of a plane
+        DISPLAY_WORDS = PLANES * HEIGHT * ROW_WORDS,
         //CPU quantities
         BYTES_PER_OPCODE = 2,
         BYTES_PER_CHAR_SPRITE = 5,
+        BYTES_PER_BIG_CHAR_SPRITE = 10,
         STACK_MAX_SIZE = 16,        //as per original; sometimes 16? TODO
+        FLAG_REGISTERS = HAS_XOCHIP ? 16 : 8,   //Fx75, Fx85
+        AUDIO_PATTERN_SIZE = 16,    //Bytes (F002)
         //Addresses
         PROGRAM_BEGIN   = 0x200, 
-        RAM_SIZE        = 0x1000,
+        RAM_SIZE        = HAS_XOCHIP ? 0x10000 : 0x1000,
         PROGRAM_SIZE    = RAM_SIZE - PROGRAM_BEGIN,
         //Miscellaneous
         DEFAULT_CLOCK_SPEED_HZ = 500,
+        FRAMES_PER_SECOND     = 60,     //Rate of timer decrement
         DEFAULT_ARGB_PIXEL    = 0xFFFFFFFF,
         DEFAULT_ARGB_NO_PIXEL = 0xFF000000,
+        DEFAULT_ARGB_PLANE_1  = 0xFFAAAAAA,     //Set only in plane 1
+        DEFAULT_ARGB_PLANES   = 0xFF555555,     //Set in planes 0 and 1
+        DEFAULT_AUDIO_PITCH   = 64,             //Fx3A: 4000 Hz playback
     };
 
+    constexpr uint64_t ALL_ROWS = ~uint64_t{0};     //Mask of display rows
+
     enum Flags : unsigned int
     {
         KEY_UP_FX0A         = 1U << 0,
@@ -58,140 +104,674 @@ namespace chip8
         NO_FLAGS            = OLD_OPCODES | KEY_DOWN_FX0A | NEW_PRESS_FX0A
     };
 
+    enum StopReason : unsigned int
+    {
+        STOP_NONE           = 0,
+        STOP_CYCLES         = 1U << 0,  //Requested quantity of cycles executed
+        STOP_FRAME          = 1U << 1,  //60 Hz frame boundary reached
+        STOP_AWAIT_KEY      = 1U << 2,  //Fx0A executed, awaiting key event
+        STOP_DRAW           = 1U << 3,  //Framebuffer modified (e.g. Dxyz)
+        STOP_FAULT          = 1U << 4,  //Batch lane faulted (CPU throws)
+        STOP_SOUND          = 1U << 5,  //Sound timer set (Fx18)
+        STOP_BREAK          = 1U << 6,  //Breakpoint or break condition met
+        STOP_WATCH          = 1U << 7   //Watched RAM accessed
+    };
+
+    //Accesses to RAM a watchpoint stops on (see CPU::set_watchpoint())
+    enum Watch : unsigned int
+    {
+        WATCH_READ          = 1U << 0,  //Fx65, Dxyz (and XO-CHIP's 5xy3)
+        WATCH_WRITE         = 1U << 1,  //Fx33, Fx55 (and XO-CHIP's 5xy2)
+        WATCH_ACCESS        = WATCH_READ | WATCH_WRITE
+    };
+
+    //Comparison of a register with a value, which breaks a run where it
+    //becomes true (see CPU::add_break_condition())
+    struct BreakCondition
+    {
+        enum Compare : unsigned int { EQUAL, NOT_EQUAL, LESS, GREATER };
+        enum : unsigned int { REG_I = 0x10 };
+
+        unsigned int reg;           //0 to 0xF: Vx; REG_I: I
+        Compare compare;
+        uint16_t value;
+    };
+
+    //Access that last stopped a run with STOP_WATCH
+    struct WatchHit
+    {
+        uint16_t pc;                //Of the instruction accessing
+        uint16_t addr;              //First watched byte accessed
+        Watch access;
+    };
+
+    enum class Engine : unsigned int
+    {
+        INTERPRETER,
+        JIT                 //Basic-block recompiler: x86-64 System V hosts only
+    };
+
+    //Result of a batched run: events in StopReason may be combined if several
+    //occurred on the final cycle. Errors are thrown as cpu_exception, as with
+    //execute().
+    struct RunResult
+    {
+        unsigned long cycles;
+        StopReason reason;
+    };
+
+    //Change of a key's state, applied by a run once cycle cycles have been
+    //executed in total (i.e. before the following instruction), or at the
+    //start of the next run if that has passed
+    struct InputEvent
+    {
+        uint64_t cycle;
+        Keys key;
+        bool is_held;
+    };
+
+    //Counts cycles and the 60 Hz frames they make up, in integer arithmetic:
+    //phase() accumulates 60 per cycle, and a frame begins on each cycle on 
+    //which it reaches the clock speed (then reduced by it), so frames begin 
+    //on the same cycles on every host. Only the cycle of the next frame is 
+    //compared against per cycle. Timers are held as the frame on which they 
+    //reach zero, so count down without work per cycle.
+    class Scheduler
+    {
+    private:
+        uint64_t cycle_;
+        uint64_t frame_;            //Frames begun
+        uint64_t next_frame_;       //Cycle on which the next frame begins
+        unsigned int next_phase_;   //phase() on next_frame_
+        unsigned int clock_speed_hz_;
+
+        void schedule(uint64_t cycle, unsigned int phase);
+        void begin_frame();
+
+    public:
+        explicit Scheduler(unsigned int clock_speed_hz = DEFAULT_CLOCK_SPEED_HZ,
+            uint64_t cycle = 0, uint64_t frame = 0, unsigned int phase = 0);
+
+        //Count one cycle, or n: true iff any frame began
+        bool tick()
+        { return (++cycle_ == next_frame_) ? (begin_frame(), true) : false; }
+        bool advance(uint64_t n);
+
+        uint64_t cycle() const { return cycle_; }
+        uint64_t frame() const { return frame_; }
+        uint64_t cycles_to_frame() const { return next_frame_ - cycle_; }
+        unsigned int phase() const;     //In [0, clock speed)
+        uint64_t frame_cycle(uint64_t frame) const; //Cycle frame begins on
+
+        //A timer set to value now: frame on which it reaches zero, and value
+        uint64_t timer_end(uint8_t value) const { return frame_ + value; }
+        uint8_t timer_value(uint64_t end) const
+        { return (end > frame_) ? static_cast<uint8_t>(end - frame_) : 0; }
+
+        unsigned int get_clock_speed_hz() const { return clock_speed_hz_; }
+        Scheduler& set_clock_speed_hz(unsigned int);    //Keeps the phase
+    };
+
+    //Complete state of a CPU (excluding its engine and caches), as taken by
+    //CPU::snapshot(): restoring it replays bit-identically. Trivially 
+    //copyable; serialize()/deserialize() convert to/from a stable, versioned
+    //binary format.
+    struct Snapshot
+    {
+        uint8_t ram[RAM_SIZE];
+        uint64_t display[DISPLAY_WORDS];
+        uint8_t v[0x10];
+        uint16_t i;
+        uint16_t pc;
+        uint16_t stack[STACK_MAX_SIZE];
+        uint8_t sp;
+        uint8_t delay_timer;
+        uint8_t sound_timer;
+        std::minstd_rand rng;
+        bool is_held[static_cast<unsigned int>(Keys::QUANTITY_OF_KEYS)];
+        bool paused;
+        uint64_t cycle;
+        uint64_t frame;
+        unsigned int frame_phase;
+        Flags flags;
+        unsigned int clock_speed_hz;
+        uint32_t palette[COLOURS];  //ARGB of each combination of planes set
+        bool hires;                 //Extended variants' state (see CPU)
+        uint8_t planes;
+        uint8_t flag_registers[FLAG_REGISTERS];
+        uint8_t audio_pattern[AUDIO_PATTERN_SIZE];
+        uint8_t audio_pitch;
+    };
+
+    std::vector<uint8_t> serialize(const Snapshot&);
+    Snapshot deserialize(const void* data, size_t size);
+
+    //Power-on state of a program (fonts and program in RAM, all else clear,
+    //default settings, the RNG default-seeded), built once and shared by 
+    //CPUs constructed from it, which reset() to it
+    std::shared_ptr<const Snapshot> boot_image(const void* program, 
+        size_t size, Flags flags = NO_FLAGS);
+
+    template<unsigned int N> class Batch;
+    struct StaticProgram;
+
     class CPU
     {
     private:
+        //Lanes of a Batch are loaded from, and stored to, CPUs
+        template<unsigned int N> friend class Batch;
+
         //Random Access Memory: [0x0, PROGRAM_BEGIN) reserved for 
-        //interpreter, [PROGRAM_BEGIN, RAM_SIZE) reserved for CHIP-8 program
+        //interpreter, [PROGRAM_BEGIN, RAM_SIZE) reserved for CHIP-8 program.
+        //Read through pages_, each either shared read-only with the boot 
+        //image (see boot_), or the instance's own in ram_, copied there on
+        //the first write to it: instances of one program only touch (and
+        //hold in cache) their own copies of the pages they write.
+        enum : unsigned int 
+        { 
+            RAM_PAGE_SIZE = 0x100, 
+            RAM_PAGES = RAM_SIZE / RAM_PAGE_SIZE 
+        };
         uint8_t ram_[RAM_SIZE];
+        const uint8_t* pages_[RAM_PAGES];
+        static_assert(RAM_SIZE % RAM_PAGE_SIZE == 0, "RAM is whole pages");
+
+        bool is_own(unsigned int page) const
+        { return pages_[page] == ram_ + page * RAM_PAGE_SIZE; }
+        uint8_t peek(unsigned int addr) const
+        {
+            return pages_[(addr / RAM_PAGE_SIZE) % RAM_PAGES]
+                         [addr % RAM_PAGE_SIZE];
+        }
+
+        //At most RAM_PAGE_SIZE bytes from addr, in place if contiguous (else
+        //copied to scratch)
+        const uint8_t* peek(unsigned int addr, unsigned int size, 
+                            uint8_t* scratch) const
+        {
+            const unsigned int page = (addr / RAM_PAGE_SIZE) % RAM_PAGES;
+            const unsigned int offset = addr % RAM_PAGE_SIZE;
+            if(offset + size <= RAM_PAGE_SIZE ||
+               pages_[page + 1] == pages_[page] + RAM_PAGE_SIZE)
+                return pages_[page] + offset;
+            return gather(addr, size, scratch);
+        }
+        const uint8_t* gather(unsigned int addr, unsigned int size,
+                              uint8_t* scratch) const;
+
+        //[addr, addr + size) made the instance's own, to be written
+        uint8_t* poke(unsigned int addr, unsigned int size)
+        {
+            for(unsigned int page = addr / RAM_PAGE_SIZE; 
+                page <= (addr + size - 1) / RAM_PAGE_SIZE; ++page)
+            {
+                if(!is_own(page)) own_page(page);
+            }
+            return ram_ + addr;
+        }
+        void own_page(unsigned int page);
+
+        //All of RAM: pages equal to the boot image's are shared
+        void copy_ram(uint8_t* out) const;
+        void load_ram(const uint8_t* in);
 
-        //Framebuffer
-        uint32_t framebuffer_[WIDTH * HEIGHT];
+        //Display: one bit per pixel, each row ROW_WORDS words from left to
+        //right, the most significant bit of each being its leftmost pixel; 
+        //each plane HEIGHT such rows. Expanded to ARGB only by framebuffer().
+        //256 bytes in CHIP-8 builds, of a CPU of under 5 KB (4 KB being RAM)
+        uint64_t display_[DISPLAY_WORDS];
+        static_assert(WIDTH % 64 == 0, "Display rows are packed into uint64_t");
+
+        //Rows changed since take_dirty_rows() (bit y for row y), and a count
+        //of changes to the display, so hosts can skip unchanged frames
+        uint64_t dirty_rows_;
+        uint64_t display_generation_;
+        static_assert(HEIGHT <= 64, "Dirty rows are packed into uint64_t");
+        void mark_dirty(uint64_t rows)
+        { if(rows) { dirty_rows_ |= rows; ++display_generation_; } }
 
         //Registers
         uint8_t v_[0x10];           //Addressable by a nibble
         uint16_t i_;
-        double delay_timer_;
-        double sound_timer_;
+        uint64_t delay_end_;        //Timers, as Scheduler::timer_end()
+        uint64_t sound_end_;
 
-        //Program Counter/Current opcode
+        //Program Counter
         uint16_t pc_;
-        uint16_t opcode_;
 
         //Stack (Pointer)
         uint16_t stack_[STACK_MAX_SIZE];
         uint8_t sp_;
 
+        //Random Number Generator (Cxkk): per instance, so instances are 
+        //independent and reproducible once seeded
+        std::minstd_rand rng_;
+
+        //SUPER-CHIP: high resolution (else pixels are drawn 2x2), and flag
+        //registers. XO-CHIP: planes drawn to (bit p for plane p), and audio.
+        bool hires_;
+        uint8_t planes_;
+        uint8_t flag_registers_[FLAG_REGISTERS];
+        uint8_t audio_pattern_[AUDIO_PATTERN_SIZE];
+        uint8_t audio_pitch_;
+
+        //Display pixels per pixel drawn, along each axis
+        unsigned int scale() const { return (HAS_SCHIP && !hires_) ? 2 : 1; }
+
+        //Bytes a skip skips at addr: F000 nnnn (XO-CHIP) is skipped whole
+        static unsigned int skip_length(const uint8_t* ram, unsigned int addr)
+        {
+            return (HAS_XOCHIP && addr < RAM_SIZE - 1 && 
+                    ram[addr] == 0xF0 && ram[addr + 1] == 0x00) 
+                ? 2 * BYTES_PER_OPCODE : BYTES_PER_OPCODE;
+        }
+        void skip()     //As skip_length(), through pages_
+        {
+            pc_ += (HAS_XOCHIP && pc_ < RAM_SIZE - 1 && 
+                    peek(pc_) == 0xF0 && peek(pc_ + 1) == 0x00) 
+                ? 2 * BYTES_PER_OPCODE : BYTES_PER_OPCODE;
+        }
+
+        //Run loop state: scheduler_ counts every cycle executed, and the 
+        //frames they make up. events_ collects StopReason bits raised since 
+        //the start of the current run, which stops on stop_on_ or at limit_.
+        Scheduler scheduler_;
+        unsigned int events_;
+        unsigned int stop_on_;
+        uint64_t limit_;
+
+        void tick() { if(scheduler_.tick()) events_ |= STOP_FRAME; }
+
+        //Idle loops (see idle_until()) skip to the bound of the current run:
+        //its limit, or the next event it stops on
+        uint64_t idle_bound() const;
+        void skip_to(uint64_t cycle)
+        {
+            if(cycle > scheduler_.cycle() && 
+               scheduler_.advance(cycle - scheduler_.cycle())) 
+                events_ |= STOP_FRAME;
+        }
+
+
+        //Decoded instruction: operands are extracted once, when an address is
+        //first executed, and cached until RAM at that address is written to.
+        //Trailing instructions of a superinstruction are read from RAM, as the
+        //whole span is invalidated on any write to it.
+        struct Instr
+        {
+            uint8_t op;             //Handler, possibly a superinstruction
+            uint8_t base;           //Handler of the lone instruction
+            uint8_t x;
+            uint8_t kk;
+
+            uint8_t y() const       { return kk >> 4; }
+            uint8_t z() const       { return kk & 0xF; }
+            uint16_t nnn() const    { return (x << 8) | kk; }
+        };
+
+        enum Op : uint8_t
+        {
+            OP_DECODE,              //Not yet decoded (zero-initialised entry)
+            OP_INVALID, OP_NOP,
+            OP_00E0, OP_00EE, OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, 
+            OP_6xkk, OP_7xkk, OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4, 
+            OP_8xy5, OP_8xy6, OP_8xy7, OP_8xyE, OP_9xy0, OP_Annn, OP_Bnnn, 
+            OP_Cxkk, OP_Dxyz, OP_Ex9E, OP_ExA1, OP_Fx07, OP_Fx0A, OP_Fx15, 
+            OP_Fx18, OP_Fx1E, OP_Fx29, OP_Fx33, OP_Fx55, OP_Fx65,
+            //Extended variants (decoded only where built)
+            OP_00Cn, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_Fx30, 
+            OP_Fx75, OP_Fx85, 
+            OP_00Dn, OP_5xy2, OP_5xy3, OP_F000, OP_Fn01, OP_F002, OP_Fx3A,
+            //Superinstructions: at most MAX_FUSED_LEN instructions each
+            OP_FUSED,
+            OP_3xkk_1nnn = OP_FUSED, OP_4xkk_1nnn, OP_Ex9E_1nnn, OP_ExA1_1nnn,
+            OP_6xkk_x2, OP_6xkk_x3, OP_6xkk_x4,
+            OP_1nnn_idle, OP_Fx07_3xkk_1nnn,
+            QUANTITY_OF_OPS
+        };
+        static constexpr unsigned int MAX_FUSED_LEN = 4;
+
+        //Handlers of quirk-dependent opcodes are instantiated per setting of
+        //the flags they depend on (Quirks: those of QUIRK_FLAGS set), so 
+        //test none at run time. Each combination of quirk flags has its own
+        //table, selected on construction (or restoring a snapshot).
+        using Handler = void (CPU::*)(Instr);
+        static constexpr unsigned int QUIRK_FLAGS = 
+            KEY_UP_FX0A | OLD_PRESS_FX0A | NEW_8XYU | NEW_FXU5;
+        template<unsigned int Quirks>
+        static const Handler quirk_handlers_[QUANTITY_OF_OPS];
+        static const Handler* const handler_tables_[QUIRK_FLAGS + 1];
+        static_assert(QUIRK_FLAGS == 0xF, "Quirk flags index handler_tables_");
+        static const Handler* handlers_for(unsigned int flags)
+        { return handler_tables_[flags & QUIRK_FLAGS]; }
+        const Handler* handlers_;
+
+        //Predecoded instructions per address, allocated up to the end of
+        //the highest page of RAM executed (a page at a time): instances only
+        //hold entries as far as the code they have run. Indexed from 0 
+        //rather than PROGRAM_BEGIN, keeping the fetch a single load.
+        std::unique_ptr<Instr[]> decoded_;
+        unsigned int decoded_size_;
+        Instr& decoded(unsigned int addr)       //Grown to addr if not yet
+        {
+            if(addr >= decoded_size_) grow_decoded(addr);
+            return decoded_[addr];
+        }
+        void grow_decoded(unsigned int addr);
+        Instr predecode(unsigned int addr)      //Decoded, and cached
+        { return decoded(addr) = decode(addr); }
+
+        Instr decode(unsigned int addr) const;
+        void invalidate(unsigned int begin, unsigned int end);
+
+        //Copy state from a snapshot, leaving caches as they are
+        void load(const Snapshot&);
+
+        //Dynamic recompiler (see chip8_jit.cpp), present iff Engine::JIT set
+        class Jit;
+        std::unique_ptr<Jit> jit_;
+
+        //Blocks of a program translated ahead of time (see chip8_aot.h), run
+        //in preference to either engine where present. Aot is public, as 
+        //the code generated names it.
+    public:
+        class Aot;
+    private:
+        std::unique_ptr<Aot> aot_;
+
+        //Guest profiler (see chip8_profile.h), if attached: public, as 
+        //hosts create it
+    public:
+        class Profiler;
+    private:
+        Profiler* profiler_;
+        bool is_profiled() const { return HAS_PROFILE && profiler_; }
 
-        //Operations: for the specification of nnn etc., two alternatives are
-        //macro substitutions, and calculation of their values in execute() 
-        //followed by passing each value into each opcode function
-        uint8_t first_nibble()  {return 0xF   & (opcode_ >> 12);}
-        uint32_t nnn()          {return 0xFFF &  opcode_;}
-        uint8_t x()             {return 0xF   & (opcode_ >>  8);}
-        uint8_t y()             {return 0xF   & (opcode_ >>  4);}
-        uint8_t z()             {return 0xF   &  opcode_;}
-        uint16_t kk()           {return 0xFF  &  opcode_;}
+        //Execution tracer (see chip8_trace.h), if attached
+    public:
+        class Tracer;
+    private:
+        Tracer* tracer_;
+        bool is_traced() const { return HAS_TRACE && tracer_; }
+        bool is_instrumented() const { return is_profiled() || is_traced(); }
+
+        //Breakpoints, watchpoints and break conditions, allocated with the
+        //first set: without any, runs test only debug_, at each block 
+        //boundary and in the handlers of opcodes accessing RAM
+        struct Debug
+        {
+            uint64_t breakpoints[RAM_SIZE / 64];    //Bit per address
+            uint8_t watchpoints[RAM_SIZE];          //Watch bits per byte
+            unsigned int watched;                   //Bytes with any
+            std::vector<BreakCondition> conditions;
+            std::vector<bool> were_met;             //Per condition
+            uint64_t resumed_at;    //Cycle of the last break, passed on resume
+            WatchHit hit;
+        };
+        std::unique_ptr<Debug> debug_;
+        Debug& debug();             //Allocated if not yet
+        bool is_breakpoint(unsigned int addr) const
+        {
+            return debug_ && 
+                ((debug_->breakpoints[addr / 64] >> (addr % 64)) & 0x1);
+        }
+        bool is_watching() const { return debug_ && debug_->watched; }
+        bool is_break();            //Before the instruction at pc_
+        void watch(unsigned int addr, unsigned int size, Watch access)
+        {
+            if(debug_ && debug_->watched) watch_range(addr, size, access);
+        }
+        void watch_range(unsigned int addr, unsigned int size, Watch);
 
 
         //Opcodes
-        void op_0nnn_(void);    
-              //00E0              CLS:  Clear display
-              //00EE              RET:  Return from subroutine
-        void op_1nnn_(void);    //JP:   Jump to location nnn
-        void op_2nnn_(void);    //CALL: Call subroutine at nnn
-        void op_3xkk_(void);    //SE:   Skip next instruction iff Vx == kk
-        void op_4xkk_(void);    //SNE:  Skip next instruction iff Vx != kk
-        void op_5xy0_(void);    //SE:   Skip next instruction iff Vx == Vy 
-        void op_6xkk_(void);    //LD:   Vx := kk
-        void op_7xkk_(void);    //ADD:  Vx := Vx + kk
-        void op_8xyz_(void);    
-              //8xy0              LD:   Vx := Vy
-              //8xy1              OR:   Vx := Vx OR Vy
-              //8xy2              AND:  Vx := Vx AND Vy
-              //8xy3              XOR:  Vx := Vx XOR Vy
-              //8xy4              ADD:  Vx := Vx + Vy, VF = carry flag
-              //8xy5              SUB:  Vx := Vx - Vy, VF = NOT borrow flag
-              //8xy6              SHR:  Right-shift Vu, VF = truncated bit 
+        void op_decode_(Instr); //Decode, cache and execute (unfused)
+        void op_invalid_(Instr);//Throw cpu_exception
+        void op_nop_(Instr);    //Unassigned 8xyz: no operation
+        void op_00E0_(Instr);   //CLS:  Clear display
+        void op_00EE_(Instr);   //RET:  Return from subroutine
+        void op_1nnn_(Instr);   //JP:   Jump to location nnn
+        void op_2nnn_(Instr);   //CALL: Call subroutine at nnn
+        void op_3xkk_(Instr);   //SE:   Skip next instruction iff Vx == kk
+        void op_4xkk_(Instr);   //SNE:  Skip next instruction iff Vx != kk
+        void op_5xy0_(Instr);   //SE:   Skip next instruction iff Vx == Vy 
+        void op_6xkk_(Instr);   //LD:   Vx := kk
+        void op_7xkk_(Instr);   //ADD:  Vx := Vx + kk
+        void op_8xy0_(Instr);   //LD:   Vx := Vy
+        void op_8xy1_(Instr);   //OR:   Vx := Vx OR Vy
+        void op_8xy2_(Instr);   //AND:  Vx := Vx AND Vy
+        void op_8xy3_(Instr);   //XOR:  Vx := Vx XOR Vy
+        void op_8xy4_(Instr);   //ADD:  Vx := Vx + Vy, VF = carry flag
+        void op_8xy5_(Instr);   //SUB:  Vx := Vx - Vy, VF = NOT borrow flag
+        template<unsigned int Quirks>
+        void op_8xy6_(Instr);   //SHR:  Right-shift Vu, VF = truncated bit 
               //                        (u == ((NEW_8XYU flag set) ? x : y))
-              //8xy7              SUBN: Vx := Vy - Vx, VF = NOT borrow flag
-              //8xyE              SHL:  Left-shift Vu, VF = truncated bit
+        void op_8xy7_(Instr);   //SUBN: Vx := Vy - Vx, VF = NOT borrow flag
+        template<unsigned int Quirks>
+        void op_8xyE_(Instr);   //SHL:  Left-shift Vu, VF = truncated bit
               //                        (u == ((NEW_8XYU flag set) ? x : y))
-        void op_9xy0_(void);    //SNE:  Skip next instruction iff Vx != Vy
-        void op_Annn_(void);    //LD:   I := nnn
-        void op_Bnnn_(void);    //JP:   Jump to location nnn + V0
-        void op_Cxkk_(void);    //RND:  Vx = random byte AND kk
-        void op_Dxyz_(void);    //DRW:  Draw z-byte sprite from I at 
+        void op_9xy0_(Instr);   //SNE:  Skip next instruction iff Vx != Vy
+        void op_Annn_(Instr);   //LD:   I := nnn
+        void op_Bnnn_(Instr);   //JP:   Jump to location nnn + V0
+        void op_Cxkk_(Instr);   //RND:  Vx = random byte AND kk
+        void op_Dxyz_(Instr);   //DRW:  Draw z-byte sprite from I at 
               //                        (Vx,Vy), VF := collision. Each byte is 
               //                        a horizontal line of bit-pixels.
-        void op_Exkk_(void);     
-              //Ex9E              SKP:  Skip next instruction iff key Vx held
-              //ExA1              SKNP: Skip next instruction iff key Vx not held
-        void op_Fxkk_(void);    
-              //Fx07              LD:   Vx := delay timer value
-              //Fx0A              LD:   'Await' keypress, store value in Vx
+        void op_Ex9E_(Instr);   //SKP:  Skip next instruction iff key Vx held
+        void op_ExA1_(Instr);   //SKNP: Skip next instruction iff key Vx not held
+        void op_Fx07_(Instr);   //LD:   Vx := delay timer value
+        template<unsigned int Quirks>
+        void op_Fx0A_(Instr);   //LD:   'Await' keypress, store value in Vx
               //                        (Event queried == (KEY_UP_FX0A flag set)
               //                         ? key up : key down)
               //                        ('Await' == (OLD_PRESS_FX0A flag set)
               //                         ? check if key event currently applied
               //                         : wait for new key event)
-              //Fx15              LD:   delay timer := Vx
-              //Fx18              LD:   sound timer := Vx
-              //Fx1E              ADD:  I := I + Vx
-              //Fx29              LD:   I := location of sprite for digit Vx
-              //Fx33              LD:   Stores decreasing decimal digits of Vx 
+        void op_Fx15_(Instr);   //LD:   delay timer := Vx
+        void op_Fx18_(Instr);   //LD:   sound timer := Vx
+        void op_Fx1E_(Instr);   //ADD:  I := I + Vx
+        void op_Fx29_(Instr);   //LD:   I := location of sprite for digit Vx
+        void op_Fx33_(Instr);   //LD:   Stores decreasing decimal digits of Vx 
               //                        in [I], [I+1], [I+2]
-              //Fx55              LD:   Load V0-Vx into [I]-[I+x]
+        template<unsigned int Quirks>
+        void op_Fx55_(Instr);   //LD:   Load V0-Vx into [I]-[I+x]
               //                        (I := I + x + 1 iff NEW_FXU5 flag set)
-              //Fx65              LD:   Load [I]-[I+x] into V0-Vx
+        template<unsigned int Quirks>
+        void op_Fx65_(Instr);   //LD:   Load [I]-[I+x] into V0-Vx
               //                        (I := I + x + 1 iff NEW_FXU5 flag set)
+
+        //SUPER-CHIP (and XO-CHIP): scrolls are of pixels as drawn, i.e. 
+        //doubled in low resolution
+        void op_00Cn_(Instr);   //SCD:  Scroll down n pixels
+        void op_00FB_(Instr);   //SCR:  Scroll right 4 pixels
+        void op_00FC_(Instr);   //SCL:  Scroll left 4 pixels
+        void op_00FD_(Instr);   //EXIT: Halt, idling (as a jump to itself)
+        void op_00FE_(Instr);   //LOW:  Low resolution (XO-CHIP: and clear)
+        void op_00FF_(Instr);   //HIGH: High resolution (XO-CHIP: and clear)
+        void op_Fx30_(Instr);   //LD:   I := location of big sprite for Vx
+        void op_Fx75_(Instr);   //LD:   Store V0-Vx in flag registers
+        void op_Fx85_(Instr);   //LD:   Load V0-Vx from flag registers
+
+        //XO-CHIP: drawing, scrolling and clearing affect selected planes
+        //only; Dxyz draws a sprite per plane, one after another from I
+        void op_00Dn_(Instr);   //SCU:  Scroll up n pixels
+        void op_5xy2_(Instr);   //LD:   Store Vx-Vy (either order) in [I]...
+        void op_5xy3_(Instr);   //LD:   Load Vx-Vy (either order) from [I]...
+        void op_F000_(Instr);   //LD:   I := nnnn, the following word
+        void op_Fn01_(Instr);   //PLANE: Select planes n
+        void op_F002_(Instr);   //AUDIO: Load audio pattern from [I]
+        void op_Fx3A_(Instr);   //PITCH: Audio pitch := Vx
+
+        //Superinstructions
+        void op_3xkk_1nnn_(Instr);  //SE, JP
+        void op_4xkk_1nnn_(Instr);  //SNE, JP
+        void op_Ex9E_1nnn_(Instr);  //SKP, JP
+        void op_ExA1_1nnn_(Instr);  //SKNP, JP
+        template<unsigned int N>
+        void op_6xkk_xN_(Instr);    //N consecutive LD Vx, kk
+        void op_1nnn_idle_(Instr);  //JP to itself: idle to the run's bound
+        void op_Fx07_3xkk_1nnn_(Instr); //LD Vx, DT; SE Vx, kk; JP back: 
+              //                           idle until Vx == kk
        
         bool is_held_[static_cast<unsigned int>(Keys::QUANTITY_OF_KEYS)];
          
         bool paused_;
 
+        //Queued input, in order of cycle (then of queueing). Not part of a 
+        //Snapshot: restoring one discards it.
+        std::deque<InputEvent> input_;
+
+        //Apply input due by the current cycle: cycle of the next, or end
+        uint64_t apply_input(uint64_t end);
+
+        //Power-on state reset() restores, and pages of RAM are shared with:
+        //nullptr if constructed from a Snapshot (or a CPU that was)
+        std::shared_ptr<const Snapshot> boot_;
+
         //Option flags: for changing how opcodes work (see above for specifics).
         //Required due to ambiguities in/between CHIP-8 specification(s)
         //available online. I am aware that the canonical solution would be to
         //follow the original COSMAC VIP implementation, however this would 
         //break compatibility with many CHIP-8 programs available online, so the
-        //choice is presented to the front-end implementer.
+        //choice is presented to the front-end implementer. Opcodes take them
+        //from handlers_ (see above); these are for the rest of the CPU.
         bool key_up_FX0A_;
         bool old_press_FX0A_;
         bool new_8XYU_;
         bool new_FXU5_;
 
         //Settings
-        unsigned int clock_speed_hz_;
-        uint32_t argb_pixel_;
-        uint32_t argb_no_pixel_;
+        uint32_t palette_[COLOURS]; //ARGB of each combination of planes set
 
     public:
+        //From a program: as from its boot image, with the RNG seeded 
+        //nondeterministically
         CPU(const void* program, size_t size, Flags flags = NO_FLAGS);
+        explicit CPU(std::shared_ptr<const Snapshot> boot);
+        explicit CPU(const Snapshot&);
+        CPU(const CPU&);            //Copies state, input, caches and engine
+        CPU& operator=(const CPU&) = delete;
+        ~CPU();
         CPU& execute();
+        RunResult run_cycles(unsigned long n, unsigned int stop_on = STOP_NONE);
+        RunResult run_until_frame(unsigned int stop_on = STOP_NONE);
         CPU& pump_input(Keys, bool);
-        uint32_t* framebuffer() { return framebuffer_; }
-        bool is_sound() { return sound_timer_ > 0; }
+        //All keys at once, bit k for key k: only changed keys are pumped
+        CPU& set_keys(uint16_t mask);
+        uint16_t get_keys() const;
+        //Input at an exact cycle, e.g. timestamped host events, or a script
+        CPU& queue_input(const InputEvent&);
+        CPU& clear_input() { input_.clear(); return *this; }
+        //Expand the display into WIDTH * HEIGHT ARGB pixels at argb (only the
+        //rows in mask rows, leaving others as they were)
+        const uint32_t* framebuffer(uint32_t* argb, 
+                                    uint64_t rows = ALL_ROWS) const;
+        //DISPLAY_WORDS words, as display_
+        const uint64_t* display() const { return display_; }
+        uint64_t display_generation() const { return display_generation_; }
+        uint64_t take_dirty_rows()
+        { const uint64_t rows = dirty_rows_; dirty_rows_ = 0; return rows; }
+        bool is_sound() const { return scheduler_.timer_value(sound_end_) > 0; }
+        bool is_hires() const { return hires_; }
+        //XO-CHIP audio: a 1-bit pattern of 128 samples, played at 
+        //4000 * 2^((pitch - 64) / 48) samples per second while is_sound()
+        const uint8_t* audio_pattern() const { return audio_pattern_; }
+        uint8_t audio_pitch() const { return audio_pitch_; }
+        CPU& seed_rng(uint32_t seed) { rng_.seed(seed); return *this; }
+
+        const CPU& snapshot(Snapshot&) const;
+        Snapshot snapshot() const;
+        CPU& restore(const Snapshot&);
+        std::unique_ptr<CPU> fork() const;
+        //Restore the boot image, without allocating: RAM is copied only in
+        //runs that differ from it, and engine, static program and caches
+        //are kept (settings and the RNG are as in the image)
+        CPU& reset();
+
+        //Cycles executed and frames begun, e.g. to pace a host in real time
+        const Scheduler& scheduler() const { return scheduler_; }
+
+        //Cycle until which the CPU only counts cycles and frames, so a host
+        //may sleep until then: when awaiting a key (until queued input, if 
+        //any), jumping to itself, or looping on the delay timer. UINT64_MAX 
+        //if only input can end it; the current cycle if not idle. Runs skip 
+        //idle cycles at once.
+        uint64_t idle_until() const;
 
 
         //Getters/setters for settings
-        unsigned int get_clock_speed_hz() { return clock_speed_hz_; }
+        Engine get_engine() const 
+        { return jit_ ? Engine::JIT : Engine::INTERPRETER; }
+        CPU& set_engine(Engine);
+
+        //Program translated ahead of time (see chip8_aot.h), or nullptr: 
+        //must outlive the CPU, and be translated for the variant built and 
+        //the CPU's flags
+        const StaticProgram* get_static_program() const;
+        CPU& set_static_program(const StaticProgram*);
+
+        //Profiler collecting from the CPU, or nullptr: at most one CPU's at
+        //a time (set on another, it is unset on this), and collects only in
+        //builds with CHIP8_PROFILE (see chip8_profile.h). Not copied by 
+        //copies of the CPU.
+        Profiler* get_profiler() const { return profiler_; }
+        CPU& set_profiler(Profiler*);
+
+        //Tracer recording the CPU, or nullptr: likewise, in builds with 
+        //CHIP8_TRACE (see chip8_trace.h)
+        Tracer* get_tracer() const { return tracer_; }
+        CPU& set_tracer(Tracer*);
+
+        //Debugging: runs with STOP_BREAK in stop_on stop before executing an
+        //instruction at a breakpoint, or once a break condition becomes 
+        //true, as checked at each block boundary (every instruction, when 
+        //interpreted); the next run resumes from there. Runs with STOP_WATCH
+        //stop after an instruction accesses a watched byte. CPUs with none
+        //set run unaffected; those with any bypass the static program and 
+        //superinstructions, and the JIT ends its blocks at breakpoints (and
+        //after watched accesses), and leaves its tight loops each iteration.
+        //Kept by reset() and copies of the CPU.
+        CPU& set_breakpoint(uint16_t addr);
+        CPU& clear_breakpoint(uint16_t addr);
+        CPU& set_watchpoint(uint16_t addr, uint16_t size, 
+                            Watch access = WATCH_ACCESS);
+        CPU& clear_watchpoint(uint16_t addr, uint16_t size);
+        CPU& add_break_condition(const BreakCondition&);
+        CPU& clear_debug();         //All of the above
+        bool is_debugged() const { return debug_ != nullptr; }
+        WatchHit last_watch() const 
+        { return debug_ ? debug_->hit : WatchHit{}; }
+
+        unsigned int get_clock_speed_hz() 
+        { return scheduler_.get_clock_speed_hz(); }
         CPU& set_clock_speed_hz(unsigned int set)
-        { 
-            clock_speed_hz_ = (set > 0) ? 
-                set : throw cpu_exception("Clock speed set to zero"); 
-            return *this; 
-        }
+        { scheduler_.set_clock_speed_hz(set); return *this; }
 
-        uint32_t get_argb_pixel() { return argb_pixel_; }
+        uint32_t get_argb_pixel() { return palette_[1]; }
         CPU& set_argb_pixel(uint32_t set)
-        { argb_pixel_ = set; return *this; }
+        { palette_[1] = set; return *this; }
 
-        uint32_t get_argb_no_pixel() { return argb_no_pixel_; }
+        uint32_t get_argb_no_pixel() { return palette_[0]; }
         CPU& set_argb_no_pixel(uint32_t set)
-        { argb_no_pixel_ = set; return *this; }
+        { palette_[0] = set; return *this; }
+
+        //Colour c of the palette: bit p set for a pixel set in plane p
+        uint32_t get_argb(unsigned int c) { return palette_[c % COLOURS]; }
+        CPU& set_argb(unsigned int c, uint32_t set)
+        { palette_[c % COLOURS] = set; return *this; }
     };
 
     uint16_t font_address(unsigned int ch);
+    uint16_t big_font_address(unsigned int ch);     //SUPER-CHIP: 8x10
+
+    //Expand a packed display (see CPU::display()) into WIDTH * HEIGHT ARGB
+    //pixels at argb, returning argb: each of the colour of its planes set in
+    //palette (COLOURS entries), or of whether any are. Only rows in mask 
+    //rows are written.
+    const uint32_t* expand_display(const uint64_t* display, 
+        const uint32_t* palette, uint32_t* argb, uint64_t rows = ALL_ROWS);
+    const uint32_t* expand_display(const uint64_t* display, 
+        uint32_t argb_pixel, uint32_t argb_no_pixel, uint32_t* argb,
+        uint64_t rows = ALL_ROWS);
 }
 #endif //CHIP8_H_OLIVECC
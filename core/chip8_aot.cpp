@@ -0,0 +1,136 @@
+#include <algorithm>    //std::min, std::max, std::fill
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <memory>       //std::make_unique
+
+#include "chip8.h"
+#include "chip8_aot.h"
+
+using namespace chip8;
+
+CPU& CPU::set_static_program(const StaticProgram* program)
+{
+    if(program == nullptr)
+    {
+        aot_.reset();
+        return *this;
+    }
+
+    if(program->variant != CHIP8_VARIANT)
+        throw cpu_exception("Static program translated for another variant");
+    if(handlers_for(program->flags) != handlers_)
+        throw cpu_exception("Static program translated for other flags");
+    if(program->size > PROGRAM_SIZE)
+        throw cpu_exception("Static program is too large");
+
+    aot_ = std::make_unique<Aot>(*program);
+    aot_->verify(*this);
+    return *this;
+}
+
+const StaticProgram* CPU::get_static_program() const
+{
+    return aot_ ? &aot_->program() : nullptr;
+}
+
+CPU::Aot::Aot(const StaticProgram& program)
+        : program_(program), entry_{}, is_code_{}, max_block_size_{}
+{
+    for(size_t b = 0; b < program_.quantity_of_blocks; ++b)
+    {
+        const StaticBlock& block = program_.blocks[b];
+        if(block.begin < PROGRAM_BEGIN || block.end <= block.begin ||
+           block.end - PROGRAM_BEGIN > program_.size)
+            throw cpu_exception("Static block outside the program");
+        max_block_size_ = std::max<unsigned int>(max_block_size_,
+                                                 block.end - block.begin);
+        std::fill(is_code_ + block.begin, is_code_ + block.end, true);
+    }
+}
+
+void CPU::Aot::verify(const CPU& cpu)
+{
+    const bool is_flags = (handlers_for(program_.flags) == cpu.handlers_);
+    for(size_t b = 0; b < program_.quantity_of_blocks; ++b)
+    {
+        const StaticBlock& block = program_.blocks[b];
+        const uint8_t* image = program_.image + (block.begin - PROGRAM_BEGIN);
+        bool is_same = is_flags;
+        for(unsigned int addr = block.begin; is_same && addr < block.end; 
+            ++addr)
+        {
+            is_same = (cpu.peek(addr) == *image++);
+        }
+        entry_[block.begin] = is_same ? static_cast<uint16_t>(b + 1) : 0;
+    }
+}
+
+uint32_t CPU::Aot::interpret(CPU& cpu, uint16_t addr)
+{
+    Instr instr = cpu.decoded(addr);
+    if(instr.op == OP_DECODE) instr = cpu.predecode(addr);
+    instr.op = instr.base;
+
+    cpu.pc_ = addr + BYTES_PER_OPCODE;
+    try
+    {
+        (cpu.*cpu.handlers_[instr.op])(instr);
+    }
+    catch(const cpu_exception&)
+    {
+        //Handlers check before modifying state, so the interpreter can
+        //re-execute the instruction to throw
+        return BAIL;
+    }
+
+    return cpu.pc_;
+}
+
+bool CPU::Aot::run(CPU& cpu, uint64_t end, unsigned int stop_on)
+{
+    const uint16_t pc = cpu.pc_;
+    if(static_cast<uint16_t>(pc - PROGRAM_BEGIN) >= PROGRAM_SIZE - 1)
+        return false;
+
+    const unsigned int index = entry_[pc];
+    if(index == 0) return false;
+
+    //Stop no later than the end of the run, or the next frame boundary
+    uint64_t budget = end - cpu.scheduler_.cycle();
+    if(stop_on & STOP_FRAME)
+        budget = std::min(budget, cpu.scheduler_.cycles_to_frame());
+    budget = std::min<uint64_t>(budget, UINT32_MAX);
+
+    const uint64_t result = program_.blocks[index - 1].run(
+        cpu, static_cast<uint32_t>(budget));
+    const uint32_t cycles = result >> 32;
+
+    cpu.pc_ = static_cast<uint16_t>(result);
+    if(cpu.scheduler_.advance(cycles)) cpu.events_ |= STOP_FRAME;
+
+    return cycles > 0;
+}
+
+void CPU::Aot::invalidate(unsigned int begin, unsigned int end)
+{
+    if(end >= RAM_SIZE) end = RAM_SIZE - 1;
+
+    bool is_code = false;
+    for(unsigned int addr = begin; addr <= end; ++addr)
+    {
+        is_code |= is_code_[addr];
+    }
+    if(!is_code) return;
+
+    //Blocks overlapping [begin, end] begin at most max_block_size_ - 1
+    //bytes before it
+    const unsigned int first =
+        (begin >= max_block_size_) ? begin - max_block_size_ + 1 : 0;
+    for(unsigned int addr = first; addr <= end; ++addr)
+    {
+        if(entry_[addr] != 0 &&
+           program_.blocks[entry_[addr] - 1].end > begin)
+        {
+            entry_[addr] = 0;
+        }
+    }
+}
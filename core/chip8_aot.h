@@ -0,0 +1,116 @@
+#ifndef CHIP8_AOT_H_OLIVECC
+#define CHIP8_AOT_H_OLIVECC
+
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstring>      //std::memcpy
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //A program translated ahead of time into C++ by test/recompile.cpp, to
+    //be compiled (with full optimization) into the host and passed to
+    //CPU::set_static_program(). Each block is a function returning
+    //(cycles executed << 32) | next pc, with the semantics of a block of
+    //the dynamic recompiler (see chip8_jit.h).
+    struct StaticBlock
+    {
+        unsigned int begin;     //Address of first instruction
+        unsigned int end;       //One past last byte translated
+        uint64_t (*run)(CPU& cpu, uint32_t budget);
+    };
+
+    struct StaticProgram
+    {
+        const uint8_t* image;   //Program translated, as loaded at PROGRAM_BEGIN
+        size_t size;
+        unsigned int variant;   //CHIP8_VARIANT translated for
+        Flags flags;            //Quirks translated for
+        const StaticBlock* blocks;  //In order of begin
+        size_t quantity_of_blocks;
+    };
+
+    //Runs the blocks of a StaticProgram for a CPU. A block is only entered
+    //while RAM holds the bytes it was translated from, so code modified at
+    //run time (or another program entirely) falls back to the interpreter
+    //(or dynamic recompiler), as does any address no block begins at, e.g.
+    //the targets of computed jumps (Bnnn).
+    //
+    //The public members are for generated code only: they expose the
+    //registers of a CPU, and execute instructions with interpreter handlers.
+    class CPU::Aot
+    {
+    public:
+        //V registers and I, held in locals by generated code so they may
+        //be kept in host registers, and written back to the CPU whenever it
+        //may observe them
+        struct Regs
+        {
+            uint8_t v[0x10];
+            uint16_t i;
+
+            explicit Regs(const CPU& cpu) { load(cpu); }
+            void load(const CPU& cpu)
+            { std::memcpy(v, cpu.v_, sizeof(v)); i = cpu.i_; }
+            void store(CPU& cpu) const
+            { std::memcpy(cpu.v_, v, sizeof(v)); cpu.i_ = i; }
+
+            //Block result, after writing registers back
+            uint64_t leave(CPU& cpu, uint32_t cycles, uint32_t pc) const
+            { store(cpu); return (static_cast<uint64_t>(cycles) << 32) | pc; }
+
+            //Execute the instruction at addr with its interpreter handler,
+            //returning false, with no effect, if it would throw
+            bool interpret(CPU& cpu, uint16_t addr)
+            {
+                store(cpu);
+                if(Aot::interpret(cpu, addr) == BAIL) return false;
+                load(cpu);
+                return true;
+            }
+        };
+
+        static uint16_t pc(const CPU& cpu) { return cpu.pc_; }
+
+        //2nnn, 00EE: false, with no effect, if the stack over/underflows
+        static bool call(CPU& cpu, uint16_t ret)
+        {
+            if(cpu.sp_ >= STACK_MAX_SIZE) return false;
+            cpu.stack_[cpu.sp_++] = ret;
+            return true;
+        }
+        static bool ret(CPU& cpu, uint16_t& pc)
+        {
+            if(cpu.sp_ == 0) return false;
+            pc = cpu.stack_[--cpu.sp_];
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t BAIL = 0xFFFFFFFF;
+        static uint32_t interpret(CPU& cpu, uint16_t addr);
+
+        const StaticProgram& program_;
+        uint16_t entry_[RAM_SIZE];  //1 + index of live block at address, or 0
+        bool is_code_[RAM_SIZE];    //Byte translated into any block
+        unsigned int max_block_size_;   //Bytes
+
+    public:
+        explicit Aot(const StaticProgram&);
+        Aot(const Aot&) = delete;
+        Aot& operator=(const Aot&) = delete;
+
+        const StaticProgram& program() const { return program_; }
+
+        //(Re)enable exactly the blocks whose bytes cpu's RAM holds
+        void verify(const CPU& cpu);
+
+        //Execute one block at cpu.pc_, returning false if none could be run
+        bool run(CPU& cpu, uint64_t end, unsigned int stop_on);
+
+        //Disable any block containing a byte in [begin, end]
+        void invalidate(unsigned int begin, unsigned int end);
+    };
+}
+#endif //CHIP8_AOT_H_OLIVECC
@@ -0,0 +1,820 @@
+#ifndef CHIP8_BATCH_H_OLIVECC
+#define CHIP8_BATCH_H_OLIVECC
+
+#include <algorithm>    //std::min, std::max
+#include <bitset>       //std::bitset
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstring>      //std::memcpy, size_t
+#include <memory>       //std::unique_ptr, std::make_unique
+#include <random>       //std::minstd_rand, std::random_device
+#include <type_traits>  //std::remove_pointer_t
+
+#include "chip8.h"
+#include "chip8_display.h"
+
+namespace chip8
+{
+    //N instances of the same program, stepped in lockstep: every lane
+    //executes one cycle per cycle of the batch. State is held as structure of
+    //arrays (e.g. v_[0x3][lane]), so that each opcode is executed across all
+    //lanes sharing its pc (and opcode) by one loop over contiguous lanes,
+    //which the compiler vectorises for the target's SIMD extension (AVX2,
+    //SSE2, ...). Divergent lanes are grouped by pc, each group executing in
+    //turn within the cycle.
+    //
+    //Each lane is bit-exact with a CPU run for the same cycles with the same
+    //input and RNG seed, and may be loaded from/stored to a CPU. Errors can't be thrown
+    //for a single lane, so a faulting lane instead stops, raising STOP_FAULT;
+    //fault() returns the cpu_exception the CPU would have thrown.
+    //
+    //Batches are large (over 4 KB per lane), so should be heap-allocated.
+    template<unsigned int N>
+    class Batch
+    {
+        static_assert(N > 0, "Batch requires at least one lane");
+
+    private:
+        enum State : uint8_t { RUNNING, AWAITING_KEY, FAULTED };
+
+        //Lane state: registers indexed [register][lane], memory [lane][addr]
+        uint8_t ram_[N][RAM_SIZE];
+        uint64_t display_[N][DISPLAY_WORDS];
+        uint8_t v_[0x10][N];
+        uint16_t i_[N];
+        uint16_t pc_[N];
+        uint64_t delay_end_[N];     //Timers, as Scheduler::timer_end()
+        uint64_t sound_end_[N];
+        uint16_t stack_[STACK_MAX_SIZE][N];
+        uint8_t sp_[N];
+        bool is_held_[N][static_cast<unsigned int>(Keys::QUANTITY_OF_KEYS)];
+        bool hires_[N];             //Extended variants' state (see CPU)
+        uint8_t planes_[N];
+        uint8_t flag_registers_[N][FLAG_REGISTERS];
+        uint8_t audio_pattern_[N][AUDIO_PATTERN_SIZE];
+        uint8_t audio_pitch_[N];
+        State state_[N];
+        const char* fault_what_[N];
+        int fault_address_[N];
+
+        //Addresses at which lanes' RAM may differ (written by Fx33/Fx55/5xy2,
+        //or loaded): elsewhere, lanes sharing a pc share an opcode
+        bool divergent_[RAM_SIZE];
+
+        //Shared run loop state: as CPU
+        Scheduler scheduler_;
+        unsigned int events_;
+
+        std::minstd_rand rng_[N];
+
+        //Options and settings: shared by all lanes
+        bool key_up_FX0A_;
+        bool old_press_FX0A_;
+        bool new_8XYU_;
+        bool new_FXU5_;
+        uint32_t argb_pixel_;
+        uint32_t argb_no_pixel_;
+
+        void tick() { if(scheduler_.tick()) events_ |= STOP_FRAME; }
+        void step();
+        void execute(uint16_t opcode, const uint8_t* mask);
+        void fault(unsigned int lane, const char* what, int address);
+
+        //Lanes in mask, other than those for which pred(lane), fault at the
+        //current instruction
+        template<typename Pred>
+        void require(const uint8_t* mask, const char* what, Pred pred);
+
+    public:
+        Batch(const void* program, size_t size, Flags flags = NO_FLAGS);
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        static constexpr unsigned int lanes() { return N; }
+
+        //As CPU, stopping when an event in stop_on is raised by any lane
+        RunResult run_cycles(unsigned long n, unsigned int stop_on = STOP_NONE);
+        RunResult run_until_frame(unsigned int stop_on = STOP_NONE);
+
+        Batch& pump_input(unsigned int lane, Keys, bool);
+        Batch& set_keys(unsigned int lane, uint16_t mask);  //As CPU
+        const uint32_t* framebuffer(unsigned int lane, uint32_t* argb) const
+        { return expand_display(display_[lane], argb_pixel_, argb_no_pixel_,
+                                argb); }
+        const uint64_t* display(unsigned int lane) const
+        { return display_[lane]; }
+        bool is_sound(unsigned int lane) const
+        { return scheduler_.timer_value(sound_end_[lane]) > 0; }
+        Batch& seed_rng(unsigned int lane, uint32_t seed)
+        { rng_[lane].seed(seed); return *this; }
+
+        bool is_faulted(unsigned int lane) const
+        { return state_[lane] == FAULTED; }
+        cpu_exception fault(unsigned int lane) const
+        { return cpu_exception(fault_what_[lane], fault_address_[lane]); }
+
+        //Copy machine state (not settings or run loop state) between a lane
+        //and a CPU, timers by their current value. A faulted lane is resumed
+        //by loading it.
+        Batch& load_lane(unsigned int lane, const CPU&);
+        const Batch& store_lane(unsigned int lane, CPU&) const;
+
+        const Scheduler& scheduler() const { return scheduler_; }
+
+
+        //Getters/setters for settings
+        unsigned int get_clock_speed_hz()
+        { return scheduler_.get_clock_speed_hz(); }
+        Batch& set_clock_speed_hz(unsigned int set)
+        { scheduler_.set_clock_speed_hz(set); return *this; }
+
+        uint32_t get_argb_pixel() { return argb_pixel_; }
+        Batch& set_argb_pixel(uint32_t set)
+        { argb_pixel_ = set; return *this; }
+
+        uint32_t get_argb_no_pixel() { return argb_no_pixel_; }
+        Batch& set_argb_no_pixel(uint32_t set)
+        { argb_no_pixel_ = set; return *this; }
+    };
+
+
+    template<unsigned int N>
+    Batch<N>::Batch(const void* program, size_t size, Flags flags)
+        : divergent_{}, scheduler_{}, events_{}
+    {
+        //Lanes boot as a CPU would, including its interpretation of flags.
+        //It is allocated, its RAM alone being 64 KB in XO-CHIP builds.
+        const std::unique_ptr<CPU> cpu =
+            std::make_unique<CPU>(program, size, flags);
+        CPU& boot = *cpu;
+
+        for(unsigned int lane = 0; lane < N; ++lane)
+            boot.copy_ram(ram_[lane]);
+
+        key_up_FX0A_    = boot.key_up_FX0A_;
+        old_press_FX0A_ = boot.old_press_FX0A_;
+        new_8XYU_       = boot.new_8XYU_;
+        new_FXU5_       = boot.new_FXU5_;
+        argb_pixel_     = boot.palette_[1];
+        argb_no_pixel_  = boot.palette_[0];
+        set_clock_speed_hz(boot.get_clock_speed_hz());
+
+        std::random_device seeder;
+        for(unsigned int lane = 0; lane < N; ++lane)
+        {
+            load_lane(lane, boot);
+            seed_rng(lane, seeder());
+        }
+    }
+
+    template<unsigned int N>
+    Batch<N>& Batch<N>::load_lane(unsigned int lane, const CPU& cpu)
+    {
+        //Compare against any other lane: all agree where not divergent
+        const unsigned int other = (lane + 1) % N;
+        cpu.copy_ram(ram_[lane]);
+        for(unsigned int addr = 0; addr < RAM_SIZE; ++addr)
+            divergent_[addr] |= (ram_[lane][addr] != ram_[other][addr]);
+        std::memcpy(display_[lane], cpu.display_, sizeof(cpu.display_));
+        for(unsigned int r = 0; r < 0x10; ++r) v_[r][lane] = cpu.v_[r];
+        i_[lane] = cpu.i_;
+        pc_[lane] = cpu.pc_;
+        delay_end_[lane] = scheduler_.timer_end(
+            cpu.scheduler_.timer_value(cpu.delay_end_));
+        sound_end_[lane] = scheduler_.timer_end(
+            cpu.scheduler_.timer_value(cpu.sound_end_));
+        for(unsigned int s = 0; s < STACK_MAX_SIZE; ++s)
+            stack_[s][lane] = cpu.stack_[s];
+        sp_[lane] = cpu.sp_;
+        std::memcpy(is_held_[lane], cpu.is_held_, sizeof(cpu.is_held_));
+        rng_[lane] = cpu.rng_;
+        hires_[lane] = cpu.hires_;
+        planes_[lane] = cpu.planes_;
+        std::memcpy(flag_registers_[lane], cpu.flag_registers_,
+                    sizeof(cpu.flag_registers_));
+        std::memcpy(audio_pattern_[lane], cpu.audio_pattern_,
+                    sizeof(cpu.audio_pattern_));
+        audio_pitch_[lane] = cpu.audio_pitch_;
+        state_[lane] = cpu.paused_ ? AWAITING_KEY : RUNNING;
+        fault_what_[lane] = nullptr;
+        fault_address_[lane] = -1;
+
+        return *this;
+    }
+
+    template<unsigned int N>
+    const Batch<N>& Batch<N>::store_lane(unsigned int lane, CPU& cpu) const
+    {
+        cpu.load_ram(ram_[lane]);
+        std::memcpy(cpu.display_, display_[lane], sizeof(cpu.display_));
+        cpu.mark_dirty(ALL_ROWS);
+        for(unsigned int r = 0; r < 0x10; ++r) cpu.v_[r] = v_[r][lane];
+        cpu.i_ = i_[lane];
+        cpu.pc_ = pc_[lane];
+        cpu.delay_end_ = cpu.scheduler_.timer_end(
+            scheduler_.timer_value(delay_end_[lane]));
+        cpu.sound_end_ = cpu.scheduler_.timer_end(
+            scheduler_.timer_value(sound_end_[lane]));
+        for(unsigned int s = 0; s < STACK_MAX_SIZE; ++s)
+            cpu.stack_[s] = stack_[s][lane];
+        cpu.sp_ = sp_[lane];
+        std::memcpy(cpu.is_held_, is_held_[lane], sizeof(cpu.is_held_));
+        cpu.rng_ = rng_[lane];
+        cpu.hires_ = hires_[lane];
+        cpu.planes_ = planes_[lane];
+        std::memcpy(cpu.flag_registers_, flag_registers_[lane],
+                    sizeof(cpu.flag_registers_));
+        std::memcpy(cpu.audio_pattern_, audio_pattern_[lane],
+                    sizeof(cpu.audio_pattern_));
+        cpu.audio_pitch_ = audio_pitch_[lane];
+        cpu.paused_ = (state_[lane] == AWAITING_KEY);
+
+        //All of RAM may differ from what was decoded/translated
+        cpu.invalidate(0, RAM_SIZE - 1);
+
+        return *this;
+    }
+
+    template<unsigned int N>
+    Batch<N>& Batch<N>::pump_input(unsigned int lane, Keys key_pressed,
+        bool is_held)
+    {
+        unsigned int key = static_cast<unsigned int>(key_pressed);
+
+        if((state_[lane] == AWAITING_KEY) &&
+           (is_held_[lane][key] == key_up_FX0A_) &&
+           (is_held             != key_up_FX0A_))
+        {
+            //pc_ remains at the awaiting Fx0A
+            state_[lane] = RUNNING;
+            v_[0xF & ram_[lane][pc_[lane]]][lane] = key;
+            pc_[lane] += BYTES_PER_OPCODE;
+        }
+
+        is_held_[lane][key] = is_held;
+
+        return *this;
+    }
+
+    template<unsigned int N>
+    Batch<N>& Batch<N>::set_keys(unsigned int lane, uint16_t mask)
+    {
+        for(unsigned int key = 0; key < 0x10; ++key)
+        {
+            const bool is_held = (mask >> key) & 0x1;
+            if(is_held != is_held_[lane][key])
+                pump_input(lane, static_cast<Keys>(key), is_held);
+        }
+
+        return *this;
+    }
+
+    template<unsigned int N>
+    RunResult Batch<N>::run_cycles(unsigned long n, unsigned int stop_on)
+    {
+        const uint64_t begin = scheduler_.cycle();
+        const uint64_t end =
+            (n < UINT64_MAX - begin) ? begin + n : UINT64_MAX;
+
+        events_ = STOP_NONE;
+        while(scheduler_.cycle() < end)
+        {
+            tick();
+            step();
+
+            if(events_ & stop_on)
+            {
+                return {static_cast<unsigned long>(scheduler_.cycle() - begin),
+                        static_cast<StopReason>(events_ & stop_on)};
+            }
+        }
+
+        return {static_cast<unsigned long>(scheduler_.cycle() - begin),
+                STOP_CYCLES};
+    }
+
+    template<unsigned int N>
+    RunResult Batch<N>::run_until_frame(unsigned int stop_on)
+    {
+        static constexpr unsigned long unbounded = -1;
+        return run_cycles(unbounded, stop_on | STOP_FRAME);
+    }
+
+    template<unsigned int N>
+    void Batch<N>::fault(unsigned int lane, const char* what, int address)
+    {
+        state_[lane] = FAULTED;
+        fault_what_[lane] = what;
+        fault_address_[lane] = address;
+        events_ |= STOP_FAULT;
+    }
+
+    template<unsigned int N>
+    template<typename Pred>
+    void Batch<N>::require(const uint8_t* mask, const char* what, Pred pred)
+    {
+        for(unsigned int lane = 0; lane < N; ++lane)
+        {
+            if(mask[lane] && !pred(lane))
+            {
+                //pc_ is decremented due to previously being incremented
+                fault(lane, what, pc_[lane] - BYTES_PER_OPCODE);
+            }
+        }
+    }
+
+    template<unsigned int N>
+    void Batch<N>::step()
+    {
+        alignas(32) uint8_t pending[N];
+        alignas(32) uint8_t mask[N];
+
+        for(unsigned int lane = 0; lane < N; ++lane)
+            pending[lane] = (state_[lane] == RUNNING) ? 0xFF : 0x00;
+
+        //Each pending lane leads the group of lanes sharing its pc and opcode
+        //(lanes' RAM may differ through Fx33/Fx55)
+        for(unsigned int lead = 0; lead < N; ++lead)
+        {
+            if(!pending[lead]) continue;
+
+            const uint16_t pc = pc_[lead];
+            if(static_cast<uint16_t>(pc - PROGRAM_BEGIN) >= PROGRAM_SIZE - 1)
+            {
+                fault(lead, "PC address is invalid, opcode can't be fetched",
+                      pc);
+                pending[lead] = 0x00;
+                continue;
+            }
+
+            const uint8_t hi = ram_[lead][pc];
+            const uint8_t lo = ram_[lead][pc + 1];
+            if(divergent_[pc] || divergent_[pc + 1])
+            {
+                for(unsigned int lane = 0; lane < N; ++lane)
+                {
+                    const bool same = (pc_[lane] == pc) &&
+                        (ram_[lane][pc] == hi) && (ram_[lane][pc + 1] == lo);
+                    mask[lane] = pending[lane] & (same ? 0xFF : 0x00);
+                }
+            }
+            else
+            {
+                for(unsigned int lane = 0; lane < N; ++lane)
+                {
+                    const bool same = (pc_[lane] == pc);
+                    mask[lane] = pending[lane] & (same ? 0xFF : 0x00);
+                }
+            }
+            for(unsigned int lane = 0; lane < N; ++lane)
+                pending[lane] &= ~mask[lane];
+
+            for(unsigned int lane = 0; lane < N; ++lane)
+            {
+                if(mask[lane]) pc_[lane] = pc + BYTES_PER_OPCODE;
+            }
+
+            execute((hi << 8) | lo, mask);
+        }
+    }
+
+    template<unsigned int N>
+    void Batch<N>::execute(uint16_t opcode, const uint8_t* mask)
+    {
+        const uint8_t x  = 0xF  & (opcode >> 8);
+        const uint8_t y  = 0xF  & (opcode >> 4);
+        const uint8_t z  = 0xF  &  opcode;
+        const uint8_t kk = 0xFF &  opcode;
+        const uint16_t nnn = 0xFFF & opcode;
+
+        uint8_t* const vx = v_[x];
+        uint8_t* const vy = v_[y];
+        uint8_t* const vf = v_[0xF];
+
+        //Assign f(lane) to dest in lanes of the group. Values are computed
+        //for all lanes before any are assigned, so f may read dest.
+        auto assign = [mask](auto* dest, auto f)
+        {
+            alignas(32) std::remove_pointer_t<decltype(dest)> value[N];
+            for(unsigned int lane = 0; lane < N; ++lane)
+                value[lane] = f(lane);
+            for(unsigned int lane = 0; lane < N; ++lane)
+                dest[lane] = mask[lane] ? value[lane] : dest[lane];
+        };
+        //As assign to Vx, then VF := flag(lane) (so VF holds the flag when 
+        //x == 0xF)
+        auto assign_vx_vf = [mask, vx, vf](auto f, auto flag)
+        {
+            alignas(32) uint8_t value[N];
+            alignas(32) uint8_t carry[N];
+            for(unsigned int lane = 0; lane < N; ++lane)
+            {
+                value[lane] = f(lane);
+                carry[lane] = flag(lane);
+            }
+            for(unsigned int lane = 0; lane < N; ++lane)
+                vx[lane] = mask[lane] ? value[lane] : vx[lane];
+            for(unsigned int lane = 0; lane < N; ++lane)
+                vf[lane] = mask[lane] ? carry[lane] : vf[lane];
+        };
+        //Skip the next instruction in lanes of the group where cond(lane)
+        auto skip_if = [this, mask](auto cond)
+        {
+            alignas(32) uint16_t skip[N];
+            for(unsigned int lane = 0; lane < N; ++lane)
+            {
+                skip[lane] = cond(lane) 
+                    ? CPU::skip_length(ram_[lane], pc_[lane]) : 0;
+            }
+            for(unsigned int lane = 0; lane < N; ++lane)
+                pc_[lane] += mask[lane] ? skip[lane] : 0;
+        };
+        //Execute f(lane) for each lane of the group, in turn
+        auto each = [this, mask](auto f)
+        {
+            for(unsigned int lane = 0; lane < N; ++lane)
+            {
+                if(mask[lane] && state_[lane] == RUNNING) f(lane);
+            }
+        };
+        auto invalid = [this, mask]()
+        {
+            require(mask, "Invalid opcode", [](unsigned int) { return false; });
+        };
+        //As CPU::scale()
+        auto scale = [this](unsigned int lane) -> unsigned int
+            { return (HAS_SCHIP && !hires_[lane]) ? 2 : 1; };
+        //Display operations (see chip8_display.h) of each lane
+        auto scroll = [&](auto op, unsigned int n)
+        {
+            each([&](unsigned int lane)
+                { op(display_[lane], planes_[lane], n * scale(lane)); });
+            events_ |= STOP_DRAW;
+        };
+        auto set_hires = [&](bool hires)
+        {
+            each([&](unsigned int lane)
+            {
+                hires_[lane] = hires;
+                if(HAS_XOCHIP) clear_planes(display_[lane], (1U << PLANES) - 1);
+            });
+            if(HAS_XOCHIP) events_ |= STOP_DRAW;
+        };
+
+        switch(0xF & (opcode >> 12))
+        {
+        case(0x0):
+            if(opcode == 0x00E0)
+            {
+                each([this](unsigned int lane)
+                    { clear_planes(display_[lane], planes_[lane]); });
+                events_ |= STOP_DRAW;
+            }
+            else if(HAS_SCHIP && (opcode & 0xFFF0) == 0x00C0)
+                scroll(scroll_down, z);
+            else if(HAS_XOCHIP && (opcode & 0xFFF0) == 0x00D0)
+                scroll(scroll_up, z);
+            else if(HAS_SCHIP && opcode == 0x00FB)
+                scroll(scroll_right, 4);
+            else if(HAS_SCHIP && opcode == 0x00FC)
+                scroll(scroll_left, 4);
+            else if(HAS_SCHIP && opcode == 0x00FD)
+                each([this](unsigned int lane)
+                    { pc_[lane] -= BYTES_PER_OPCODE; });
+            else if(HAS_SCHIP && opcode == 0x00FE)
+                set_hires(false);
+            else if(HAS_SCHIP && opcode == 0x00FF)
+                set_hires(true);
+            else if(opcode == 0x00EE)
+            {
+                require(mask, "00EE: Call stack underflow",
+                    [this](unsigned int lane) { return sp_[lane] != 0x0; });
+                each([this](unsigned int lane)
+                    { pc_[lane] = stack_[--sp_[lane]][lane]; });
+            }
+            else invalid();
+            break;
+        case(0x1):
+            assign(pc_, [nnn](unsigned int) { return nnn; });
+            break;
+        case(0x2):
+            require(mask, "2nnn: Call stack overflow", [this](unsigned int lane)
+                { return sp_[lane] < STACK_MAX_SIZE; });
+            each([this, nnn](unsigned int lane)
+            {
+                stack_[sp_[lane]++][lane] = pc_[lane];
+                pc_[lane] = nnn;
+            });
+            break;
+        case(0x3):
+            skip_if([vx, kk](unsigned int lane) { return vx[lane] == kk; });
+            break;
+        case(0x4):
+            skip_if([vx, kk](unsigned int lane) { return vx[lane] != kk; });
+            break;
+        case(0x5):
+            if(HAS_XOCHIP && (z == 0x2 || z == 0x3))
+            {
+                //As CPU: Vx to Vy, in either order
+                const bool store = (z == 0x2);
+                const unsigned int first = std::min(x, y);
+                const unsigned int n = std::max(x, y) - first;
+                require(mask, "Illegal RAM access",
+                    [this, n, store](unsigned int lane)
+                {
+                    return !((i_[lane] + n >= RAM_SIZE) ||
+                             ((i_[lane] < PROGRAM_BEGIN) && store && (n > 0)));
+                });
+                each([this, x, y, first, n, store](unsigned int lane)
+                {
+                    for(unsigned int iter = 0; iter <= n; ++iter)
+                    {
+                        uint8_t& mem = ram_[lane][i_[lane] + iter];
+                        uint8_t& reg = v_[(x <= y) ? first + iter 
+                                                   : first + n - iter][lane];
+                        if(store) divergent_[i_[lane] + iter] = true;
+                        if(store) mem = reg;
+                        else reg = mem;
+                    }
+                });
+                break;
+            }
+            if(z != 0x0) { invalid(); break; }
+            skip_if([vx, vy](unsigned int lane)
+                { return vx[lane] == vy[lane]; });
+            break;
+        case(0x6):
+            assign(vx, [kk](unsigned int) { return kk; });
+            break;
+        case(0x7):
+            assign(vx, [vx, kk](unsigned int lane)
+                { return static_cast<uint8_t>(vx[lane] + kk); });
+            break;
+        case(0x8):
+            switch(z)
+            {
+            case(0x0):
+                assign(vx, [vy](unsigned int lane) { return vy[lane]; });
+                break;
+            case(0x1):
+                assign(vx, [vx, vy](unsigned int lane)
+                    { return static_cast<uint8_t>(vx[lane] | vy[lane]); });
+                break;
+            case(0x2):
+                assign(vx, [vx, vy](unsigned int lane)
+                    { return static_cast<uint8_t>(vx[lane] & vy[lane]); });
+                break;
+            case(0x3):
+                assign(vx, [vx, vy](unsigned int lane)
+                    { return static_cast<uint8_t>(vx[lane] ^ vy[lane]); });
+                break;
+            case(0x4):
+                assign_vx_vf(
+                    [vx, vy](unsigned int lane)
+                        { return static_cast<uint8_t>(vx[lane] + vy[lane]); },
+                    [vx, vy](unsigned int lane)
+                        { return vx[lane] + vy[lane] > 0xFF; });
+                break;
+            case(0x5):
+                assign_vx_vf(
+                    [vx, vy](unsigned int lane)
+                        { return static_cast<uint8_t>(vx[lane] - vy[lane]); },
+                    [vx, vy](unsigned int lane)
+                        { return vx[lane] >= vy[lane]; });
+                break;
+            case(0x6):
+            {
+                const uint8_t* const vu = new_8XYU_ ? vx : vy;
+                assign_vx_vf(
+                    [vu](unsigned int lane)
+                        { return static_cast<uint8_t>(vu[lane] >> 1); },
+                    [vu](unsigned int lane)
+                        { return vu[lane] & 0x01; });
+                break;
+            }
+            case(0x7):
+                //Vy is read after Vx is assigned, so is the result if y == x
+                assign_vx_vf(
+                    [vx, vy](unsigned int lane)
+                        { return static_cast<uint8_t>(vy[lane] - vx[lane]); },
+                    [vx, vy, x, y](unsigned int lane)
+                        { return (y == x) || (vy[lane] >= vx[lane]); });
+                break;
+            case(0xE):
+            {
+                const uint8_t* const vu = new_8XYU_ ? vx : vy;
+                assign_vx_vf(
+                    [vu](unsigned int lane)
+                        { return static_cast<uint8_t>(vu[lane] << 1); },
+                    [vu](unsigned int lane)
+                        { return vu[lane] >> 7; });
+                break;
+            }
+            default:
+                break;
+            }
+            break;
+        case(0x9):
+            if(z != 0x0) { invalid(); break; }
+            skip_if([vx, vy](unsigned int lane)
+                { return vx[lane] != vy[lane]; });
+            break;
+        case(0xA):
+            assign(i_, [nnn](unsigned int) { return nnn; });
+            break;
+        case(0xB):
+            assign(pc_, [this, nnn](unsigned int lane)
+                { return static_cast<uint16_t>(nnn + v_[0x0][lane]); });
+            break;
+        case(0xC):
+            each([this, vx, kk](unsigned int lane)
+                { vx[lane] = (rng_[lane]() & 0xFF) & kk; });
+            break;
+        case(0xD):
+        {
+            //As CPU: Dxy0 draws 16x16 in SUPER-CHIP, a sprite per plane
+            const bool is_big = HAS_SCHIP && (z == 0);
+            const unsigned int lines = is_big ? 16 : z;
+            const unsigned int width = is_big ? 16 : 8;
+            auto bytes = [this, lines, width](unsigned int lane)
+            {
+                return lines * (width / 8) * 
+                    static_cast<unsigned int>(
+                        std::bitset<PLANES>(planes_[lane]).count());
+            };
+
+            events_ |= STOP_DRAW;
+            assign(vf, [](unsigned int) { return uint8_t{0}; });
+            require(mask, "Illegal RAM access", [this, bytes](unsigned int lane)
+            {
+                return !((i_[lane] + bytes(lane) - 1 >= RAM_SIZE) && 
+                         (bytes(lane) > 0));
+            });
+            each([&](unsigned int lane)
+            {
+                bool collision;
+                draw_sprite(display_[lane], planes_[lane], scale(lane),
+                            vx[lane], vy[lane], ram_[lane] + i_[lane], 
+                            lines, width, collision);
+                vf[lane] = collision;
+            });
+            break;
+        }
+        case(0xE):
+            if(kk != 0x9E && kk != 0xA1) { invalid(); break; }
+            require(mask, "Exkk: non-nibble Vx (no equivalent key)",
+                [vx](unsigned int lane) { return vx[lane] < 0x10; });
+            skip_if([this, vx, kk](unsigned int lane)
+            {
+                return state_[lane] == RUNNING &&
+                       is_held_[lane][vx[lane]] == (kk == 0x9E);
+            });
+            break;
+        case(0xF):
+            switch(kk)
+            {
+            case(0x07):
+                assign(vx, [this](unsigned int lane)
+                    { return scheduler_.timer_value(delay_end_[lane]); });
+                break;
+            case(0x0A):
+                each([this, vx](unsigned int lane)
+                {
+                    if(old_press_FX0A_)
+                    {
+                        for(unsigned int key = 0x0; key < 0x10; ++key)
+                        {
+                            if(is_held_[lane][key] == !key_up_FX0A_)
+                            {
+                                vx[lane] = key;
+                                return;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        state_[lane] = AWAITING_KEY;
+                    }
+                    pc_[lane] -= BYTES_PER_OPCODE;
+                    events_ |= STOP_AWAIT_KEY;
+                });
+                break;
+            case(0x15):
+                assign(delay_end_, [this, vx](unsigned int lane)
+                    { return scheduler_.timer_end(vx[lane]); });
+                break;
+            case(0x18):
+                assign(sound_end_, [this, vx](unsigned int lane)
+                    { return scheduler_.timer_end(vx[lane]); });
+                events_ |= STOP_SOUND;
+                break;
+            case(0x1E):
+                assign(i_, [this, vx](unsigned int lane)
+                    { return static_cast<uint16_t>(i_[lane] + vx[lane]); });
+                break;
+            case(0x29):
+                assign(i_, [vx](unsigned int lane)
+                    { return font_address(vx[lane]); });
+                break;
+            case(0x30):
+                if(!HAS_SCHIP) { invalid(); break; }
+                assign(i_, [vx](unsigned int lane)
+                    { return big_font_address(vx[lane] & 0xF); });
+                break;
+            case(0x75):
+            case(0x85):
+            {
+                if(!HAS_SCHIP) { invalid(); break; }
+                const bool store = (kk == 0x75);
+                require(mask, store ? "Fx75: No such flag register"
+                                    : "Fx85: No such flag register",
+                    [x](unsigned int) { return x < FLAG_REGISTERS; });
+                each([this, x, store](unsigned int lane)
+                {
+                    for(unsigned int iter = 0; iter <= x; ++iter)
+                    {
+                        uint8_t& flag = flag_registers_[lane][iter];
+                        if(store) flag = v_[iter][lane];
+                        else v_[iter][lane] = flag;
+                    }
+                });
+                break;
+            }
+            case(0x00):
+                if(!HAS_XOCHIP || x != 0x0) { invalid(); break; }
+                require(mask, "Illegal RAM access", [this](unsigned int lane)
+                    { return pc_[lane] >= PROGRAM_BEGIN; });
+                each([this](unsigned int lane)
+                {
+                    const uint16_t pc = pc_[lane];
+                    i_[lane] = (ram_[lane][pc] << 8) | ram_[lane][pc + 1];
+                    pc_[lane] += BYTES_PER_OPCODE;
+                });
+                break;
+            case(0x01):
+                if(!HAS_XOCHIP) { invalid(); break; }
+                assign(planes_, [x](unsigned int)
+                    { return static_cast<uint8_t>(x & ((1U << PLANES) - 1)); });
+                break;
+            case(0x02):
+                if(!HAS_XOCHIP || x != 0x0) { invalid(); break; }
+                require(mask, "Illegal RAM access", [this](unsigned int lane)
+                    { return i_[lane] + AUDIO_PATTERN_SIZE - 1 < RAM_SIZE; });
+                each([this](unsigned int lane)
+                {
+                    std::memcpy(audio_pattern_[lane], ram_[lane] + i_[lane],
+                                AUDIO_PATTERN_SIZE);
+                });
+                break;
+            case(0x3A):
+                if(!HAS_XOCHIP) { invalid(); break; }
+                assign(audio_pitch_, [vx](unsigned int lane)
+                    { return vx[lane]; });
+                break;
+            case(0x33):
+                require(mask, "Illegal RAM access", [this](unsigned int lane)
+                {
+                    return !((i_[lane] < PROGRAM_BEGIN) ||
+                             (i_[lane] + 2 >= RAM_SIZE));
+                });
+                each([this, vx](unsigned int lane)
+                {
+                    divergent_[i_[lane] + 0] = true;
+                    divergent_[i_[lane] + 1] = true;
+                    divergent_[i_[lane] + 2] = true;
+                    ram_[lane][i_[lane] + 0] = (vx[lane] / 100) % 10;
+                    ram_[lane][i_[lane] + 1] = (vx[lane] /  10) % 10;
+                    ram_[lane][i_[lane] + 2] = (vx[lane] /   1) % 10;
+                });
+                break;
+            case(0x55):
+            case(0x65):
+            {
+                const bool store = (kk == 0x55);
+                require(mask, "Illegal RAM access",
+                    [this, x, store](unsigned int lane)
+                {
+                    return !((i_[lane] + x >= RAM_SIZE) ||
+                             ((i_[lane] < PROGRAM_BEGIN) && store && (x > 0)));
+                });
+                each([this, x, store](unsigned int lane)
+                {
+                    for(unsigned int iter = 0; iter <= x; ++iter)
+                    {
+                        uint8_t& mem = ram_[lane][i_[lane] + iter];
+                        if(store) divergent_[i_[lane] + iter] = true;
+                        if(store) mem = v_[iter][lane];
+                        else v_[iter][lane] = mem;
+                    }
+                    if(!new_FXU5_) i_[lane] += x + 1;
+                });
+                break;
+            }
+            default:
+                invalid();
+                break;
+            }
+            break;
+        }
+    }
+}
+#endif //CHIP8_BATCH_H_OLIVECC
@@ -0,0 +1,136 @@
+#include <cstddef>      //size_t
+#include <cstdint>      //uint16_t, uint64_t, UINT64_MAX
+#include <memory>       //std::make_unique
+
+#include "chip8.h"
+#include "chip8_jit.h"
+
+using namespace chip8;
+
+CPU::Debug& CPU::debug()
+{
+    if(!debug_)
+    {
+        debug_ = std::make_unique<Debug>();
+        debug_->resumed_at = UINT64_MAX;
+
+        //Tight loops translated before iterate without returning to the
+        //run loop, so would never break: they leave each iteration once
+        //translated again
+        if(jit_) jit_->invalidate(0, RAM_SIZE - 1);
+    }
+    return *debug_;
+}
+
+bool CPU::is_break()
+{
+    Debug& debug = *debug_;
+
+    //Conditions break as they become true, so a run may resume past them
+    bool is_met = false;
+    for(size_t c = 0; c < debug.conditions.size(); ++c)
+    {
+        const BreakCondition& condition = debug.conditions[c];
+        const unsigned int value = (condition.reg == BreakCondition::REG_I)
+            ? i_ : v_[condition.reg];
+        bool holds = false;
+        const unsigned int operand = condition.value;
+        switch(condition.compare)
+        {
+        case(BreakCondition::EQUAL):     holds = (value == operand); break;
+        case(BreakCondition::NOT_EQUAL): holds = (value != operand); break;
+        case(BreakCondition::LESS):      holds = (value < operand);  break;
+        case(BreakCondition::GREATER):   holds = (value > operand);  break;
+        }
+        is_met |= holds && !debug.were_met[c];
+        debug.were_met[c] = holds;
+    }
+
+    //Not again on the cycle last broken on, which a run resumes from
+    const uint64_t cycle = scheduler_.cycle();
+    if(cycle == debug.resumed_at || !(is_met || is_breakpoint(pc_)))
+        return false;
+    debug.resumed_at = cycle;
+    return true;
+}
+
+void CPU::watch_range(unsigned int addr, unsigned int size, Watch access)
+{
+    for(unsigned int b = addr; b < addr + size; ++b)
+    {
+        if(debug_->watchpoints[b] & access)
+        {
+            debug_->hit = {static_cast<uint16_t>(pc_ - BYTES_PER_OPCODE),
+                           static_cast<uint16_t>(b), access};
+            events_ |= STOP_WATCH;
+            return;
+        }
+    }
+}
+
+CPU& CPU::set_breakpoint(uint16_t addr)
+{
+    if(addr >= RAM_SIZE) throw cpu_exception("Breakpoint is outside RAM");
+    debug().breakpoints[addr / 64] |= uint64_t{1} << (addr % 64);
+
+    //Blocks spanning it end before it once translated again
+    if(jit_) jit_->invalidate(addr, addr);
+    return *this;
+}
+
+CPU& CPU::clear_breakpoint(uint16_t addr)
+{
+    if(debug_ && addr < RAM_SIZE)
+        debug_->breakpoints[addr / 64] &= ~(uint64_t{1} << (addr % 64));
+    return *this;
+}
+
+CPU& CPU::set_watchpoint(uint16_t addr, uint16_t size, Watch access)
+{
+    if(addr + size > RAM_SIZE) throw cpu_exception("Watchpoint is outside RAM");
+
+    Debug& debug = this->debug();
+    const bool was_watching = (debug.watched > 0);
+    for(unsigned int b = addr; b < addr + size; ++b)
+    {
+        if(!debug.watchpoints[b] && access) ++debug.watched;
+        debug.watchpoints[b] |= access;
+    }
+
+    //Blocks continuing after Fx65 end after it once translated again
+    if(jit_ && !was_watching && debug.watched)
+        jit_->invalidate(0, RAM_SIZE - 1);
+    return *this;
+}
+
+CPU& CPU::clear_watchpoint(uint16_t addr, uint16_t size)
+{
+    if(!debug_) return *this;
+    for(unsigned int b = addr; b < addr + size && b < RAM_SIZE; ++b)
+    {
+        if(debug_->watchpoints[b]) --debug_->watched;
+        debug_->watchpoints[b] = 0;
+    }
+    return *this;
+}
+
+CPU& CPU::add_break_condition(const BreakCondition& condition)
+{
+    if(condition.reg > BreakCondition::REG_I ||
+       condition.compare > BreakCondition::GREATER)
+    {
+        throw cpu_exception("Break condition is invalid");
+    }
+    Debug& debug = this->debug();
+    debug.conditions.push_back(condition);
+    debug.were_met.push_back(false);
+    return *this;
+}
+
+CPU& CPU::clear_debug()
+{
+    //Blocks ended early for it are translated whole again
+    if(debug_ && jit_) jit_->invalidate(0, RAM_SIZE - 1);
+    debug_.reset();
+    return *this;
+}
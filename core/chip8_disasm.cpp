@@ -0,0 +1,244 @@
+#include <cstdint>      //uint8_t, uint16_t
+#include <cstdio>       //std::snprintf
+#include <string>       //std::string
+#include <vector>       //std::vector
+
+#include "chip8.h"
+#include "chip8_disasm.h"
+
+using namespace chip8;
+
+namespace
+{
+    struct Program
+    {
+        const uint8_t* bytes;
+        size_t size;
+
+        uint8_t at(unsigned int addr) const
+        {
+            return (addr >= PROGRAM_BEGIN && addr - PROGRAM_BEGIN < size)
+                ? bytes[addr - PROGRAM_BEGIN] : 0;
+        }
+        uint16_t opcode_at(unsigned int addr) const
+        { return (at(addr) << 8) | at(addr + 1); }
+
+        //Whether an instruction at addr may be fetched from the program
+        bool contains(unsigned int addr) const
+        {
+            return addr >= PROGRAM_BEGIN && addr - PROGRAM_BEGIN < size &&
+                   addr < RAM_SIZE - 1;
+        }
+    };
+
+    Instruction decode(const Program& program, unsigned int addr)
+    {
+        const uint16_t opcode = program.opcode_at(addr);
+        const uint8_t x  = 0xF  & (opcode >> 8);
+        const uint8_t kk = 0xFF &  opcode;
+        const uint8_t z  = 0xF  &  opcode;
+
+        Instruction in {static_cast<uint16_t>(addr), opcode, 0,
+                        BYTES_PER_OPCODE, Flow::NEXT, 0, true};
+        auto set = [&in](Flow flow, uint16_t target = 0)
+            { in.flow = flow; in.target = target; };
+
+        switch(0xF & (opcode >> 12))
+        {
+        case(0x0):
+            if(x == 0x0 && kk == 0xEE) set(Flow::RETURN);
+            else if(HAS_SCHIP && x == 0x0 && kk == 0xFD) set(Flow::HALT);
+            else in.is_valid = (x == 0x0) && (kk == 0xE0 ||
+                (HAS_SCHIP && ((kk & 0xF0) == 0xC0 || kk >= 0xFB)) ||
+                (HAS_XOCHIP && (kk & 0xF0) == 0xD0));
+            break;
+        case(0x1): set(Flow::JUMP, 0xFFF & opcode); break;
+        case(0x2): set(Flow::CALL, 0xFFF & opcode); break;
+        case(0x3):
+        case(0x4): set(Flow::SKIP); break;
+        case(0x5):
+            if(z == 0x0) set(Flow::SKIP);
+            else in.is_valid = HAS_XOCHIP && (z == 0x2 || z == 0x3);
+            break;
+        case(0x9):
+            if(z == 0x0) set(Flow::SKIP);
+            else in.is_valid = false;
+            break;
+        case(0xB): set(Flow::COMPUTED); break;
+        case(0xE):
+            if(kk == 0x9E || kk == 0xA1) set(Flow::SKIP);
+            else in.is_valid = false;
+            break;
+        case(0xF):
+            switch(kk)
+            {
+            case(0x07): case(0x0A): case(0x15): case(0x18): case(0x1E):
+            case(0x29): case(0x33): case(0x55): case(0x65):
+                break;
+            case(0x30): case(0x75): case(0x85):
+                in.is_valid = HAS_SCHIP;
+                break;
+            case(0x00):
+                in.is_valid = HAS_XOCHIP && x == 0x0;
+                if(in.is_valid)
+                {
+                    in.operand = program.opcode_at(addr + BYTES_PER_OPCODE);
+                    in.length = 2 * BYTES_PER_OPCODE;
+                }
+                break;
+            case(0x02): in.is_valid = HAS_XOCHIP && x == 0x0; break;
+            case(0x01): case(0x3A): in.is_valid = HAS_XOCHIP; break;
+            default: in.is_valid = false; break;
+            }
+            break;
+        default: break;     //6xkk, 7xkk, 8xyz, Annn, Cxkk, Dxyz
+        }
+
+        if(!in.is_valid) set(Flow::HALT);
+        return in;
+    }
+}
+
+Instruction chip8::decode_instruction(const uint8_t* program, size_t size,
+                                      unsigned int addr)
+{
+    return decode(Program{program, size}, addr);
+}
+
+std::string chip8::disassemble(const Instruction& in)
+{
+    const unsigned int x   = 0xF   & (in.opcode >> 8);
+    const unsigned int y   = 0xF   & (in.opcode >> 4);
+    const unsigned int z   = 0xF   &  in.opcode;
+    const unsigned int kk  = 0xFF  &  in.opcode;
+    const unsigned int nnn = 0xFFF &  in.opcode;
+
+    char text[32];
+    auto put = [&text](const char* mnemonic, const char* format = "",
+                       unsigned int a = 0, unsigned int b = 0,
+                       unsigned int c = 0)
+    {
+        const int n = std::snprintf(text, sizeof(text), "%-5s", mnemonic);
+        std::snprintf(text + n, sizeof(text) - n, format, a, b, c);
+    };
+
+    if(!in.is_valid)
+    {
+        put("DW", "#%04X", in.opcode);
+        return text;
+    }
+
+    switch(0xF & (in.opcode >> 12))
+    {
+    case(0x0):
+        if(kk == 0xE0) put("CLS");
+        else if(kk == 0xEE) put("RET");
+        else if((kk & 0xF0) == 0xC0) put("SCD", "%u", z);
+        else if((kk & 0xF0) == 0xD0) put("SCU", "%u", z);
+        else if(kk == 0xFB) put("SCR");
+        else if(kk == 0xFC) put("SCL");
+        else if(kk == 0xFD) put("EXIT");
+        else if(kk == 0xFE) put("LOW");
+        else put("HIGH");
+        break;
+    case(0x1): put("JP", "#%03X", nnn); break;
+    case(0x2): put("CALL", "#%03X", nnn); break;
+    case(0x3): put("SE", "V%X, #%02X", x, kk); break;
+    case(0x4): put("SNE", "V%X, #%02X", x, kk); break;
+    case(0x5):
+        if(z == 0x0) put("SE", "V%X, V%X", x, y);
+        else put((z == 0x2) ? "SAVE" : "LOAD", "V%X - V%X", x, y);
+        break;
+    case(0x6): put("LD", "V%X, #%02X", x, kk); break;
+    case(0x7): put("ADD", "V%X, #%02X", x, kk); break;
+    case(0x8):
+    {
+        static const char* const names[0x10] = {
+            "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL",
+            nullptr
+        };
+        if(names[z]) put(names[z], "V%X, V%X", x, y);
+        else put("NOP", "(#%04X)", in.opcode);
+        break;
+    }
+    case(0x9): put("SNE", "V%X, V%X", x, y); break;
+    case(0xA): put("LD", "I, #%03X", nnn); break;
+    case(0xB): put("JP", "V0, #%03X", nnn); break;
+    case(0xC): put("RND", "V%X, #%02X", x, kk); break;
+    case(0xD): put("DRW", "V%X, V%X, %u", x, y, z); break;
+    case(0xE): put((kk == 0x9E) ? "SKP" : "SKNP", "V%X", x); break;
+    case(0xF):
+        switch(kk)
+        {
+        case(0x07): put("LD", "V%X, DT", x); break;
+        case(0x0A): put("LD", "V%X, K", x); break;
+        case(0x15): put("LD", "DT, V%X", x); break;
+        case(0x18): put("LD", "ST, V%X", x); break;
+        case(0x1E): put("ADD", "I, V%X", x); break;
+        case(0x29): put("LD", "F, V%X", x); break;
+        case(0x30): put("LD", "HF, V%X", x); break;
+        case(0x33): put("LD", "B, V%X", x); break;
+        case(0x55): put("LD", "[I], V%X", x); break;
+        case(0x65): put("LD", "V%X, [I]", x); break;
+        case(0x75): put("LD", "R, V%X", x); break;
+        case(0x85): put("LD", "V%X, R", x); break;
+        case(0x00): put("LD", "I, #%04X", in.operand); break;
+        case(0x01): put("PLANE", "%u", x); break;
+        case(0x02): put("AUDIO"); break;
+        case(0x3A): put("PITCH", "V%X", x); break;
+        }
+        break;
+    }
+
+    //Trailing padding of operandless mnemonics
+    std::string out = text;
+    out.erase(out.find_last_not_of(' ') + 1);
+    return out;
+}
+
+Listing chip8::trace_program(const uint8_t* bytes, size_t size)
+{
+    const Program program {bytes, size};
+    Listing listing {{}, {}, false};
+
+    std::vector<bool> is_seen(RAM_SIZE), is_leader(RAM_SIZE);
+    std::vector<unsigned int> pending;
+    auto reach = [&](unsigned int addr, bool leads)
+    {
+        if(!program.contains(addr)) return;
+        if(leads) is_leader[addr] = true;
+        if(!is_seen[addr]) { is_seen[addr] = true; pending.push_back(addr); }
+    };
+
+    reach(PROGRAM_BEGIN, true);
+    while(!pending.empty())
+    {
+        const Instruction in = decode(program, pending.back());
+        pending.pop_back();
+
+        const unsigned int next = in.addr + in.length;
+        switch(in.flow)
+        {
+        case(Flow::NEXT): reach(next, false); break;
+        case(Flow::SKIP):
+            reach(next, true);
+            reach(next + decode(program, next).length, true);
+            break;
+        case(Flow::JUMP): reach(in.target, true); break;
+        case(Flow::CALL): reach(in.target, true); reach(next, true); break;
+        case(Flow::COMPUTED): listing.has_computed_jumps = true; break;
+        case(Flow::RETURN):
+        case(Flow::HALT): break;
+        }
+    }
+
+    for(unsigned int addr = PROGRAM_BEGIN; addr < RAM_SIZE; ++addr)
+    {
+        if(!is_seen[addr]) continue;
+        listing.code.push_back(decode(program, addr));
+        if(is_leader[addr]) listing.leaders.push_back(addr);
+    }
+
+    return listing;
+}
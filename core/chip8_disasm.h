@@ -0,0 +1,59 @@
+#ifndef CHIP8_DISASM_H_OLIVECC
+#define CHIP8_DISASM_H_OLIVECC
+
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint16_t
+#include <string>       //std::string
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+//Disassembly of a program as loaded at PROGRAM_BEGIN, decoding opcodes as
+//the CPU built does (see CHIP8_VARIANT). Bytes past the end of the program
+//read as zero, as in the RAM of a CPU just constructed from it.
+namespace chip8
+{
+    //Where control may pass after an instruction
+    enum class Flow : unsigned int
+    {
+        NEXT,       //The following instruction
+        SKIP,       //The following instruction, or the one after it
+        JUMP,       //target (1nnn)
+        CALL,       //target, returning to the following instruction (2nnn)
+        RETURN,     //An address on the stack (00EE)
+        COMPUTED,   //An address known only at run time (Bnnn)
+        HALT        //Nowhere: 00FD, or an invalid opcode (which throws)
+    };
+
+    struct Instruction
+    {
+        uint16_t addr;
+        uint16_t opcode;
+        uint16_t operand;       //XO-CHIP F000 nnnn: nnnn, the following word
+        unsigned int length;    //Bytes
+        Flow flow;
+        uint16_t target;        //JUMP, CALL
+        bool is_valid;
+    };
+
+    Instruction decode_instruction(const uint8_t* program, size_t size,
+                                   unsigned int addr);
+
+    //Mnemonic and operands, after Cowgod's reference (and Octo's names for
+    //XO-CHIP), e.g. "LD   V1, #2A"; invalid opcodes as "DW   #0123"
+    std::string disassemble(const Instruction&);
+
+    //Code reachable from PROGRAM_BEGIN, found by recursive descent: jumps,
+    //calls (and their returns) and both outcomes of skips are followed,
+    //within the program. Code reached only through computed jumps (Bnnn)
+    //or written at run time is not found.
+    struct Listing
+    {
+        std::vector<Instruction> code;      //In order of address
+        std::vector<uint16_t> leaders;      //Basic blocks' first addresses
+        bool has_computed_jumps;
+    };
+
+    Listing trace_program(const uint8_t* program, size_t size);
+}
+#endif //CHIP8_DISASM_H_OLIVECC
@@ -0,0 +1,193 @@
+#ifndef CHIP8_DISPLAY_H_OLIVECC
+#define CHIP8_DISPLAY_H_OLIVECC
+
+#include <cstdint>      //uint8_t, uint32_t, uint64_t
+
+#include "chip8.h"
+
+//Operations on a packed display (see CPU::display()), shared by CPU and
+//Batch so their lanes stay bit-exact. Rows are shifted and sprites placed a
+//word at a time, so a display of more pixels costs more words, not more
+//per-pixel work. Each operation affects the planes in mask planes, and
+//returns the rows (bit y for row y) it may have changed.
+namespace chip8
+{
+    inline uint64_t* display_row(uint64_t* display, unsigned int plane,
+                                 unsigned int y)
+    {
+        return display + (plane * HEIGHT + y) * ROW_WORDS;
+    }
+
+    //Each bit of bits twice over, e.g. a sprite line drawn at 2x scale
+    inline uint64_t double_bits(uint64_t bits)
+    {
+        bits &= 0xFFFF;
+        bits = (bits | (bits << 8)) & 0x00FF00FF;
+        bits = (bits | (bits << 4)) & 0x0F0F0F0F;
+        bits = (bits | (bits << 2)) & 0x33333333;
+        bits = (bits | (bits << 1)) & 0x55555555;
+        return bits | (bits << 1);
+    }
+
+    //A word of bits, from its most significant, as a row rotated right by x
+    //pixels, wrapping horizontally
+    inline void place_row(uint64_t bits, unsigned int x,
+                          uint64_t (&row)[ROW_WORDS])
+    {
+        const unsigned int word = x / 64;
+        const unsigned int shift = x % 64;
+        for(uint64_t& w : row) w = 0;
+        row[word] = bits >> shift;
+        if(shift) row[(word + 1) % ROW_WORDS] |= bits << (64 - shift);
+    }
+
+    inline uint64_t clear_planes(uint64_t* display, unsigned int planes)
+    {
+        uint64_t cleared = 0;
+        for(unsigned int plane = 0; plane < PLANES; ++plane)
+        {
+            if(!((planes >> plane) & 0x1)) continue;
+            for(unsigned int y = 0; y < HEIGHT; ++y)
+            {
+                uint64_t* const row = display_row(display, plane, y);
+                for(unsigned int w = 0; w < ROW_WORDS; ++w)
+                {
+                    cleared |= static_cast<uint64_t>(row[w] != 0) << y;
+                    row[w] = 0;
+                }
+            }
+        }
+        return cleared;
+    }
+
+    //XOR a sprite of lines of width bits (8 or 16, most significant byte
+    //first) into each plane, plane after plane from sprite, at (x, y) in
+    //pixels of scale x scale, wrapping around. collision := whether any
+    //pixel set was cleared.
+    inline uint64_t draw_sprite(uint64_t* display, unsigned int planes,
+        unsigned int scale, unsigned int x, unsigned int y,
+        const uint8_t* sprite, unsigned int lines, unsigned int width,
+        bool& collision)
+    {
+        const unsigned int left = (x % (WIDTH / scale)) * scale;
+        const unsigned int top = (y % (HEIGHT / scale)) * scale;
+        uint64_t hit = 0;
+        uint64_t drawn = 0;
+
+        for(unsigned int plane = 0; plane < PLANES; ++plane)
+        {
+            if(!((planes >> plane) & 0x1)) continue;
+
+            unsigned int row_y = top;
+            for(unsigned int line = 0; line < lines; ++line)
+            {
+                uint64_t bits = *sprite++;
+                if(width == 16) bits = (bits << 8) | *sprite++;
+                unsigned int bits_width = width;
+                if(scale == 2)
+                {
+                    bits = double_bits(bits);
+                    bits_width *= 2;
+                }
+
+                uint64_t placed[ROW_WORDS];
+                place_row(bits << (64 - bits_width), left, placed);
+
+                for(unsigned int s = 0; s < scale; ++s)
+                {
+                    uint64_t* const row = display_row(display, plane, row_y);
+                    for(unsigned int w = 0; w < ROW_WORDS; ++w)
+                    {
+                        hit |= row[w] & placed[w];
+                        row[w] ^= placed[w];
+                        drawn |= 
+                            static_cast<uint64_t>(placed[w] != 0) << row_y;
+                    }
+                    row_y = (row_y + 1) % HEIGHT;
+                }
+            }
+        }
+
+        collision = (hit != 0);
+        return drawn;
+    }
+
+    //Scrolls by n pixels of the display, shifting in unset pixels
+    inline uint64_t scroll_down(uint64_t* display, unsigned int planes,
+                                unsigned int n)
+    {
+        if(n == 0) return 0;
+        for(unsigned int plane = 0; plane < PLANES; ++plane)
+        {
+            if(!((planes >> plane) & 0x1)) continue;
+            for(unsigned int y = HEIGHT; y-- > 0; )
+            {
+                uint64_t* const row = display_row(display, plane, y);
+                const uint64_t* const from = (y >= n)
+                    ? display_row(display, plane, y - n) : nullptr;
+                for(unsigned int w = 0; w < ROW_WORDS; ++w)
+                    row[w] = from ? from[w] : 0;
+            }
+        }
+        return ALL_ROWS;
+    }
+
+    inline uint64_t scroll_up(uint64_t* display, unsigned int planes,
+                              unsigned int n)
+    {
+        if(n == 0) return 0;
+        for(unsigned int plane = 0; plane < PLANES; ++plane)
+        {
+            if(!((planes >> plane) & 0x1)) continue;
+            for(unsigned int y = 0; y < HEIGHT; ++y)
+            {
+                uint64_t* const row = display_row(display, plane, y);
+                const uint64_t* const from = (y + n < HEIGHT)
+                    ? display_row(display, plane, y + n) : nullptr;
+                for(unsigned int w = 0; w < ROW_WORDS; ++w)
+                    row[w] = from ? from[w] : 0;
+            }
+        }
+        return ALL_ROWS;
+    }
+
+    //n in [1, 64)
+    inline uint64_t scroll_right(uint64_t* display, unsigned int planes,
+                                 unsigned int n)
+    {
+        for(unsigned int plane = 0; plane < PLANES; ++plane)
+        {
+            if(!((planes >> plane) & 0x1)) continue;
+            for(unsigned int y = 0; y < HEIGHT; ++y)
+            {
+                uint64_t* const row = display_row(display, plane, y);
+                for(unsigned int w = ROW_WORDS; w-- > 0; )
+                {
+                    row[w] = (row[w] >> n) |
+                             ((w > 0) ? row[w - 1] << (64 - n) : 0);
+                }
+            }
+        }
+        return ALL_ROWS;
+    }
+
+    inline uint64_t scroll_left(uint64_t* display, unsigned int planes,
+                                unsigned int n)
+    {
+        for(unsigned int plane = 0; plane < PLANES; ++plane)
+        {
+            if(!((planes >> plane) & 0x1)) continue;
+            for(unsigned int y = 0; y < HEIGHT; ++y)
+            {
+                uint64_t* const row = display_row(display, plane, y);
+                for(unsigned int w = 0; w < ROW_WORDS; ++w)
+                {
+                    row[w] = (row[w] << n) |
+                        ((w + 1 < ROW_WORDS) ? row[w + 1] >> (64 - n) : 0);
+                }
+            }
+        }
+        return ALL_ROWS;
+    }
+}
+#endif //CHIP8_DISPLAY_H_OLIVECC
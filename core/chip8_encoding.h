@@ -0,0 +1,114 @@
+#ifndef CHIP8_ENCODING_H_OLIVECC
+#define CHIP8_ENCODING_H_OLIVECC
+
+#include <cctype>       //std::toupper
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint32_t, uint64_t
+#include <cstring>      //std::memcmp
+#include <string>       //std::string
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //Encoding shared by the core's binary formats (movies and traces):
+    //little-endian values, LEB128 varints, and a header of an 8 byte magic,
+    //uint32 version and uint32 CHIP8_VARIANT, as they are read by the same
+    //build. Internal to the core.
+    namespace encoding
+    {
+        struct Format
+        {
+            char magic[8];
+            uint32_t version;
+            const char* name;       //In errors, e.g. "movie"
+        };
+        constexpr size_t HEADER_SIZE = 8 + 2 * sizeof(uint32_t);
+
+        template<typename T>
+        void put(std::vector<uint8_t>& out, T value)
+        {
+            for(unsigned int b = 0; b < sizeof(T); ++b)
+                out.push_back(static_cast<uint8_t>(value >> (8 * b)));
+        }
+
+        inline void put_varint(std::vector<uint8_t>& out, uint64_t value)
+        {
+            for(; value >= 0x80; value >>= 7)
+                out.push_back(static_cast<uint8_t>(value | 0x80));
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        inline void put_header(std::vector<uint8_t>& out, const Format& format)
+        {
+            for(char c : format.magic) out.push_back(static_cast<uint8_t>(c));
+            put(out, format.version);
+            put(out, static_cast<uint32_t>(CHIP8_VARIANT));
+        }
+
+        inline bool has(const uint8_t* p, const uint8_t* end, size_t size)
+        {
+            return static_cast<size_t>(end - p) >= size;
+        }
+
+        //Unchecked: see has()
+        template<typename T>
+        T get(const uint8_t*& p)
+        {
+            T value = 0;
+            for(unsigned int b = 0; b < sizeof(T); ++b)
+                value |= static_cast<T>(static_cast<T>(*p++) << (8 * b));
+            return value;
+        }
+
+        //Of format.name, to begin an error
+        inline std::string capitalized(const Format& format)
+        {
+            std::string name = format.name;
+            name[0] = static_cast<char>(std::toupper(name[0]));
+            return name;
+        }
+
+        inline cpu_exception invalid(const Format& format)
+        {
+            return cpu_exception(capitalized(format) + " data is invalid");
+        }
+
+        //False if truncated
+        inline bool get_varint(const uint8_t*& p, const uint8_t* end,
+                               uint64_t& out, const Format& format)
+        {
+            out = 0;
+            for(unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                if(p == end) return false;
+                const uint8_t byte = *p++;
+                out |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if(!(byte & 0x80)) return true;
+            }
+            throw invalid(format);
+        }
+
+        //Thrown if not of format, or of another version or variant
+        inline void get_header(const uint8_t*& p, const uint8_t* end,
+                               const Format& format)
+        {
+            const std::string name = format.name;
+            if(!has(p, end, HEADER_SIZE) ||
+               std::memcmp(p, format.magic, sizeof(format.magic)))
+            {
+                throw cpu_exception("Not a " + name);
+            }
+            p += sizeof(format.magic);
+            if(get<uint32_t>(p) != format.version)
+                throw cpu_exception("Unsupported " + name + " version");
+            if(get<uint32_t>(p) != CHIP8_VARIANT)
+            {
+                throw cpu_exception(capitalized(format) +
+                                    " is of a different CHIP-8 variant");
+            }
+        }
+    }
+}
+#endif //CHIP8_ENCODING_H_OLIVECC
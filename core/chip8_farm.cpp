@@ -0,0 +1,425 @@
+#include <algorithm>    //std::min, std::max
+#include <atomic>       //std::atomic, std::atomic_thread_fence
+#include <chrono>       //std::chrono::milliseconds, std::chrono::microseconds
+#include <condition_variable>   //std::condition_variable
+#include <cstring>      //std::memcpy
+#include <deque>        //std::deque
+#include <memory>       //std::unique_ptr, std::make_unique
+#include <mutex>        //std::mutex, std::lock_guard, std::unique_lock
+#include <thread>       //std::thread, std::this_thread
+
+#include "chip8_farm.h"
+
+#if defined(__linux__)
+#include <pthread.h>    //pthread_setaffinity_np
+#include <sched.h>      //cpu_set_t, CPU_ZERO, CPU_SET
+#define CHIP8_FARM_PIN
+#endif
+
+using namespace chip8;
+
+namespace
+{
+    constexpr size_t cache_line = 64;
+
+    //A job in progress: the CPU is created by the first worker to run it
+    struct Task
+    {
+        std::atomic<Task*> next;    //Completion queue link
+        Job job;
+        std::unique_ptr<CPU> cpu;
+        Result result;
+    };
+
+    //Chase-Lev work-stealing deque of fixed capacity: the owning worker
+    //pushes and pops at the bottom, others steal from the top
+    class alignas(cache_line) Deque
+    {
+    private:
+        static constexpr int64_t capacity = 1 << 10;
+        std::atomic<int64_t> top_{0};
+        alignas(cache_line) std::atomic<int64_t> bottom_{0};
+        std::atomic<Task*> buffer_[capacity];
+
+    public:
+        int64_t space() const
+        {
+            return capacity - (bottom_.load(std::memory_order_relaxed) -
+                               top_.load(std::memory_order_relaxed));
+        }
+
+        bool push(Task* task)
+        {
+            const int64_t b = bottom_.load(std::memory_order_relaxed);
+            const int64_t t = top_.load(std::memory_order_acquire);
+            if(b - t >= capacity) return false;
+
+            buffer_[b & (capacity - 1)].store(task, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        Task* pop()
+        {
+            const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top_.load(std::memory_order_relaxed);
+
+            Task* task = nullptr;
+            if(t <= b)
+            {
+                task = buffer_[b & (capacity - 1)].load(
+                    std::memory_order_relaxed);
+                if(t == b)
+                {
+                    //Last task: race any thief for it
+                    if(!top_.compare_exchange_strong(t, t + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed))
+                    {
+                        task = nullptr;
+                    }
+                    bottom_.store(b + 1, std::memory_order_relaxed);
+                }
+            }
+            else
+            {
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        Task* steal()
+        {
+            int64_t t = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom_.load(std::memory_order_acquire);
+            if(t >= b) return nullptr;
+
+            Task* task = buffer_[t & (capacity - 1)].load(
+                std::memory_order_relaxed);
+            if(!top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return task;
+        }
+    };
+
+    //Intrusive multiple-producer single-consumer queue (Vyukov): push is
+    //wait-free, pop may transiently fail while a push is in progress
+    class Completions
+    {
+    private:
+        alignas(cache_line) std::atomic<Task*> head_;
+        alignas(cache_line) Task* tail_;
+        Task stub_;
+
+    public:
+        Completions() : head_{&stub_}, tail_{&stub_}
+        {
+            stub_.next.store(nullptr, std::memory_order_relaxed);
+        }
+
+        void push(Task* task)
+        {
+            task->next.store(nullptr, std::memory_order_relaxed);
+            Task* prev = head_.exchange(task, std::memory_order_acq_rel);
+            prev->next.store(task, std::memory_order_release);
+        }
+
+        Task* pop()
+        {
+            Task* tail = tail_;
+            Task* next = tail->next.load(std::memory_order_acquire);
+            if(tail == &stub_)
+            {
+                if(!next) return nullptr;
+                tail_ = tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if(next)
+            {
+                tail_ = next;
+                return tail;
+            }
+            if(tail != head_.load(std::memory_order_acquire)) return nullptr;
+
+            push(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if(next)
+            {
+                tail_ = next;
+                return tail;
+            }
+            return nullptr;
+        }
+    };
+}
+
+class Farm::Farm_impl
+{
+private:
+    const unsigned int frames_per_slice_;
+
+    std::vector<std::unique_ptr<Deque>> deques_;
+    std::vector<std::thread> threads_;
+
+    //Submitted jobs not yet taken by a worker
+    std::mutex submitted_mutex_;
+    std::condition_variable submitted_cv_;
+    std::deque<Task*> submitted_;
+    bool stopping_ = false;
+
+    Completions completions_;
+    std::atomic<unsigned long> pending_{0};
+
+    void work(unsigned int index);
+    Task* take_submitted(Deque& own);
+    bool run_slice(Task& task);
+
+public:
+    Farm_impl(unsigned int workers, unsigned int frames_per_slice,
+        bool pin_workers);
+    ~Farm_impl();
+
+    void submit(Job job);
+    bool poll(Result& result);
+    bool wait(Result& result);
+    unsigned long pending() const { return pending_.load(); }
+    unsigned int workers() const
+    { return static_cast<unsigned int>(deques_.size()); }
+};
+
+Farm::Farm_impl::Farm_impl(unsigned int workers,
+    unsigned int frames_per_slice, bool pin_workers)
+    : frames_per_slice_{std::max(frames_per_slice, 1U)}
+{
+    const unsigned int cores = 
+        std::max(std::thread::hardware_concurrency(), 1U);
+    if(workers == 0) workers = cores;
+
+    for(unsigned int w = 0; w < workers; ++w)
+        deques_.push_back(std::make_unique<Deque>());
+
+    for(unsigned int w = 0; w < workers; ++w)
+    {
+        threads_.emplace_back(&Farm_impl::work, this, w);
+
+#ifdef CHIP8_FARM_PIN
+        if(pin_workers)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(w % cores, &set);
+            //Best effort: workers still run if pinning is disallowed
+            pthread_setaffinity_np(threads_.back().native_handle(),
+                sizeof(set), &set);
+        }
+#else
+        static_cast<void>(pin_workers);
+#endif
+    }
+}
+
+Farm::Farm_impl::~Farm_impl()
+{
+    {
+        std::lock_guard<std::mutex> lock(submitted_mutex_);
+        stopping_ = true;
+    }
+    submitted_cv_.notify_all();
+    for(std::thread& thread : threads_) thread.join();
+
+    //Discard unfinished and unretrieved jobs
+    for(Task* task : submitted_) delete task;
+    for(auto& deque : deques_)
+        while(Task* task = deque->pop()) delete task;
+    while(Task* task = completions_.pop()) delete task;
+}
+
+void Farm::Farm_impl::submit(Job job)
+{
+    Task* task = new Task{};
+    task->job = std::move(job);
+    task->result.id = task->job.id;
+
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(submitted_mutex_);
+        submitted_.push_back(task);
+    }
+    submitted_cv_.notify_one();
+}
+
+Task* Farm::Farm_impl::take_submitted(Deque& own)
+{
+    std::lock_guard<std::mutex> lock(submitted_mutex_);
+    if(submitted_.empty()) return nullptr;
+
+    //Take a share of the jobs, leaving the rest for other workers to take
+    //(or steal from this one)
+    const size_t share = std::min<size_t>(
+        {submitted_.size(), submitted_.size() / deques_.size() + 1, 
+         static_cast<size_t>(own.space()) + 1});
+
+    Task* task = submitted_.front();
+    submitted_.pop_front();
+    for(size_t n = 1; n < share; ++n)
+    {
+        own.push(submitted_.front());
+        submitted_.pop_front();
+    }
+    return task;
+}
+
+void Farm::Farm_impl::work(unsigned int index)
+{
+    Deque& own = *deques_[index];
+    const size_t workers = deques_.size();
+
+    for(;;)
+    {
+        Task* task = own.pop();
+
+        for(size_t n = 1; !task && n < workers; ++n)
+            task = deques_[(index + n) % workers]->steal();
+
+        if(!task) task = take_submitted(own);
+
+        if(!task)
+        {
+            //Idle: queued jobs elsewhere are rechecked periodically, new
+            //submissions wake a worker immediately
+            std::unique_lock<std::mutex> lock(submitted_mutex_);
+            if(stopping_) return;
+            submitted_cv_.wait_for(lock, std::chrono::milliseconds(1),
+                [this] { return stopping_ || !submitted_.empty(); });
+            continue;
+        }
+
+        if(run_slice(*task))
+        {
+            task->cpu.reset();
+            completions_.push(task);
+        }
+        else if(!own.push(task))
+        {
+            std::lock_guard<std::mutex> lock(submitted_mutex_);
+            submitted_.push_back(task);
+        }
+    }
+}
+
+bool Farm::Farm_impl::run_slice(Task& task)
+{
+    const Job& job = task.job;
+    Result& result = task.result;
+
+    try
+    {
+        if(!task.cpu)
+        {
+            task.cpu = std::make_unique<CPU>(
+                job.program.get(), job.program_size, job.flags);
+            task.cpu->seed_rng(job.seed);
+            task.cpu->set_clock_speed_hz(job.clock_speed_hz);
+            for(uint16_t addr : job.breakpoints)
+                task.cpu->set_breakpoint(addr);
+        }
+        CPU& cpu = *task.cpu;
+
+        const unsigned long end =
+            std::min(job.frames, result.frames + frames_per_slice_);
+        while(result.frames < end)
+        {
+            const uint16_t held = (result.frames < job.input.size()) ?
+                job.input[result.frames] : 0;
+            cpu.set_keys(held);
+
+            const RunResult run = cpu.run_until_frame(STOP_BREAK);
+            result.cycles += run.cycles;
+            if(run.reason & STOP_BREAK)
+            {
+                result.broke = true;
+                result.break_address = cpu.snapshot().pc;
+                break;
+            }
+            ++result.frames;
+        }
+
+        std::memcpy(result.display, cpu.display(), sizeof(result.display));
+        return result.broke || result.frames >= job.frames;
+    }
+    catch(const cpu_exception& e)
+    {
+        result.faulted = true;
+        result.error = e.what();
+        result.error_address = e.last_address;
+        if(task.cpu)
+        {
+            std::memcpy(result.display, task.cpu->display(),
+                        sizeof(result.display));
+        }
+        return true;
+    }
+}
+
+bool Farm::Farm_impl::poll(Result& result)
+{
+    Task* task = completions_.pop();
+    if(!task) return false;
+
+    result = std::move(task->result);
+    delete task;
+    pending_.fetch_sub(1);
+    return true;
+}
+
+bool Farm::Farm_impl::wait(Result& result)
+{
+    while(pending_.load() > 0)
+    {
+        if(poll(result)) return true;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return false;
+}
+
+
+Farm::Farm(unsigned int workers, unsigned int frames_per_slice,
+    bool pin_workers)
+    : pImpl_{std::make_unique<Farm_impl>(workers, frames_per_slice,
+                                         pin_workers)}
+{
+}
+
+Farm::~Farm() = default;
+
+Farm& Farm::submit(Job job)
+{
+    pImpl_->submit(std::move(job));
+    return *this;
+}
+
+bool Farm::poll(Result& result)
+{
+    return pImpl_->poll(result);
+}
+
+bool Farm::wait(Result& result)
+{
+    return pImpl_->wait(result);
+}
+
+unsigned long Farm::pending() const
+{
+    return pImpl_->pending();
+}
+
+unsigned int Farm::workers() const
+{
+    return pImpl_->workers();
+}
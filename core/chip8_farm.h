@@ -0,0 +1,88 @@
+#ifndef CHIP8_FARM_H_OLIVECC
+#define CHIP8_FARM_H_OLIVECC
+
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <memory>       //std::shared_ptr, std::unique_ptr
+#include <string>       //std::string
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //A program run to completion by a Farm
+    struct Job
+    {
+        uint64_t id = 0;            //Returned with the job's Result
+
+        //Program bytes, shared rather than copied by jobs of one program:
+        //e.g. owned by a std::vector, or a view into a memory-mapped ROM 
+        //pack (through the aliasing constructor of std::shared_ptr)
+        std::shared_ptr<const uint8_t> program;
+        size_t program_size = 0;
+
+        Flags flags = NO_FLAGS;
+        uint32_t seed = 0;          //RNG seed (Cxkk)
+        unsigned int clock_speed_hz = DEFAULT_CLOCK_SPEED_HZ;
+        unsigned long frames = 0;   //Quantity of 60 Hz frames to run
+
+        //Keys held during frame f: bit k of input[f] for key k (none held
+        //once the script has ended)
+        std::vector<uint16_t> input;
+
+        //Addresses to stop at (see CPU::set_breakpoint()): the job ends at
+        //the first reached, with Result::broke set
+        std::vector<uint16_t> breakpoints;
+    };
+
+    struct Result
+    {
+        uint64_t id;
+        unsigned long frames;       //Frames completed
+        uint64_t cycles;
+        bool faulted;               //If so, error/error_address are as thrown
+        bool broke;                 //If so, at break_address (unexecuted)
+        uint16_t break_address;
+        std::string error;
+        int error_address;
+        uint64_t display[DISPLAY_WORDS];    //Final, as CPU::display()
+    };
+
+    //Runs Jobs on a fixed pool of worker threads, each pinned to a core where
+    //supported. Jobs are scheduled in slices of frames_per_slice frames: each
+    //worker runs slices from its own deque, stealing queued jobs from other
+    //workers when its own is empty, and taking a share of newly submitted
+    //jobs when there are none to steal. Results are delivered through a
+    //lock-free queue, in order of completion.
+    //
+    //submit() may be called from any thread; poll() and wait() from only one
+    //thread at a time.
+    class Farm
+    {
+    private:
+        class Farm_impl;
+        std::unique_ptr<Farm_impl> pImpl_;
+
+    public:
+        //workers == 0: one per hardware thread
+        explicit Farm(unsigned int workers = 0,
+            unsigned int frames_per_slice = FRAMES_PER_SECOND,
+            bool pin_workers = true);
+        ~Farm();
+        Farm(const Farm&) = delete;
+        Farm& operator=(const Farm&) = delete;
+
+        Farm& submit(Job);
+
+        //Retrieve a result: poll() returns false if none has completed,
+        //wait() blocks until one has (returning false if none are pending)
+        bool poll(Result&);
+        bool wait(Result&);
+
+        //Jobs submitted whose results have not yet been retrieved
+        unsigned long pending() const;
+        unsigned int workers() const;
+    };
+}
+#endif //CHIP8_FARM_H_OLIVECC
@@ -0,0 +1,727 @@
+#include <algorithm>    //std::min, std::fill
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t, uintptr_t
+#include <cstring>      //std::memcpy
+#include <memory>       //std::make_unique
+
+#include "chip8.h"
+#include "chip8_aot.h"
+#include "chip8_jit.h"
+#include "chip8_profile.h"
+#include "chip8_trace.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define CHIP8_JIT_X86_64
+#include <sys/mman.h>   //mmap, mprotect, munmap
+#endif
+
+using namespace chip8;
+
+//Defined here, where CPU::Jit (and CPU::Aot) is complete
+CPU::~CPU()
+{
+    if(profiler_) profiler_->detach();
+    if(tracer_) set_tracer(nullptr);
+}
+
+CPU& CPU::set_engine(Engine engine)
+{
+    if(engine == Engine::INTERPRETER)
+    {
+        jit_.reset();
+    }
+    else if(!jit_)
+    {
+        if(!Jit::is_supported())
+            throw cpu_exception("JIT engine unsupported on this host");
+        jit_ = std::make_unique<Jit>();
+    }
+
+    return *this;
+}
+
+#ifdef CHIP8_JIT_X86_64
+
+namespace
+{
+    constexpr size_t arena_size = 1 << 20;
+    constexpr size_t max_block_bytes = 1 << 14;
+    constexpr unsigned int max_block_instrs = 64;
+
+    //Marks an address whose first instruction is left to the interpreter
+    const uint8_t no_block_marker = 0;
+    const uint8_t* const no_block = &no_block_marker;
+
+    enum Reg : unsigned int
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8,  R9,  R10, R11, R12, R13, R14, R15
+    };
+
+    //Opcodes of the 'op r/m32, r32' forms; the /digit of each 'op r/m32,
+    //imm32' form is the opcode shifted right by three
+    enum Alu : uint8_t
+    {
+        ADD = 0x01, OR = 0x09, AND = 0x21, SUB = 0x29, XOR = 0x31, CMP = 0x39
+    };
+
+    enum Shift : uint8_t { SHL = 4, SHR = 5 };
+
+    enum Cond : uint8_t { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5 };
+
+    //Memory operand [rbx + index * 2^scale + disp]: all guest state is
+    //addressed relative to the CPU object, which is held in rbx
+    struct Mem
+    {
+        int32_t disp;
+        int index;
+        unsigned int scale;
+
+        Mem(int32_t d, int i = -1, unsigned int s = 0)
+            : disp{d}, index{i}, scale{s} {}
+    };
+
+    //Minimal x86-64 encoder for the instruction forms the translator needs.
+    //32-bit operations are used throughout, guest values being held
+    //zero-extended.
+    class Assembler
+    {
+    private:
+        uint8_t* p_;
+
+        void rex(bool w, unsigned int reg, unsigned int index,
+                 unsigned int base, bool byte_reg = false)
+        {
+            const uint8_t r = 0x40 | (w << 3) | ((reg & 8) >> 1) |
+                              ((index & 8) >> 2) | ((base & 8) >> 3);
+
+            //SPL, BPL, SIL and DIL are only addressable with a REX prefix
+            if((r != 0x40) || (byte_reg && (reg >= RSP) && (reg <= RDI)))
+                byte(r);
+        }
+
+        void modrm(unsigned int reg, unsigned int rm)
+        {
+            byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        void modrm(unsigned int reg, Mem m)
+        {
+            if(m.index < 0)
+            {
+                byte(0x80 | ((reg & 7) << 3) | (RBX & 7));
+            }
+            else
+            {
+                byte(0x84 | ((reg & 7) << 3));
+                byte((m.scale << 6) | ((m.index & 7) << 3) | (RBX & 7));
+            }
+            dword(m.disp);
+        }
+
+        void mem_prefix(unsigned int reg, Mem m, bool byte_reg = false)
+        {
+            rex(false, reg, (m.index < 0) ? 0 : m.index, RBX, byte_reg);
+        }
+
+    public:
+        explicit Assembler(uint8_t* p) : p_{p} {}
+        uint8_t* pos() const { return p_; }
+
+        void byte(uint8_t b)    { *p_++ = b; }
+        void word(uint16_t w)   { std::memcpy(p_, &w, sizeof w); p_ += sizeof w; }
+        void dword(uint32_t d)  { std::memcpy(p_, &d, sizeof d); p_ += sizeof d; }
+        void qword(uint64_t q)  { std::memcpy(p_, &q, sizeof q); p_ += sizeof q; }
+
+        void mov(Reg dst, uint32_t imm)
+        { rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(imm); }
+
+        void mov(Reg dst, Reg src)
+        { rex(false, src, 0, dst); byte(0x89); modrm(src, dst); }
+
+        void mov64(Reg dst, uint64_t imm)
+        { rex(true, 0, 0, dst); byte(0xB8 + (dst & 7)); qword(imm); }
+
+        void mov64(Reg dst, Reg src)
+        { rex(true, src, 0, dst); byte(0x89); modrm(src, dst); }
+
+        void alu(Alu op, Reg dst, Reg src)
+        { rex(false, src, 0, dst); byte(op); modrm(src, dst); }
+
+        void alu(Alu op, Reg dst, uint32_t imm)
+        { rex(false, 0, 0, dst); byte(0x81); modrm(op >> 3, dst); dword(imm); }
+
+        void shift(Shift op, Reg dst, uint8_t imm)
+        { rex(false, 0, 0, dst); byte(0xC1); modrm(op, dst); byte(imm); }
+
+        void cmov(Cond cc, Reg dst, Reg src)
+        { rex(false, dst, 0, src); byte(0x0F); byte(0x40 + cc); modrm(dst, src); }
+
+        void load8(Reg dst, Mem m)      //movzx r32, byte
+        { mem_prefix(dst, m); byte(0x0F); byte(0xB6); modrm(dst, m); }
+
+        void load16(Reg dst, Mem m)     //movzx r32, word
+        { mem_prefix(dst, m); byte(0x0F); byte(0xB7); modrm(dst, m); }
+
+        void store8(Mem m, Reg src)
+        { mem_prefix(src, m, true); byte(0x88); modrm(src, m); }
+
+        void store16(Mem m, Reg src)
+        { byte(0x66); mem_prefix(src, m); byte(0x89); modrm(src, m); }
+
+        void store16(Mem m, uint16_t imm)
+        { byte(0x66); mem_prefix(0, m); byte(0xC7); modrm(0, m); word(imm); }
+
+        void call(Reg r)
+        { rex(false, 0, 0, r); byte(0xFF); modrm(2, r); }
+
+        void push(Reg r) { rex(false, 0, 0, r); byte(0x50 + (r & 7)); }
+        void pop(Reg r)  { rex(false, 0, 0, r); byte(0x58 + (r & 7)); }
+        void ret()       { byte(0xC3); }
+
+        void rsp_adjust(int8_t imm) //add rsp, imm8
+        { byte(0x48); byte(0x83); byte(0xC4); byte(imm); }
+
+        void shl64(Reg dst, uint8_t imm)
+        { rex(true, 0, 0, dst); byte(0xC1); modrm(SHL, dst); byte(imm); }
+
+        void or64(Reg dst, Reg src)
+        { rex(true, src, 0, dst); byte(OR); modrm(src, dst); }
+
+        //Jumps return the location of their rel32 operand, to be patched
+        uint8_t* jmp()          { byte(0xE9); dword(0); return p_ - 4; }
+        uint8_t* jcc(Cond cc)   { byte(0x0F); byte(0x80 + cc); dword(0); return p_ - 4; }
+
+        void jmp(const uint8_t* target) { patch(jmp(), target); }
+
+        static void patch(uint8_t* rel, const uint8_t* target)
+        {
+            const int32_t d = static_cast<int32_t>(target - (rel + 4));
+            std::memcpy(rel, &d, sizeof d);
+        }
+    };
+
+    //Guest V registers cached in host registers for the duration of a block.
+    //Assignments are written through to memory immediately, so the cache
+    //never needs flushing, only forgetting (after calls into the
+    //interpreter, which may change V registers behind its back).
+    class RegCache
+    {
+    private:
+        static constexpr unsigned int size = 8;
+        static constexpr Reg pool_[size] = {RBP, R15, RSI, RDI, R8, R9, R10, R11};
+        static constexpr int none = -1;
+
+        Assembler& a_;
+        const int32_t v_;           //Offset of v_ within CPU
+        int host_of_[0x10];
+        int guest_of_[size];
+        unsigned int used_[size];   //For least-recently-used eviction
+        unsigned int clock_;
+        unsigned int pinned_;       //Hosts in use by current instruction
+
+        int find(unsigned int g, bool load)
+        {
+            int h = host_of_[g];
+            if(h == none)
+            {
+                //Prefer a free host, else evict the least recently used
+                for(unsigned int c = 0; c < size; ++c)
+                {
+                    if(pinned_ & (1U << c)) continue;
+                    if(guest_of_[c] == none) { h = c; break; }
+                    if((h == none) || (used_[c] < used_[h])) h = c;
+                }
+                if(guest_of_[h] != none) host_of_[guest_of_[h]] = none;
+                guest_of_[h] = g;
+                host_of_[g] = h;
+                if(load) a_.load8(pool_[h], Mem{v_ + static_cast<int32_t>(g)});
+            }
+            used_[h] = ++clock_;
+            pinned_ |= 1U << h;
+            return h;
+        }
+
+    public:
+        RegCache(Assembler& a, int32_t v) : a_(a), v_{v}, clock_{}, pinned_{}
+        { forget(); }
+
+        void forget()
+        {
+            std::fill(std::begin(host_of_), std::end(host_of_), int{none});
+            std::fill(std::begin(guest_of_), std::end(guest_of_), int{none});
+            std::fill(std::begin(used_), std::end(used_), 0);
+        }
+
+        void next_instruction() { pinned_ = 0; }
+
+        //Host register holding Vg, to be read and/or modified in place
+        Reg get(unsigned int g) { return pool_[find(g, true)]; }
+
+        //Write back Vg after modifying it in place
+        void store(unsigned int g)
+        { a_.store8(Mem{v_ + static_cast<int32_t>(g)}, get(g)); }
+
+        //Vg := src
+        void set(unsigned int g, Reg src)
+        {
+            const Reg h = pool_[find(g, false)];
+            if(h != src) a_.mov(h, src);
+            store(g);
+        }
+    };
+
+    constexpr Reg RegCache::pool_[];
+}
+
+bool CPU::Jit::is_supported()
+{
+    return true;
+}
+
+CPU::Jit::Jit() : arena_used_{}, entry_{}, coverage_{}
+{
+    void* p = mmap(nullptr, arena_size, PROT_READ | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) throw cpu_exception("JIT arena allocation failed");
+    arena_ = static_cast<uint8_t*>(p);
+}
+
+CPU::Jit::~Jit()
+{
+    munmap(arena_, arena_size);
+}
+
+void CPU::Jit::flush()
+{
+    arena_used_ = 0;
+    spans_.clear();
+    std::fill(std::begin(entry_), std::end(entry_), nullptr);
+    std::fill(std::begin(coverage_), std::end(coverage_), 0);
+}
+
+uint32_t CPU::Jit::interpret(CPU* cpu, uint32_t addr, uint32_t packed)
+{
+    Instr instr;
+    std::memcpy(&instr, &packed, sizeof instr);
+
+    cpu->pc_ = addr + BYTES_PER_OPCODE;
+    try
+    {
+        (cpu->*cpu->handlers_[instr.op])(instr);
+    }
+    catch(const cpu_exception&)
+    {
+        //Handlers check before modifying state, so the interpreter can
+        //re-execute the instruction to throw
+        return BAIL;
+    }
+
+    return cpu->pc_;
+}
+
+const uint8_t* CPU::Jit::translate(CPU& cpu, uint16_t start)
+{
+    if(arena_used_ + max_block_bytes > arena_size) flush();
+    mprotect(arena_, arena_size, PROT_READ | PROT_WRITE);
+
+    auto offset = [&cpu](const void* member) -> int32_t
+    {
+        return static_cast<int32_t>(static_cast<const uint8_t*>(member) -
+                                    reinterpret_cast<const uint8_t*>(&cpu));
+    };
+    const int32_t v_off     = offset(cpu.v_);
+    const int32_t i_off     = offset(&cpu.i_);
+    const int32_t sp_off    = offset(&cpu.sp_);
+    const int32_t stack_off = offset(cpu.stack_);
+
+    Assembler a(arena_ + arena_used_);
+    RegCache v(a, v_off);
+    const uint8_t* const code = a.pos();
+
+    //Exits to the epilogue with eax := pc, from budget checks and bail-outs
+    struct Exit { uint8_t* rel; uint16_t pc; };
+    std::vector<Exit> exits;
+    std::vector<uint8_t*> to_epilogue;
+
+    auto exit_to = [&](uint8_t* rel, uint16_t pc) { exits.push_back({rel, pc}); };
+    auto leave = [&](uint16_t pc) { a.mov(RAX, pc); to_epilogue.push_back(a.jmp()); };
+    //Count the current instruction, and leave with eax already the next pc
+    auto leave_counted = [&]()
+    {
+        a.alu(SUB, R13, 1U);
+        to_epilogue.push_back(a.jmp());
+    };
+    auto call_interpreter = [&](uint16_t addr, Instr instr)
+    {
+        uint32_t packed;
+        instr.op = instr.base;
+        std::memcpy(&packed, &instr, sizeof packed);
+
+        a.mov64(RDI, RBX);
+        a.mov(RSI, addr);
+        a.mov(RDX, packed);
+        a.mov64(RAX, reinterpret_cast<uintptr_t>(&CPU::Jit::interpret));
+        a.call(RAX);
+        a.alu(CMP, RAX, BAIL);
+        exit_to(a.jcc(CC_E), addr);
+    };
+    auto reload = [&]()
+    {
+        v.forget();
+        a.load16(R12, Mem{i_off});
+    };
+#if CHIP8_VARIANT != CHIP8_XOCHIP
+    auto skip_if = [&](Cond cc, uint16_t addr)
+    {
+        a.mov(RAX, addr + BYTES_PER_OPCODE);
+        a.mov(RCX, addr + 2 * BYTES_PER_OPCODE);
+        a.cmov(cc, RAX, RCX);
+    };
+#endif
+
+    //Prologue: rbx := CPU, r12d := I, r13d := remaining budget,
+    //r14d := initial budget. Six pushes and an 8 byte adjustment keep the
+    //stack 16-byte aligned for calls.
+    for(Reg r : {RBX, RBP, R12, R13, R14, R15}) a.push(r);
+    a.rsp_adjust(-8);
+    a.mov64(RBX, RDI);
+    a.mov(R13, RSI);
+    a.mov(R14, RSI);
+    a.load16(R12, Mem{i_off});
+    const uint8_t* const body = a.pos();
+
+    unsigned int addr = start;      //Not wrapping at the end of RAM
+    unsigned int n = 0;
+    bool open = true;
+    while(open)
+    {
+        //Breakpoints are checked between blocks (see CPU::set_breakpoint)
+        if((n == max_block_instrs) || (addr > RAM_SIZE - BYTES_PER_OPCODE) ||
+           (n > 0 && cpu.is_breakpoint(addr)))
+        {
+            leave(addr);
+            break;
+        }
+
+        const Instr in = cpu.decode(addr);
+        const unsigned int x = in.x, y = in.y();
+        v.next_instruction();
+
+        switch(in.base)
+        {
+        //Native, sequential
+        case(OP_NOP):
+            break;
+
+        case(OP_6xkk):
+            a.mov(RAX, in.kk);
+            v.set(x, RAX);
+            break;
+
+        case(OP_7xkk):
+            a.alu(ADD, v.get(x), in.kk);
+            a.alu(AND, v.get(x), 0xFFU);
+            v.store(x);
+            break;
+
+        case(OP_8xy0):
+            v.set(x, v.get(y));
+            break;
+
+        case(OP_8xy1): a.alu(OR,  v.get(x), v.get(y)); v.store(x); break;
+        case(OP_8xy2): a.alu(AND, v.get(x), v.get(y)); v.store(x); break;
+        case(OP_8xy3): a.alu(XOR, v.get(x), v.get(y)); v.store(x); break;
+
+        case(OP_8xy4):          //eax := Vx + Vy, ecx := carry
+            a.mov(RAX, v.get(x));
+            a.alu(ADD, RAX, v.get(y));
+            a.mov(RCX, RAX);
+            a.alu(AND, RAX, 0xFFU);
+            a.shift(SHR, RCX, 8);
+            v.set(x, RAX);
+            v.set(0xF, RCX);
+            break;
+
+        case(OP_8xy5):          //eax := Vx - Vy, ecx := NOT borrow
+        case(OP_8xy7):          //eax := Vy - Vx, ecx := NOT borrow
+            a.mov(RAX, v.get((in.base == OP_8xy5) ? x : y));
+            a.alu(SUB, RAX, v.get((in.base == OP_8xy5) ? y : x));
+            a.mov(RCX, RAX);
+            a.alu(AND, RAX, 0xFFU);
+            a.shift(SHR, RCX, 31);
+            a.alu(XOR, RCX, 1U);
+            v.set(x, RAX);
+            v.set(0xF, RCX);
+            break;
+
+        case(OP_8xy6):          //eax := Vu >> 1, ecx := truncated bit
+            a.mov(RAX, v.get(cpu.new_8XYU_ ? x : y));
+            a.mov(RCX, RAX);
+            a.shift(SHR, RAX, 1);
+            a.alu(AND, RCX, 1U);
+            v.set(x, RAX);
+            v.set(0xF, RCX);
+            break;
+
+        case(OP_8xyE):          //eax := Vu << 1, ecx := truncated bit
+            a.mov(RAX, v.get(cpu.new_8XYU_ ? x : y));
+            a.mov(RCX, RAX);
+            a.shift(SHL, RAX, 1);
+            a.alu(AND, RAX, 0xFFU);
+            a.shift(SHR, RCX, 7);
+            v.set(x, RAX);
+            v.set(0xF, RCX);
+            break;
+
+        case(OP_Annn):
+            a.mov(R12, in.nnn());
+            a.store16(Mem{i_off}, R12);
+            break;
+
+        case(OP_Fx1E):
+            a.alu(ADD, R12, v.get(x));
+            a.alu(AND, R12, 0xFFFFU);
+            a.store16(Mem{i_off}, R12);
+            break;
+
+        case(OP_Fx29):          //I := 5 * Vx
+            a.mov(RAX, v.get(x));
+            a.mov(R12, RAX);
+            a.shift(SHL, R12, 2);
+            a.alu(ADD, R12, RAX);
+            a.store16(Mem{i_off}, R12);
+            break;
+
+        //Interpreted, sequential
+        case(OP_Cxkk):
+        case(OP_Fx65):
+            call_interpreter(addr, in);
+            reload();
+            if(in.base == OP_Fx65 && cpu.is_watching())
+            {
+                //So a watchpoint stops the run straight after
+                leave_counted();
+                open = false;
+            }
+            break;
+
+        //Native, ending block
+        case(OP_1nnn):
+            if(in.nnn() == addr)
+            {
+                //Jump to itself: left to the interpreter, which skips the
+                //idle cycles at once
+                if(n == 0)
+                {
+                    mprotect(arena_, arena_size, PROT_READ | PROT_EXEC);
+                    return no_block;
+                }
+                leave(addr);
+                open = false;
+                continue;
+            }
+            a.mov(RAX, in.nnn());
+            if(in.nnn() == start && !cpu.is_debugged())
+            {
+                //Tight loop: iterate within the block until budget is spent
+                a.alu(SUB, R13, 1U);
+                to_epilogue.push_back(a.jcc(CC_E));
+                v.forget();
+                a.jmp(body);
+                open = false;
+            }
+            else
+            {
+                //Also tight loops when debugged, so breaks are checked each
+                //iteration
+                leave_counted();
+                open = false;
+            }
+            break;
+
+        case(OP_2nnn):
+            a.load8(RCX, Mem{sp_off});
+            a.alu(CMP, RCX, static_cast<uint32_t>(STACK_MAX_SIZE));
+            exit_to(a.jcc(CC_AE), addr);
+            a.store16(Mem{stack_off, RCX, 1},
+                      static_cast<uint16_t>(addr + BYTES_PER_OPCODE));
+            a.alu(ADD, RCX, 1U);
+            a.store8(Mem{sp_off}, RCX);
+            a.mov(RAX, in.nnn());
+            leave_counted();
+            open = false;
+            break;
+
+        case(OP_00EE):
+            a.load8(RCX, Mem{sp_off});
+            a.alu(CMP, RCX, 0U);
+            exit_to(a.jcc(CC_E), addr);
+            a.alu(SUB, RCX, 1U);
+            a.store8(Mem{sp_off}, RCX);
+            a.load16(RAX, Mem{stack_off, RCX, 1});
+            leave_counted();
+            open = false;
+            break;
+
+        case(OP_Bnnn):
+            a.mov(RAX, v.get(0x0));
+            a.alu(ADD, RAX, static_cast<uint32_t>(in.nnn()));
+            leave_counted();
+            open = false;
+            break;
+
+#if CHIP8_VARIANT != CHIP8_XOCHIP
+        case(OP_3xkk): a.alu(CMP, v.get(x), in.kk);     skip_if(CC_E, addr);
+                       leave_counted(); open = false; break;
+        case(OP_4xkk): a.alu(CMP, v.get(x), in.kk);     skip_if(CC_NE, addr);
+                       leave_counted(); open = false; break;
+        case(OP_5xy0): a.alu(CMP, v.get(x), v.get(y));  skip_if(CC_E, addr);
+                       leave_counted(); open = false; break;
+        case(OP_9xy0): a.alu(CMP, v.get(x), v.get(y));  skip_if(CC_NE, addr);
+                       leave_counted(); open = false; break;
+#endif
+
+        //Interpreted, ending block: skips, or run loop events and RAM writes.
+        //XO-CHIP's skips depend on the instruction skipped (see skip_length).
+#if CHIP8_VARIANT == CHIP8_XOCHIP
+        case(OP_3xkk):
+        case(OP_4xkk):
+        case(OP_5xy0):
+        case(OP_9xy0):
+#endif
+        case(OP_00E0):
+        case(OP_Dxyz):
+        case(OP_Ex9E):
+        case(OP_ExA1):
+        case(OP_Fx33):
+        case(OP_Fx55):
+            call_interpreter(addr, in);
+            leave_counted();
+            open = false;
+            break;
+
+        //Left to the interpreter: timers depend on the frame, which is only
+        //brought up to date after the block
+        default:
+            if(n == 0)
+            {
+                mprotect(arena_, arena_size, PROT_READ | PROT_EXEC);
+                return no_block;
+            }
+            leave(addr);
+            open = false;
+            continue;
+        }
+
+        if(open)
+        {
+            a.alu(SUB, R13, 1U);
+            exit_to(a.jcc(CC_E), addr + BYTES_PER_OPCODE);
+        }
+        addr += BYTES_PER_OPCODE;
+        ++n;
+    }
+
+    for(const Exit& e : exits)
+    {
+        Assembler::patch(e.rel, a.pos());
+        leave(e.pc);
+    }
+
+    //Epilogue: rax := (cycles executed << 32) | pc
+    const uint8_t* const epilogue = a.pos();
+    a.mov(RAX, RAX);        //Zero-extend, as interpreter calls return eax
+    a.mov(RCX, R14);
+    a.alu(SUB, RCX, R13);
+    a.shl64(RCX, 32);
+    a.or64(RAX, RCX);
+    a.rsp_adjust(8);
+    for(Reg r : {R15, R14, R13, R12, RBP, RBX}) a.pop(r);
+    a.ret();
+
+    for(uint8_t* rel : to_epilogue) Assembler::patch(rel, epilogue);
+
+    mprotect(arena_, arena_size, PROT_READ | PROT_EXEC);
+    arena_used_ = a.pos() - arena_;
+
+    spans_.push_back({start, addr});
+    for(unsigned int b = start; b < addr; ++b) ++coverage_[b];
+
+    return code;
+}
+
+bool CPU::Jit::run(CPU& cpu, uint64_t end, unsigned int stop_on)
+{
+    const uint16_t pc = cpu.pc_;
+    if(static_cast<uint16_t>(pc - PROGRAM_BEGIN) >= PROGRAM_SIZE - 1)
+        return false;
+
+    const uint8_t* code = entry_[pc];
+    if(code == nullptr) code = entry_[pc] = translate(cpu, pc);
+    if(code == no_block) return false;
+
+    //Stop no later than the end of the run, or the next frame boundary
+    uint64_t budget = end - cpu.scheduler_.cycle();
+    if(stop_on & STOP_FRAME)
+        budget = std::min(budget, cpu.scheduler_.cycles_to_frame());
+    budget = std::min<uint64_t>(budget, UINT32_MAX);
+
+    const Block block = reinterpret_cast<Block>(
+        reinterpret_cast<uintptr_t>(code));
+    const uint64_t result = block(&cpu, static_cast<uint32_t>(budget));
+    const uint32_t cycles = result >> 32;
+
+    cpu.pc_ = static_cast<uint16_t>(result);
+    if(cpu.scheduler_.advance(cycles)) cpu.events_ |= STOP_FRAME;
+
+    return cycles > 0;
+}
+
+void CPU::Jit::invalidate(unsigned int begin, unsigned int end)
+{
+    if(end >= RAM_SIZE) end = RAM_SIZE - 1;
+
+    //Instructions left to the interpreter may have become translatable
+    for(unsigned int addr = (begin > 0) ? begin - 1 : 0; addr <= end; ++addr)
+    {
+        if(entry_[addr] == no_block) entry_[addr] = nullptr;
+    }
+
+    bool is_code = false;
+    for(unsigned int addr = begin; addr <= end; ++addr)
+    {
+        is_code |= (coverage_[addr] != 0);
+    }
+    if(!is_code) return;
+
+    //Generated code is left in the arena (a block may be writing to itself)
+    //and reclaimed when the arena is next flushed
+    auto overlaps = [begin, end](const Span& s)
+        { return (s.begin <= end) && (s.end > begin); };
+    for(const Span& s : spans_)
+    {
+        if(!overlaps(s)) continue;
+        entry_[s.begin] = nullptr;
+        for(unsigned int b = s.begin; b < s.end; ++b) --coverage_[b];
+    }
+    spans_.erase(std::remove_if(spans_.begin(), spans_.end(), overlaps),
+                 spans_.end());
+}
+
+#else //CHIP8_JIT_X86_64
+
+bool CPU::Jit::is_supported()
+{
+    return false;
+}
+
+CPU::Jit::Jit() : arena_{}, arena_used_{}, entry_{}, coverage_{} {}
+CPU::Jit::~Jit() = default;
+
+uint32_t CPU::Jit::interpret(CPU*, uint32_t, uint32_t) { return BAIL; }
+const uint8_t* CPU::Jit::translate(CPU&, uint16_t) { return nullptr; }
+void CPU::Jit::flush() {}
+bool CPU::Jit::run(CPU&, uint64_t, unsigned int) { return false; }
+void CPU::Jit::invalidate(unsigned int, unsigned int) {}
+
+#endif //CHIP8_JIT_X86_64
@@ -0,0 +1,74 @@
+#ifndef CHIP8_JIT_H_OLIVECC
+#define CHIP8_JIT_H_OLIVECC
+
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //Basic-block dynamic recompiler for x86-64 (System V ABI) hosts.
+    //
+    //Blocks run from an address up to and including a control transfer
+    //(1nnn, 2nnn, 00EE, Bnnn, skips), a framebuffer or RAM write (00E0, Dxyz,
+    //Fx33, Fx55), or up to but excluding an instruction left to the
+    //interpreter (Fx07, Fx0A, Fx15, Fx18, invalid opcodes) or a breakpoint
+    //(see CPU::set_breakpoint()). Within a block, V registers are cached in
+    //host registers (written through to v_ on assignment) and I is held in
+    //r12. Instructions with involved semantics are executed by calling back
+    //into their interpreter handlers.
+    //Instructions of the extended variants (see CHIP8_VARIANT) are left to
+    //the interpreter.
+    //
+    //Each block is passed a cycle budget, and returns early when it is spent,
+    //so runs stop at exactly the same cycle as the interpreter. Errors are
+    //never thrown through generated code: the block instead returns before
+    //the faulting instruction, which the interpreter then executes (and
+    //throws from).
+    class CPU::Jit
+    {
+    private:
+        //Generated code signature: returns (cycles executed << 32) | next pc
+        using Block = uint64_t (*)(CPU* cpu, uint32_t budget);
+
+        struct Span
+        {
+            unsigned int begin;     //Address of first instruction
+            unsigned int end;       //One past last byte translated
+        };
+
+        uint8_t* arena_;            //mmap'd, writable only while translating
+        size_t arena_used_;
+
+        const uint8_t* entry_[RAM_SIZE];    //Block at address, if translated
+        std::vector<Span> spans_;
+        uint16_t coverage_[RAM_SIZE];       //Quantity of blocks using byte
+
+        const uint8_t* translate(CPU& cpu, uint16_t addr);
+        void flush();
+
+        //Called from generated code: execute the (unfused) instruction at
+        //addr with its interpreter handler, returning the next pc, or BAIL 
+        //if it would throw
+        static constexpr uint32_t BAIL = 0xFFFFFFFF;
+        static uint32_t interpret(CPU* cpu, uint32_t addr, uint32_t instr);
+
+    public:
+        static bool is_supported();
+
+        Jit();
+        ~Jit();
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        //Execute one block at cpu.pc_, returning false if none could be run
+        //(the interpreter then executes the instruction at pc_ instead)
+        bool run(CPU& cpu, uint64_t end, unsigned int stop_on);
+
+        //Discard any block containing a byte in [begin, end]
+        void invalidate(unsigned int begin, unsigned int end);
+    };
+}
+#endif //CHIP8_JIT_H_OLIVECC
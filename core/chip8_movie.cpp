@@ -0,0 +1,202 @@
+#include <algorithm>    //std::min
+#include <climits>      //ULONG_MAX
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t, UINT64_MAX
+#include <vector>       //std::vector
+
+#include "chip8.h"
+#include "chip8_encoding.h"
+#include "chip8_movie.h"
+
+using namespace chip8;
+using namespace chip8::encoding;
+
+namespace
+{
+    constexpr Format format = {
+        {'C', 'H', 'O', 'P', '8', 'M', 'O', 'V'}, 2, "movie"
+    };
+
+    //Each event begins with a varint (LEB128) of (cycles since the previous
+    //event << TYPE_BITS | type), followed by its little-endian payload
+    constexpr unsigned int TYPE_BITS = 2;
+
+    constexpr uint64_t fnv_basis = 0xCBF29CE484222325;
+    constexpr uint64_t fnv_prime = 0x100000001B3;
+}
+
+uint64_t chip8::program_hash(const void* program, size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(program);
+    uint64_t h = fnv_basis;
+    for(size_t b = 0; b < size; ++b)
+    {
+        h ^= p[b];
+        h *= fnv_prime;
+    }
+    return h;
+}
+
+uint64_t chip8::display_hash(const uint64_t* display)
+{
+    uint64_t h = fnv_basis;
+    for(unsigned int word = 0; word < DISPLAY_WORDS; ++word)
+    {
+        for(unsigned int b = 0; b < sizeof(uint64_t); ++b)
+        {
+            h ^= static_cast<uint8_t>(display[word] >> (8 * b));
+            h *= fnv_prime;
+        }
+    }
+    return h;
+}
+
+
+MovieWriter::MovieWriter(const MovieHeader& header)
+        : cycle_{}, keys_{}, ended_{}
+{
+    put_header(pending_, format);
+    put(pending_, header.program_hash);
+    put(pending_, static_cast<uint32_t>(header.flags));
+    put(pending_, header.seed);
+    put(pending_, static_cast<uint32_t>(header.clock_speed_hz));
+}
+
+void MovieWriter::event(MovieEvent::Type type, uint64_t cycle)
+{
+    if(ended_) throw cpu_exception("Movie has ended");
+    if(cycle < cycle_) throw cpu_exception("Movie events out of order");
+
+    put_varint(pending_, ((cycle - cycle_) << TYPE_BITS) | type);
+    cycle_ = cycle;
+}
+
+MovieWriter& MovieWriter::keys(uint64_t cycle, uint16_t mask)
+{
+    if(mask == keys_) return *this;
+
+    event(MovieEvent::KEYS, cycle);
+    put(pending_, mask);
+    keys_ = mask;
+
+    return *this;
+}
+
+MovieWriter& MovieWriter::checkpoint(uint64_t cycle, uint64_t display_hash)
+{
+    event(MovieEvent::CHECKPOINT, cycle);
+    put(pending_, display_hash);
+
+    return *this;
+}
+
+MovieWriter& MovieWriter::end(uint64_t cycle)
+{
+    event(MovieEvent::END, cycle);
+    ended_ = true;
+
+    return *this;
+}
+
+std::vector<uint8_t> MovieWriter::take()
+{
+    std::vector<uint8_t> out;
+    out.swap(pending_);
+    return out;
+}
+
+
+MovieReader::MovieReader(const void* data, size_t size)
+        : p_{static_cast<const uint8_t*>(data)}, end_{p_ + size},
+          header_{}, cycle_{}, ended_{}
+{
+    if(!has(p_, end_, HEADER_SIZE + sizeof(uint64_t) + 3 * sizeof(uint32_t)))
+        throw cpu_exception("Movie data truncated");
+    get_header(p_, end_, format);
+    header_.program_hash = get<uint64_t>(p_);
+    header_.flags = static_cast<Flags>(get<uint32_t>(p_));
+    header_.seed = get<uint32_t>(p_);
+    header_.clock_speed_hz = get<uint32_t>(p_);
+    if(header_.clock_speed_hz == 0)
+        throw invalid(format);
+}
+
+bool MovieReader::next(MovieEvent& out)
+{
+    if(ended_) return false;
+
+    //An event cut short ends the movie, as if recorded up to the one before
+    uint64_t tagged;
+    if(!get_varint(p_, end_, tagged, format)) { p_ = end_; return false; }
+    const uint64_t delta = tagged >> TYPE_BITS;
+    if(delta > UINT64_MAX - cycle_)
+        throw invalid(format);
+
+    const auto type = static_cast<MovieEvent::Type>(
+        tagged & ((1U << TYPE_BITS) - 1));
+    const size_t payload = (type == MovieEvent::KEYS) ? sizeof(uint16_t) :
+        (type == MovieEvent::CHECKPOINT) ? sizeof(uint64_t) : 0;
+    if(!has(p_, end_, payload)) { p_ = end_; return false; }
+
+    cycle_ += delta;
+    out.cycle = cycle_;
+    out.type = type;
+    switch(type)
+    {
+    case(MovieEvent::KEYS):
+        out.keys = get<uint16_t>(p_);
+        break;
+    case(MovieEvent::CHECKPOINT):
+        out.display_hash = get<uint64_t>(p_);
+        break;
+    case(MovieEvent::END):
+        ended_ = true;
+        break;
+    default:
+        throw invalid(format);
+    }
+
+    return true;
+}
+
+
+ReplayResult chip8::replay(MovieReader& movie, const void* program,
+                           size_t size, Engine engine)
+{
+    const MovieHeader& header = movie.header();
+    if(program_hash(program, size) != header.program_hash)
+        throw cpu_exception("Movie is of a different program");
+
+    CPU cpu(program, size, header.flags);
+    cpu.seed_rng(header.seed);
+    cpu.set_clock_speed_hz(header.clock_speed_hz);
+    cpu.set_engine(engine);
+
+    ReplayResult result {};
+    MovieEvent event;
+    while(movie.next(event))
+    {
+        //Events are in order of cycle, so each run is of the cycles between
+        while(cpu.scheduler().cycle() < event.cycle)
+        {
+            const uint64_t left = event.cycle - cpu.scheduler().cycle();
+            cpu.run_cycles(static_cast<unsigned long>(
+                std::min<uint64_t>(left, ULONG_MAX)));
+        }
+
+        if(event.type == MovieEvent::KEYS) cpu.set_keys(event.keys);
+        else if(event.type == MovieEvent::CHECKPOINT)
+        {
+            ++result.checkpoints;
+            if(display_hash(cpu.display()) != event.display_hash &&
+               result.mismatches++ == 0)
+            {
+                result.first_mismatch = event.cycle;
+            }
+        }
+    }
+
+    result.cycles = cpu.scheduler().cycle();
+    result.display_hash = display_hash(cpu.display());
+    return result;
+}
@@ -0,0 +1,101 @@
+#ifndef CHIP8_MOVIE_H_OLIVECC
+#define CHIP8_MOVIE_H_OLIVECC
+
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //FNV-1a of a program, or of the words of a display (see CPU::display(),
+    //little-endian), e.g. to identify a ROM, or compare runs across hosts
+    uint64_t program_hash(const void* program, size_t size);
+    uint64_t display_hash(const uint64_t* display);
+
+    //Everything besides input that a run depends on
+    struct MovieHeader
+    {
+        uint64_t program_hash;      //Of all size bytes given to the CPU
+        Flags flags;
+        uint32_t seed;              //RNG seed (Cxkk)
+        unsigned int clock_speed_hz;
+    };
+
+    struct MovieEvent
+    {
+        enum Type : uint8_t
+        {
+            KEYS,                   //keys held from cycle onwards
+            CHECKPOINT,             //display_hash() expected at cycle
+            END                     //Recording stopped at cycle
+        };
+
+        Type type;
+        uint64_t cycle;             //Total cycles executed when it applies
+        uint16_t keys;              //Bit k for key k, as CPU::set_keys()
+        uint64_t display_hash;
+    };
+
+    //Movies are a header, then events in order of cycle, each stored as the
+    //cycles since the previous event: a few bytes per change of input.
+    //
+    //Encodes a movie as it is recorded: take() returns the bytes encoded
+    //since it was last called, to be appended to a file.
+    class MovieWriter
+    {
+    private:
+        std::vector<uint8_t> pending_;
+        uint64_t cycle_;            //Of the last event
+        uint16_t keys_;
+        bool ended_;
+
+        void event(MovieEvent::Type, uint64_t cycle);
+
+    public:
+        explicit MovieWriter(const MovieHeader&);
+
+        //Only changes are recorded, so keys() may be called on every poll
+        MovieWriter& keys(uint64_t cycle, uint16_t mask);
+        MovieWriter& checkpoint(uint64_t cycle, uint64_t display_hash);
+        MovieWriter& end(uint64_t cycle);
+
+        std::vector<uint8_t> take();
+    };
+
+    //Decodes a movie in place (e.g. from a memory-mapped file), one event at
+    //a time, so only the events being replayed need be resident. A movie
+    //truncated between events (e.g. its recorder was killed) ends early;
+    //malformed data is thrown as cpu_exception.
+    class MovieReader
+    {
+    private:
+        const uint8_t* p_;
+        const uint8_t* const end_;
+        MovieHeader header_;
+        uint64_t cycle_;
+        bool ended_;
+
+    public:
+        MovieReader(const void* data, size_t size);
+
+        const MovieHeader& header() const { return header_; }
+        bool next(MovieEvent&);     //False once the movie has ended
+    };
+
+    struct ReplayResult
+    {
+        uint64_t cycles;
+        uint64_t display_hash;      //Of the final display
+        unsigned long checkpoints;  //Quantity verified
+        unsigned long mismatches;   //Checkpoints not matching
+        uint64_t first_mismatch;    //Cycle of the first, if any
+    };
+
+    //Replay a movie of program (as given to the CPU, which must match the
+    //header's hash) from its start, with no pacing. Errors in the program
+    //are thrown as cpu_exception, as with CPU::run_cycles().
+    ReplayResult replay(MovieReader&, const void* program, size_t size,
+                        Engine = Engine::INTERPRETER);
+}
+#endif //CHIP8_MOVIE_H_OLIVECC
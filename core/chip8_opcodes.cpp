@@ -1,17 +1,14 @@
-#include <cmath>        //std::ceil
-#include <cstdint>      //uint16_t
-#include <random>       //std::mt19937, std::random_device
+#include <algorithm>    //std::min, std::max, std::copy_n
+#include <bitset>       //std::bitset
+#include <cstdint>      //uint16_t, uint64_t
+#include <cstring>      //std::memcpy
 #include "chip8.h"
+#include "chip8_display.h"
 
 using namespace chip8;
 
 namespace
 {
-    int mod(int a, int b)
-    {
-        return (b + (a % b)) % b;
-    }
-
     void opcode_throw(const char* m, int pc)
     {
         //pc is decremented due to previously being incremented in execute()
@@ -29,298 +26,549 @@ namespace
     }
 }
 
-void CPU::op_0nnn_()
+void CPU::op_decode_(Instr)
 {
-    switch(nnn())
-    {
-    case(0x0E0):
-        for(uint32_t& byte : framebuffer_) byte = argb_no_pixel_;
-        break;
-
-    case(0x0EE):
-        if(sp_ == 0x0) 
-            opcode_throw("00EE: Call stack underflow", pc_);
-        pc_ =  stack_[--sp_];
-        break;
-
-    default:
-        bad_opcode(pc_);
-        break;
-    }
+    //pc_ is decremented due to previously being incremented in run_cycles()
+    const uint16_t addr = pc_ - BYTES_PER_OPCODE;
+    Instr instr = predecode(addr);
+
+    //Superinstructions are only formed from the next execution onwards, as
+    //the run loop has already checked this cycle against its limits
+    (this->*handlers_[instr.base])(instr);
+}
+
+void CPU::op_invalid_(Instr)
+{
+    bad_opcode(pc_);
+}
+
+void CPU::op_nop_(Instr)
+{
+}
+
+void CPU::op_00E0_(Instr)
+{
+    mark_dirty(clear_planes(display_, planes_));
+    events_ |= STOP_DRAW;
 }
 
-void CPU::op_1nnn_()     
+void CPU::op_00EE_(Instr)
 {
-    pc_ = nnn();
+    if(sp_ == 0x0) 
+        opcode_throw("00EE: Call stack underflow", pc_);
+    pc_ =  stack_[--sp_];
 }
 
-void CPU::op_2nnn_()    
+void CPU::op_1nnn_(Instr in)     
+{
+    pc_ = in.nnn();
+}
+
+void CPU::op_2nnn_(Instr in)    
 {
     if(sp_ >= STACK_MAX_SIZE) 
         opcode_throw("2nnn: Call stack overflow", pc_);
     stack_[sp_++] = pc_; 
-    pc_ = nnn();
+    pc_ = in.nnn();
 }
 
-void CPU::op_3xkk_()   
+void CPU::op_3xkk_(Instr in)   
 { 
-    if(v_[x()] == kk()) 
+    if(v_[in.x] == in.kk) 
     {
-        pc_ += BYTES_PER_OPCODE; 
+        skip();
     }
 }   
 
-void CPU::op_4xkk_()  
+void CPU::op_4xkk_(Instr in)  
 {
-    if(v_[x()] != kk())
+    if(v_[in.x] != in.kk)
     {
-        pc_ += BYTES_PER_OPCODE;
+        skip();
     }
 }
-void CPU::op_5xy0_() 
-{
-    if(z() != 0x0) bad_opcode(pc_);
 
-    if(v_[x()] == v_[y()])
+void CPU::op_5xy0_(Instr in) 
+{
+    if(v_[in.x] == v_[in.y()])
     {
-        pc_ += BYTES_PER_OPCODE;
+        skip();
     }
 }
 
-void CPU::op_6xkk_()
+void CPU::op_6xkk_(Instr in)
 { 
-    v_[x()]  = kk(); 
+    v_[in.x]  = in.kk; 
 }
 
-void CPU::op_7xkk_() 
+void CPU::op_7xkk_(Instr in) 
 { 
-    v_[x()] += kk(); 
+    v_[in.x] += in.kk; 
 }
 
-void CPU::op_8xyz_()
+void CPU::op_8xy0_(Instr in)
 {
-    const uint8_t old_Vx = v_[x()];
-    const uint8_t pre_shift = v_[((new_8XYU_) ? x() : y())];
+    v_[in.x]  = v_[in.y()];
+}
 
-    switch(z())
-    {
-    case(0x0):
-        v_[x()]  = v_[y()];
-        break;
-
-    case(0x1):
-        v_[x()] |= v_[y()];
-        break;
-
-    case(0x2):
-        v_[x()] &= v_[y()];
-        break;
-
-    case(0x3):
-        v_[x()] ^= v_[y()];
-        break;
-
-    case(0x4):
-        v_[x()] += v_[y()];
-        v_[0xF] = ((old_Vx > v_[x()]) ? 1 : 0);
-        break;
-
-    case(0x5):
-        v_[x()] -= v_[y()];
-        v_[0xF] = ((old_Vx < v_[x()]) ? 0 : 1);
-        break;
-
-    case(0x6):
-        v_[x()] = pre_shift >> 1; 
-        v_[0xF] = ((pre_shift == (v_[x()] << 1)) ? 0 : 1);
-        break;
-
-    case(0x7):
-        v_[x()] = (v_[y()] - v_[x()]);
-        v_[0xF] = ((v_[y()] < v_[x()]) ? 0 : 1);
-        break;
-
-    case(0xE):
-        v_[x()] = pre_shift << 1;
-        v_[0xF] = ((pre_shift == (v_[x()] >> 1)) ? 0 : 1);
-        break;
-    }
+void CPU::op_8xy1_(Instr in)
+{
+    v_[in.x] |= v_[in.y()];
 }
 
-void CPU::op_9xy0_()  
+void CPU::op_8xy2_(Instr in)
 {
-    if(z() != 0x0) bad_opcode(pc_); 
-    
-    if(v_[x()] != v_[y()])
+    v_[in.x] &= v_[in.y()];
+}
+
+void CPU::op_8xy3_(Instr in)
+{
+    v_[in.x] ^= v_[in.y()];
+}
+
+void CPU::op_8xy4_(Instr in)
+{
+    const uint8_t old_Vx = v_[in.x];
+    v_[in.x] += v_[in.y()];
+    v_[0xF] = ((old_Vx > v_[in.x]) ? 1 : 0);
+}
+
+void CPU::op_8xy5_(Instr in)
+{
+    const uint8_t old_Vx = v_[in.x];
+    v_[in.x] -= v_[in.y()];
+    v_[0xF] = ((old_Vx < v_[in.x]) ? 0 : 1);
+}
+
+template<unsigned int Quirks>
+void CPU::op_8xy6_(Instr in)
+{
+    const uint8_t pre_shift = v_[(Quirks & NEW_8XYU) ? in.x : in.y()];
+    v_[in.x] = pre_shift >> 1; 
+    v_[0xF] = ((pre_shift == (v_[in.x] << 1)) ? 0 : 1);
+}
+
+void CPU::op_8xy7_(Instr in)
+{
+    v_[in.x] = (v_[in.y()] - v_[in.x]);
+    v_[0xF] = ((v_[in.y()] < v_[in.x]) ? 0 : 1);
+}
+
+template<unsigned int Quirks>
+void CPU::op_8xyE_(Instr in)
+{
+    const uint8_t pre_shift = v_[(Quirks & NEW_8XYU) ? in.x : in.y()];
+    v_[in.x] = pre_shift << 1;
+    v_[0xF] = ((pre_shift == (v_[in.x] >> 1)) ? 0 : 1);
+}
+
+void CPU::op_9xy0_(Instr in)  
+{
+    if(v_[in.x] != v_[in.y()])
     {
-        pc_ += BYTES_PER_OPCODE;
+        skip();
     }
 }
 
-void CPU::op_Annn_()   
+void CPU::op_Annn_(Instr in)   
 {
-    i_ = nnn(); 
+    i_ = in.nnn(); 
 }
 
-void CPU::op_Bnnn_() 
+void CPU::op_Bnnn_(Instr in) 
 {
-    pc_ = nnn() + v_[0x0];
+    pc_ = in.nnn() + v_[0x0];
 }
 
-void CPU::op_Cxkk_()
+void CPU::op_Cxkk_(Instr in)
 {
-    //Random Number Generator
     //https://channel9.msdn.com/Events/GoingNative/2013/rand-Considered-Harmful
-    //TODO thread-safe?
-    static std::mt19937 rng{(std::random_device{})()};
-
-    v_[x()] = (rng() & 0xFF) & kk();
+    v_[in.x] = (rng_() & 0xFF) & in.kk;
 }
 
-void CPU::op_Dxyz_()
+void CPU::op_Dxyz_(Instr in)
 {
+    //SUPER-CHIP: Dxy0 draws 16x16
+    const bool is_big = HAS_SCHIP && (in.z() == 0);
+    const unsigned int lines = is_big ? 16 : in.z();
+    const unsigned int width = is_big ? 16 : 8;
+    const unsigned int bytes = lines * (width / 8) * 
+        std::bitset<PLANES>(planes_).count();
+
     v_[0xF] = 0;
+    events_ |= STOP_DRAW;
        
-    if((i_ + z() - 1 >= RAM_SIZE) && (z() > 0))
+    if((i_ + bytes - 1 >= RAM_SIZE) && (bytes > 0))
         bad_ram_access(pc_);
+    watch(i_, bytes, WATCH_READ);
 
-    for(unsigned int line_num = 0, 
-                     pix_y = mod(v_[y()] + line_num, HEIGHT);
-        line_num < z(); 
-        ++line_num, pix_y = mod(pix_y + 1, HEIGHT))
-    {
-        uint8_t new_line = ram_[i_ + line_num];
-        
-        for(int col_num = 8-1, 
-                     pix_x = mod(v_[x()] + col_num, WIDTH);
-            col_num >= 0;
-            --col_num, pix_x = mod(pix_x - 1, WIDTH))
-        {
-            uint32_t& dest =
-                framebuffer_[pix_x + pix_y * WIDTH];
-
-            uint32_t draw_pixel = 
-                (new_line & 0x1) ? argb_pixel_ : argb_no_pixel_;
-
-            //VF |= dest AND draw_pixel
-            v_[0xF] |= ( ((dest == argb_pixel_) && (draw_pixel == argb_pixel_))
-                         ? 1 : 0);
+    bool collision;
+    uint8_t scratch[RAM_PAGE_SIZE];
+    mark_dirty(draw_sprite(display_, planes_, scale(), v_[in.x], v_[in.y()],
+                           peek(i_, bytes, scratch), lines, width, collision));
+    v_[0xF] = collision;
+}
 
-            //dest ^= draw_pixel;
-            dest = ( ((dest == argb_pixel_) + (draw_pixel == argb_pixel_) == 1) 
-                     ? argb_pixel_ : argb_no_pixel_);
+void CPU::op_Ex9E_(Instr in)
+{
+    if(!(v_[in.x] < 0x10)) 
+        opcode_throw("Exkk: non-nibble Vx (no equivalent key)", pc_);
 
-            new_line >>= 1;
-        }
+    if(is_held_[v_[in.x]])
+    {
+        skip();
     }
 }
 
-void CPU::op_Exkk_()
+void CPU::op_ExA1_(Instr in)
 {
-    if(!(v_[x()] < 0x10)) 
+    if(!(v_[in.x] < 0x10)) 
         opcode_throw("Exkk: non-nibble Vx (no equivalent key)", pc_);
 
-    switch(kk())
+    if(!is_held_[v_[in.x]])
     {
-    case(0x9E):
-        if(is_held_[v_[x()]])
-        {
-            pc_ += BYTES_PER_OPCODE;
-        }
-        break;
-
-    case(0xA1):
-        if(!is_held_[v_[x()]])
-        {
-            pc_ += BYTES_PER_OPCODE;
-        }
-        break;
-
-    default:
-        bad_opcode(pc_);
-        break;
+        skip();
     }
 }
 
-void CPU::op_Fxkk_()
+void CPU::op_Fx07_(Instr in)
+{
+    v_[in.x] = scheduler_.timer_value(delay_end_);
+}
+
+template<unsigned int Quirks>
+void CPU::op_Fx0A_(Instr in)
 {
+    constexpr bool key_up_FX0A = (Quirks & KEY_UP_FX0A);
     bool key_pressed = false;
 
-    switch(kk())
+    if(Quirks & OLD_PRESS_FX0A)
     {
-    case(0x07):
-        v_[x()] = static_cast<uint8_t>(std::ceil(delay_timer_));
-        break;
-
-    case(0x0A): 
-        if(old_press_FX0A_)
+        for(unsigned int key = static_cast<unsigned int>(Keys::KEY_0); 
+            key < static_cast<unsigned int>(Keys::QUANTITY_OF_KEYS); 
+            ++key)
         {
-            for(unsigned int key = static_cast<unsigned int>(Keys::KEY_0); 
-                key < static_cast<unsigned int>(Keys::QUANTITY_OF_KEYS); 
-                ++key)
+            if(is_held_[key] == !key_up_FX0A)
             {
-                if(is_held_[key] == !key_up_FX0A_)
-                {
-                    key_pressed = true;
-                    v_[x()] = key;
-                    break;
-                }
+                key_pressed = true;
+                v_[in.x] = key;
+                break;
             }
-            if(!key_pressed) pc_ -= BYTES_PER_OPCODE;
         }
-        else
+        if(!key_pressed) 
         {
-            paused_ = true;
             pc_ -= BYTES_PER_OPCODE;
+            events_ |= STOP_AWAIT_KEY;
         }
-        break;
-
-    case(0x15):
-        delay_timer_ = v_[x()];
-        break;
-
-    case(0x18):
-        sound_timer_ = v_[x()];
-        break;
-
-    case(0x1E):
-        i_ += v_[x()];
-        break;
-
-    case(0x29):
-        i_ = font_address(v_[x()]);
-        break;
-
-    case(0x33):
-        if((i_ < PROGRAM_BEGIN) || (i_ + 2 >= RAM_SIZE))
-            bad_ram_access(pc_);
-        ram_[i_ + 0] = (v_[x()] / 100) % 10;
-        ram_[i_ + 1] = (v_[x()] /  10) % 10;
-        ram_[i_ + 2] = (v_[x()] /   1) % 10;
-        break;
-
-    case(0x55): 
-        if(((i_ < PROGRAM_BEGIN) || (i_ + x() >= RAM_SIZE)) && (x() > 0))
-            bad_ram_access(pc_);
-        for(unsigned int iter = 0; iter <= x(); ++iter)
-        {
-            ram_[i_ + iter] = v_[iter];
-        }
-        if(!new_FXU5_) i_ += x() + 1;
-        break;
+    }
+    else
+    {
+        paused_ = true;
+        pc_ -= BYTES_PER_OPCODE;
+        events_ |= STOP_AWAIT_KEY;
+    }
+}
 
-    case(0x65): 
-        if((i_ + x() >= RAM_SIZE) && (x() > 0))
-            bad_ram_access(pc_);
-        for(unsigned int iter = 0; iter <= x(); ++iter)
-        {
-            v_[iter] = ram_[i_ + iter];
-        }
-        if(!new_FXU5_) i_ += x() + 1;
-        break;
+void CPU::op_Fx15_(Instr in)
+{
+    delay_end_ = scheduler_.timer_end(v_[in.x]);
+}
+
+void CPU::op_Fx18_(Instr in)
+{
+    sound_end_ = scheduler_.timer_end(v_[in.x]);
+    events_ |= STOP_SOUND;
+}
+
+void CPU::op_Fx1E_(Instr in)
+{
+    i_ += v_[in.x];
+}
+
+void CPU::op_Fx29_(Instr in)
+{
+    i_ = font_address(v_[in.x]);
+}
+
+void CPU::op_Fx33_(Instr in)
+{
+    if((i_ < PROGRAM_BEGIN) || (i_ + 2 >= RAM_SIZE))
+        bad_ram_access(pc_);
+    watch(i_, 3, WATCH_WRITE);
+    uint8_t* ram = poke(i_, 3);
+    ram[0] = (v_[in.x] / 100) % 10;
+    ram[1] = (v_[in.x] /  10) % 10;
+    ram[2] = (v_[in.x] /   1) % 10;
+    invalidate(i_, i_ + 2);
+}
+
+template<unsigned int Quirks>
+void CPU::op_Fx55_(Instr in)
+{
+    if((i_ + in.x >= RAM_SIZE) || ((i_ < PROGRAM_BEGIN) && (in.x > 0)))
+        bad_ram_access(pc_);
+    watch(i_, in.x + 1, WATCH_WRITE);
+    std::copy_n(v_, in.x + 1, poke(i_, in.x + 1));
+    invalidate(i_, i_ + in.x);
+    if(!(Quirks & NEW_FXU5)) i_ += in.x + 1;
+}
+
+template<unsigned int Quirks>
+void CPU::op_Fx65_(Instr in)
+{
+    if(i_ + in.x >= RAM_SIZE)
+        bad_ram_access(pc_);
+    watch(i_, in.x + 1, WATCH_READ);
+    uint8_t scratch[0x10];
+    std::copy_n(peek(i_, in.x + 1, scratch), in.x + 1, v_);
+    if(!(Quirks & NEW_FXU5)) i_ += in.x + 1;
+}
+
+//Instantiations used by quirk_handlers_ (see chip8.cpp)
+template void CPU::op_8xy6_<0>(Instr);
+template void CPU::op_8xy6_<NEW_8XYU>(Instr);
+template void CPU::op_8xyE_<0>(Instr);
+template void CPU::op_8xyE_<NEW_8XYU>(Instr);
+template void CPU::op_Fx0A_<0>(Instr);
+template void CPU::op_Fx0A_<KEY_UP_FX0A>(Instr);
+template void CPU::op_Fx0A_<OLD_PRESS_FX0A>(Instr);
+template void CPU::op_Fx0A_<KEY_UP_FX0A | OLD_PRESS_FX0A>(Instr);
+template void CPU::op_Fx55_<0>(Instr);
+template void CPU::op_Fx55_<NEW_FXU5>(Instr);
+template void CPU::op_Fx65_<0>(Instr);
+template void CPU::op_Fx65_<NEW_FXU5>(Instr);
+
+void CPU::op_00Cn_(Instr in)
+{
+    mark_dirty(scroll_down(display_, planes_, in.z() * scale()));
+    events_ |= STOP_DRAW;
+}
+
+void CPU::op_00FB_(Instr)
+{
+    mark_dirty(scroll_right(display_, planes_, 4 * scale()));
+    events_ |= STOP_DRAW;
+}
+
+void CPU::op_00FC_(Instr)
+{
+    mark_dirty(scroll_left(display_, planes_, 4 * scale()));
+    events_ |= STOP_DRAW;
+}
+
+void CPU::op_00FD_(Instr)
+{
+    //Nothing follows, so the program idles here as on a jump to itself
+    pc_ -= BYTES_PER_OPCODE;
+    skip_to(idle_bound());
+}
+
+void CPU::op_00FE_(Instr)
+{
+    hires_ = false;
+    if(HAS_XOCHIP)
+    {
+        mark_dirty(clear_planes(display_, (1U << PLANES) - 1));
+        events_ |= STOP_DRAW;
+    }
+}
 
-    default:
-        bad_opcode(pc_);
-        break;
+void CPU::op_00FF_(Instr)
+{
+    hires_ = true;
+    if(HAS_XOCHIP)
+    {
+        mark_dirty(clear_planes(display_, (1U << PLANES) - 1));
+        events_ |= STOP_DRAW;
     }
 }
+
+void CPU::op_Fx30_(Instr in)
+{
+    i_ = big_font_address(v_[in.x] & 0xF);
+}
+
+void CPU::op_Fx75_(Instr in)
+{
+    if(in.x >= FLAG_REGISTERS)
+        opcode_throw("Fx75: No such flag register", pc_);
+    std::memcpy(flag_registers_, v_, in.x + 1);
+}
+
+void CPU::op_Fx85_(Instr in)
+{
+    if(in.x >= FLAG_REGISTERS)
+        opcode_throw("Fx85: No such flag register", pc_);
+    std::memcpy(v_, flag_registers_, in.x + 1);
+}
+
+void CPU::op_00Dn_(Instr in)
+{
+    mark_dirty(scroll_up(display_, planes_, in.z() * scale()));
+    events_ |= STOP_DRAW;
+}
+
+void CPU::op_5xy2_(Instr in)
+{
+    const unsigned int first = std::min(in.x, in.y());
+    const unsigned int last = std::max(in.x, in.y());
+    const unsigned int n = last - first;
+    if((i_ + n >= RAM_SIZE) || ((i_ < PROGRAM_BEGIN) && (n > 0)))
+        bad_ram_access(pc_);
+    watch(i_, n + 1, WATCH_WRITE);
+    //In order from Vx, so descending if x > y
+    uint8_t* ram = poke(i_, n + 1);
+    for(unsigned int iter = 0; iter <= n; ++iter)
+    {
+        ram[iter] = v_[(in.x <= in.y()) ? first + iter : last - iter];
+    }
+    invalidate(i_, i_ + n);
+}
+
+void CPU::op_5xy3_(Instr in)
+{
+    const unsigned int first = std::min(in.x, in.y());
+    const unsigned int last = std::max(in.x, in.y());
+    const unsigned int n = last - first;
+    if(i_ + n >= RAM_SIZE)
+        bad_ram_access(pc_);
+    watch(i_, n + 1, WATCH_READ);
+    for(unsigned int iter = 0; iter <= n; ++iter)
+    {
+        v_[(in.x <= in.y()) ? first + iter : last - iter] = peek(i_ + iter);
+    }
+}
+
+void CPU::op_F000_(Instr)
+{
+    //pc_ wraps past the end of RAM
+    if(pc_ < PROGRAM_BEGIN)
+        bad_ram_access(pc_);
+    i_ = (peek(pc_) << 8) | peek(pc_ + 1);
+    pc_ += BYTES_PER_OPCODE;
+}
+
+void CPU::op_Fn01_(Instr in)
+{
+    planes_ = in.x & ((1U << PLANES) - 1);
+}
+
+void CPU::op_F002_(Instr)
+{
+    if(i_ + AUDIO_PATTERN_SIZE - 1 >= RAM_SIZE)
+        bad_ram_access(pc_);
+    for(unsigned int b = 0; b < AUDIO_PATTERN_SIZE; ++b)
+        audio_pattern_[b] = peek(i_ + b);
+}
+
+void CPU::op_Fx3A_(Instr in)
+{
+    audio_pitch_ = v_[in.x];
+}
+
+//Superinstructions: the cached Instr describes the first instruction only,
+//with those following it read directly from RAM. Each instruction executed
+//after the first accounts for its own cycle.
+namespace
+{
+    uint16_t nnn_of(uint8_t high, uint8_t low)
+    {
+        return ((0xF & high) << 8) | low;
+    }
+}
+
+void CPU::op_3xkk_1nnn_(Instr in)
+{
+    op_3xkk_(in);
+    if(v_[in.x] != in.kk)
+    {
+        tick();
+        pc_ = nnn_of(peek(pc_), peek(pc_ + 1));
+    }
+}
+
+void CPU::op_4xkk_1nnn_(Instr in)
+{
+    op_4xkk_(in);
+    if(v_[in.x] == in.kk)
+    {
+        tick();
+        pc_ = nnn_of(peek(pc_), peek(pc_ + 1));
+    }
+}
+
+void CPU::op_Ex9E_1nnn_(Instr in)
+{
+    op_Ex9E_(in);
+    if(!is_held_[v_[in.x]])
+    {
+        tick();
+        pc_ = nnn_of(peek(pc_), peek(pc_ + 1));
+    }
+}
+
+void CPU::op_ExA1_1nnn_(Instr in)
+{
+    op_ExA1_(in);
+    if(is_held_[v_[in.x]])
+    {
+        tick();
+        pc_ = nnn_of(peek(pc_), peek(pc_ + 1));
+    }
+}
+
+template<unsigned int N>
+void CPU::op_6xkk_xN_(Instr in)
+{
+    v_[in.x] = in.kk;
+    for(unsigned int n = 1; n < N; ++n)
+    {
+        tick();
+        v_[0xF & peek(pc_)] = peek(pc_ + 1);
+        pc_ += BYTES_PER_OPCODE;
+    }
+}
+
+template void CPU::op_6xkk_xN_<2>(Instr);
+template void CPU::op_6xkk_xN_<3>(Instr);
+template void CPU::op_6xkk_xN_<4>(Instr);
+
+//Idle loops: one iteration executes as usual, then as many whole iterations
+//as can't change anything (or reach the run's bound) are skipped at once
+void CPU::op_1nnn_idle_(Instr in)
+{
+    op_1nnn_(in);
+    skip_to(idle_bound());
+}
+
+void CPU::op_Fx07_3xkk_1nnn_(Instr in)
+{
+    const uint16_t loop = pc_ - BYTES_PER_OPCODE;
+    const uint8_t until = peek(pc_ + 1);
+    const uint64_t read = scheduler_.cycle();
+
+    op_Fx07_(in);
+    tick();
+    if(v_[in.x] == until)
+    {
+        pc_ += 2 * BYTES_PER_OPCODE;
+        return;
+    }
+    tick();
+    pc_ = loop;
+
+    //Each further iteration reads the timer 3 cycles after the last: those
+    //before it can read until (it only decreases), and ending by the bound, 
+    //are skipped
+    uint64_t n = (idle_bound() - scheduler_.cycle()) / 3;
+    if(v_[in.x] > until)
+    {
+        const uint64_t exit = scheduler_.frame_cycle(delay_end_ - until);
+        n = std::min(n, (exit - 1 - read) / 3);
+    }
+    if(n == 0) return;
+
+    skip_to(read + 3 * n);
+    op_Fx07_(in);
+    skip_to(read + 3 * n + 2);
+}
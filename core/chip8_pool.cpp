@@ -0,0 +1,30 @@
+#include <cstddef>      //size_t
+#include <memory>       //std::shared_ptr, std::make_unique
+
+#include "chip8_pool.h"
+
+using namespace chip8;
+
+Pool::Pool(std::shared_ptr<const Snapshot> boot, size_t size)
+{
+    if(!boot) throw cpu_exception("Pool has no boot image");
+
+    cpus_.reserve(size);
+    idle_.reserve(size);
+    for(size_t n = 0; n < size; ++n)
+    {
+        cpus_.push_back(std::make_unique<CPU>(boot));
+        idle_.push_back(cpus_.back().get());
+    }
+}
+
+Pool::Lease Pool::acquire()
+{
+    if(idle_.empty()) return Lease(nullptr, Release{this});
+
+    //Most recently released first, as the likeliest still in cache
+    CPU* cpu = idle_.back();
+    idle_.pop_back();
+    cpu->reset();
+    return Lease(cpu, Release{this});
+}
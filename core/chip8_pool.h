@@ -0,0 +1,46 @@
+#ifndef CHIP8_POOL_H_OLIVECC
+#define CHIP8_POOL_H_OLIVECC
+
+#include <cstddef>      //size_t
+#include <memory>       //std::shared_ptr, std::unique_ptr
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //CPUs of one boot image (see boot_image()), all constructed up front,
+    //for runs of many short episodes (e.g. reinforcement learning, fuzzing):
+    //acquire() hands out an idle CPU reset to power-on state, which returns
+    //to the pool when its Lease is destroyed, so neither allocates. Settings
+    //of a CPU other than those in the image (e.g. its engine) are kept
+    //between leases.
+    //
+    //Not thread-safe: a Pool per thread. Leases must not outlive their Pool.
+    class Pool
+    {
+    public:
+        struct Release
+        {
+            Pool* pool;
+            void operator()(CPU* cpu) const { pool->idle_.push_back(cpu); }
+        };
+        using Lease = std::unique_ptr<CPU, Release>;
+
+    private:
+        std::vector<std::unique_ptr<CPU>> cpus_;
+        std::vector<CPU*> idle_;    //Reserved for all, so never reallocated
+
+    public:
+        Pool(std::shared_ptr<const Snapshot> boot, size_t size);
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        //An idle CPU, reset, or an empty Lease if all are leased
+        Lease acquire();
+
+        size_t size() const { return cpus_.size(); }
+        size_t idle() const { return idle_.size(); }
+    };
+}
+#endif //CHIP8_POOL_H_OLIVECC
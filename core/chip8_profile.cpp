@@ -0,0 +1,135 @@
+#include <algorithm>    //std::stable_sort, std::fill
+#include <cstdint>      //uint16_t, uint64_t
+#include <cstdio>       //std::snprintf
+#include <map>          //std::map
+#include <string>       //std::string, std::to_string
+#include <utility>      //std::pair
+#include <vector>       //std::vector
+
+#include "chip8.h"
+#include "chip8_profile.h"
+
+using namespace chip8;
+
+CPU& CPU::set_profiler(Profiler* profiler)
+{
+    if(profiler_) profiler_->detach();
+    profiler_ = profiler;
+    if(profiler_) profiler_->attach(*this);
+    return *this;
+}
+
+CPU::Profiler::Profiler()
+        : families_{}, handlers_{}, hits_(RAM_SIZE), since_{}, cpu_{}
+{
+}
+
+CPU::Profiler::~Profiler()
+{
+    if(cpu_) cpu_->set_profiler(nullptr);
+}
+
+void CPU::Profiler::clear()
+{
+    std::fill(families_, families_ + 0x10, 0);
+    std::fill(handlers_, handlers_ + QUANTITY_OF_OPS, 0);
+    std::fill(hits_.begin(), hits_.end(), 0);
+    stacks_.clear();
+    if(cpu_) since_ = cpu_->scheduler_.cycle();
+}
+
+void CPU::Profiler::attach(CPU& cpu)
+{
+    //From one CPU at a time: another collecting into it stops
+    if(cpu_ && cpu_ != &cpu) cpu_->set_profiler(nullptr);
+    detach();
+    cpu_ = &cpu;
+    frames_.assign(cpu.sp_, uint16_t{UNKNOWN});
+    since_ = cpu.scheduler_.cycle();
+}
+
+void CPU::Profiler::detach()
+{
+    if(!cpu_) return;
+    const uint64_t now = cpu_->scheduler_.cycle();
+    if(now > since_) stacks_[frames_] += now - since_;
+    cpu_ = nullptr;
+}
+
+void CPU::Profiler::call_or_return()
+{
+    //Cycles since the last change are those of the stack until now
+    const uint64_t now = cpu_->scheduler_.cycle();
+    if(now > since_) stacks_[frames_] += now - since_;
+    since_ = now;
+
+    //2nnn has just jumped to the subroutine's entry
+    const unsigned int sp = cpu_->sp_;
+    if(sp > frames_.size())
+    {
+        frames_.resize(sp, uint16_t{UNKNOWN});
+        frames_.back() = cpu_->pc_;
+    }
+    else frames_.resize(sp);
+}
+
+std::vector<std::pair<std::string, uint64_t>>
+CPU::Profiler::handler_counts() const
+{
+    static const char* const names[QUANTITY_OF_OPS] = {
+        "decode",   "invalid",  "nop",
+        "00E0",     "00EE",     "1nnn",     "2nnn",     "3xkk",     "4xkk",
+        "5xy0",     "6xkk",     "7xkk",     "8xy0",     "8xy1",     "8xy2",
+        "8xy3",     "8xy4",     "8xy5",     "8xy6",     "8xy7",     "8xyE",
+        "9xy0",     "Annn",     "Bnnn",     "Cxkk",     "Dxyz",     "Ex9E",
+        "ExA1",     "Fx07",     "Fx0A",     "Fx15",     "Fx18",     "Fx1E",
+        "Fx29",     "Fx33",     "Fx55",     "Fx65",
+        "00Cn",     "00FB",     "00FC",     "00FD",     "00FE",     "00FF",
+        "Fx30",     "Fx75",     "Fx85",
+        "00Dn",     "5xy2",     "5xy3",     "F000",     "Fn01",     "F002",
+        "Fx3A",
+        "3xkk_1nnn",        "4xkk_1nnn",        "Ex9E_1nnn",    "ExA1_1nnn",
+        "6xkk_x2",          "6xkk_x3",          "6xkk_x4",
+        "1nnn_idle",        "Fx07_3xkk_1nnn"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == QUANTITY_OF_OPS,
+                  "A name per handler");
+
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    for(unsigned int op = 0; op < QUANTITY_OF_OPS; ++op)
+    {
+        if(handlers_[op]) counts.emplace_back(names[op], handlers_[op]);
+    }
+    std::stable_sort(counts.begin(), counts.end(),
+        [](const std::pair<std::string, uint64_t>& a,
+           const std::pair<std::string, uint64_t>& b)
+        { return a.second > b.second; });
+    return counts;
+}
+
+std::vector<std::string> CPU::Profiler::collapsed_stacks() const
+{
+    //Including the current stack, up to now
+    std::map<std::vector<uint16_t>, uint64_t> stacks = stacks_;
+    if(cpu_ && cpu_->scheduler_.cycle() > since_)
+        stacks[frames_] += cpu_->scheduler_.cycle() - since_;
+
+    std::vector<std::string> lines;
+    for(const auto& stack : stacks)
+    {
+        char frame[8];
+        std::snprintf(frame, sizeof(frame), "%03X", PROGRAM_BEGIN);
+        std::string line = frame;
+        for(uint16_t entry : stack.first)
+        {
+            if(entry == UNKNOWN) line += ";?";
+            else
+            {
+                std::snprintf(frame, sizeof(frame), ";%03X", entry);
+                line += frame;
+            }
+        }
+        lines.push_back(line + ' ' + std::to_string(stack.second));
+    }
+    return lines;
+}
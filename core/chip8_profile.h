@@ -0,0 +1,73 @@
+#ifndef CHIP8_PROFILE_H_OLIVECC
+#define CHIP8_PROFILE_H_OLIVECC
+
+#include <cstdint>      //uint8_t, uint16_t, uint64_t
+#include <map>          //std::map
+#include <string>       //std::string
+#include <utility>      //std::pair
+#include <vector>       //std::vector
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //Guest-level profile of a CPU, collected while attached to it with
+    //CPU::set_profiler() in builds with CHIP8_PROFILE defined (elsewhere
+    //nothing is collected, and the run loop has no instrumentation).
+    //
+    //While attached, every instruction is interpreted (any engine or static
+    //program is bypassed), and each dispatch of a handler is counted, with
+    //its opcode family (first nibble) and address: a superinstruction, or an
+    //idle loop skipped, counts once at its first instruction. Cycles are
+    //attributed to call stacks, which change on each 2nnn and 00EE, for
+    //flame graphs.
+    class CPU::Profiler
+    {
+    private:
+        uint64_t families_[0x10];
+        uint64_t handlers_[QUANTITY_OF_OPS];
+        std::vector<uint64_t> hits_;        //RAM_SIZE
+
+        //Entry of each subroutine called: stack_ holds only return
+        //addresses. UNKNOWN where calls weren't seen (e.g. after restore()).
+        static constexpr uint16_t UNKNOWN = 0xFFFF;
+        std::vector<uint16_t> frames_;
+        std::map<std::vector<uint16_t>, uint64_t> stacks_; //Cycles in each
+        uint64_t since_;    //Cycle frames_ was entered on
+
+        CPU* cpu_;
+
+        friend class CPU;
+        void attach(CPU&);          //Or, after restore(), re-attach
+        void detach();
+        void count(uint16_t addr, Instr instr)
+        {
+            ++families_[cpu_->peek(addr) >> 4];
+            ++handlers_[instr.op];
+            ++hits_[addr];
+        }
+        void call_or_return();      //sp_ changed
+
+    public:
+        Profiler();
+        ~Profiler();                //Detaches
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        void clear();
+
+        //Counts of executions: of the family of opcodes nxxx, and at addr
+        uint64_t family_count(unsigned int n) const { return families_[n]; }
+        uint64_t address_count(unsigned int addr) const { return hits_[addr]; }
+
+        //Dispatches of each handler (named as in chip8.h, e.g. "Fx33",
+        //"6xkk_x2"), in decreasing order of count, omitting those never run
+        std::vector<std::pair<std::string, uint64_t>> handler_counts() const;
+
+        //Cycles spent in each call stack, as lines of the collapsed stack
+        //format read by flame graph tools: frames from the outermost, named
+        //by entry address (e.g. "200;2A4;31E 1234"), "?" if unknown
+        std::vector<std::string> collapsed_stacks() const;
+    };
+}
+#endif //CHIP8_PROFILE_H_OLIVECC
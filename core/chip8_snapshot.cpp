@@ -0,0 +1,342 @@
+#include <algorithm>    //std::fill, std::copy_n
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstring>      //std::memcpy, std::memcmp, size_t
+#include <memory>       //std::unique_ptr, std::make_unique
+#include <sstream>      //std::ostringstream, std::istringstream
+#include <string>       //std::stoul, std::to_string
+#include <vector>       //std::vector
+
+#include "chip8.h"
+#include "chip8_aot.h"
+#include "chip8_jit.h"
+#include "chip8_profile.h"
+#include "chip8_trace.h"
+
+using namespace chip8;
+
+CPU::CPU(const Snapshot& snapshot)
+        : dirty_rows_{}, display_generation_{}, events_{}, stop_on_{}, 
+          limit_{}, decoded_size_{}, profiler_{}, tracer_{}
+{
+    load(snapshot);
+}
+
+CPU::CPU(const CPU& other)
+        : CPU(other.snapshot())
+{
+    if(other.decoded_size_)
+    {
+        grow_decoded(other.decoded_size_ - 1);
+        std::copy_n(other.decoded_.get(), decoded_size_, decoded_.get());
+    }
+    input_ = other.input_;
+    set_engine(other.get_engine());
+    set_static_program(other.get_static_program());
+    if(other.debug_) debug_ = std::make_unique<Debug>(*other.debug_);
+
+    //Pages other shares with its boot image are shared by the copy too
+    boot_ = other.boot_;
+    for(unsigned int page = 0; page < RAM_PAGES; ++page)
+    {
+        if(!other.is_own(page)) pages_[page] = other.pages_[page];
+    }
+}
+
+const CPU& CPU::snapshot(Snapshot& out) const
+{
+    copy_ram(out.ram);
+    std::memcpy(out.display, display_, sizeof(display_));
+    std::memcpy(out.v, v_, sizeof(v_));
+    out.i = i_;
+    out.pc = pc_;
+    std::memcpy(out.stack, stack_, sizeof(stack_));
+    out.sp = sp_;
+    out.delay_timer = scheduler_.timer_value(delay_end_);
+    out.sound_timer = scheduler_.timer_value(sound_end_);
+    out.rng = rng_;
+    std::memcpy(out.is_held, is_held_, sizeof(is_held_));
+    out.paused = paused_;
+    out.cycle = scheduler_.cycle();
+    out.frame = scheduler_.frame();
+    out.frame_phase = scheduler_.phase();
+    unsigned int flags = NO_FLAGS;
+    if(key_up_FX0A_)    flags |= KEY_UP_FX0A;
+    if(old_press_FX0A_) flags |= OLD_PRESS_FX0A;
+    if(new_8XYU_)       flags |= NEW_8XYU;
+    if(new_FXU5_)       flags |= NEW_FXU5;
+    out.flags = static_cast<Flags>(flags);
+    out.clock_speed_hz = scheduler_.get_clock_speed_hz();
+    std::memcpy(out.palette, palette_, sizeof(palette_));
+    out.hires = hires_;
+    out.planes = planes_;
+    std::memcpy(out.flag_registers, flag_registers_, sizeof(flag_registers_));
+    std::memcpy(out.audio_pattern, audio_pattern_, sizeof(audio_pattern_));
+    out.audio_pitch = audio_pitch_;
+
+    return *this;
+}
+
+Snapshot CPU::snapshot() const
+{
+    Snapshot out;
+    snapshot(out);
+    return out;
+}
+
+CPU& CPU::restore(const Snapshot& in)
+{
+    //Only cached instructions in runs of differing RAM are invalidated, so
+    //restoring to a state of the same program is cheap. Pages shared with 
+    //in itself (i.e. with the boot image, by reset()) aren't compared.
+    using Word = uint64_t;
+    static_assert(RAM_PAGE_SIZE % sizeof(Word) == 0, "Pages are whole words");
+    for(unsigned int page = 0; page < RAM_PAGES; ++page)
+    {
+        const unsigned int base = page * RAM_PAGE_SIZE;
+        const uint8_t* const from = in.ram + base;
+        if(pages_[page] == from) continue;
+
+        for(unsigned int offset = 0; offset < RAM_PAGE_SIZE; 
+            offset += sizeof(Word))
+        {
+            Word a, b;
+            std::memcpy(&a, pages_[page] + offset, sizeof(Word));
+            std::memcpy(&b, from + offset, sizeof(Word));
+            if(a == b) continue;
+
+            const unsigned int begin = offset;
+            do
+            {
+                offset += sizeof(Word);
+                if(offset >= RAM_PAGE_SIZE) break;
+                std::memcpy(&a, pages_[page] + offset, sizeof(Word));
+                std::memcpy(&b, from + offset, sizeof(Word));
+            }
+            while(a != b);
+            invalidate(base + begin, base + offset - 1);
+        }
+    }
+
+    //Translations embed the quirks they were made with (e.g. 8xy6's source)
+    if(jit_ && handlers_for(in.flags) != handlers_)
+        jit_->invalidate(0, RAM_SIZE - 1);
+
+    load(in);
+    input_.clear();
+    if(aot_) aot_->verify(*this);
+    if(is_profiled()) profiler_->attach(*this);
+    if(is_traced()) tracer_->attach(*this);
+
+    //Runs break afresh from the state restored: even on the cycle last
+    //broken on (e.g. 0, after reset()), and on conditions already true
+    if(debug_)
+    {
+        debug_->resumed_at = UINT64_MAX;
+        std::fill(debug_->were_met.begin(), debug_->were_met.end(), false);
+    }
+    return *this;
+}
+
+CPU& CPU::reset()
+{
+    //Only pages written since are compared, and shared once more
+    if(!boot_) throw cpu_exception("CPU has no boot image to reset to", pc_);
+    return restore(*boot_);
+}
+
+std::unique_ptr<CPU> CPU::fork() const
+{
+    return std::make_unique<CPU>(*this);
+}
+
+void CPU::load(const Snapshot& in)
+{
+    load_ram(in.ram);
+    std::memcpy(display_, in.display, sizeof(display_));
+    mark_dirty(ALL_ROWS);
+    std::memcpy(v_, in.v, sizeof(v_));
+    i_ = in.i;
+    pc_ = in.pc;
+    std::memcpy(stack_, in.stack, sizeof(stack_));
+    sp_ = in.sp;
+    rng_ = in.rng;
+    std::memcpy(is_held_, in.is_held, sizeof(is_held_));
+    paused_ = in.paused;
+    scheduler_ = Scheduler(in.clock_speed_hz, in.cycle, in.frame, 
+                           in.frame_phase);
+    delay_end_ = scheduler_.timer_end(in.delay_timer);
+    sound_end_ = scheduler_.timer_end(in.sound_timer);
+    key_up_FX0A_    = in.flags & KEY_UP_FX0A;
+    old_press_FX0A_ = in.flags & OLD_PRESS_FX0A;
+    new_8XYU_       = in.flags & NEW_8XYU;
+    new_FXU5_       = in.flags & NEW_FXU5;
+    handlers_ = handlers_for(in.flags);
+    std::memcpy(palette_, in.palette, sizeof(palette_));
+    hires_ = in.hires;
+    planes_ = in.planes;
+    std::memcpy(flag_registers_, in.flag_registers, sizeof(flag_registers_));
+    std::memcpy(audio_pattern_, in.audio_pattern, sizeof(audio_pattern_));
+    audio_pitch_ = in.audio_pitch;
+}
+
+
+//Serialisation: little-endian fields, in declaration order, following a
+//magic number, format version and variant (see CHIP8_VARIANT). The version
+//is incremented on any change.
+namespace
+{
+    constexpr char magic[8] = {'C', 'H', 'O', 'P', '8', 'S', 'N', 'P'};
+    constexpr uint32_t version = 3;
+    constexpr uint32_t variant = CHIP8_VARIANT;
+
+    class Writer
+    {
+    private:
+        std::vector<uint8_t>& out_;
+
+    public:
+        explicit Writer(std::vector<uint8_t>& out) : out_{out} {}
+
+        void bytes(const void* data, size_t size)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            out_.insert(out_.end(), p, p + size);
+        }
+
+        template<typename T>
+        void uint(T value)
+        {
+            for(unsigned int b = 0; b < sizeof(T); ++b)
+                out_.push_back(static_cast<uint8_t>(value >> (8 * b)));
+        }
+
+    };
+
+    class Reader
+    {
+    private:
+        const uint8_t* p_;
+        const uint8_t* const end_;
+
+        void need(size_t size)
+        {
+            if(static_cast<size_t>(end_ - p_) < size)
+                throw cpu_exception("Snapshot data truncated");
+        }
+
+    public:
+        Reader(const void* data, size_t size)
+            : p_{static_cast<const uint8_t*>(data)}, end_{p_ + size} {}
+
+        void bytes(void* data, size_t size)
+        {
+            need(size);
+            std::memcpy(data, p_, size);
+            p_ += size;
+        }
+
+        template<typename T>
+        T uint()
+        {
+            need(sizeof(T));
+            T value = 0;
+            for(unsigned int b = 0; b < sizeof(T); ++b)
+                value |= static_cast<T>(static_cast<T>(*p_++) << (8 * b));
+            return value;
+        }
+
+        bool at_end() const { return p_ == end_; }
+    };
+}
+
+std::vector<uint8_t> chip8::serialize(const Snapshot& s)
+{
+    std::vector<uint8_t> out;
+    out.reserve(sizeof(Snapshot) + sizeof(magic) + sizeof(version) + 
+                sizeof(variant));
+    Writer w(out);
+
+    w.bytes(magic, sizeof(magic));
+    w.uint(version);
+    w.uint(variant);
+
+    w.bytes(s.ram, sizeof(s.ram));
+    for(uint64_t word : s.display) w.uint(word);
+    w.bytes(s.v, sizeof(s.v));
+    w.uint(s.i);
+    w.uint(s.pc);
+    for(uint16_t addr : s.stack) w.uint(addr);
+    w.uint(s.sp);
+    w.uint(s.delay_timer);
+    w.uint(s.sound_timer);
+
+    //The standard specifies the textual form of an engine's state
+    std::ostringstream rng;
+    rng << s.rng;
+    w.uint(static_cast<uint32_t>(std::stoul(rng.str())));
+
+    for(bool held : s.is_held) w.uint(static_cast<uint8_t>(held));
+    w.uint(static_cast<uint8_t>(s.paused));
+    w.uint(s.cycle);
+    w.uint(s.frame);
+    w.uint(static_cast<uint32_t>(s.frame_phase));
+    w.uint(static_cast<uint32_t>(s.flags));
+    w.uint(static_cast<uint32_t>(s.clock_speed_hz));
+    for(uint32_t argb : s.palette) w.uint(argb);
+    w.uint(static_cast<uint8_t>(s.hires));
+    w.uint(s.planes);
+    w.bytes(s.flag_registers, sizeof(s.flag_registers));
+    w.bytes(s.audio_pattern, sizeof(s.audio_pattern));
+    w.uint(s.audio_pitch);
+
+    return out;
+}
+
+Snapshot chip8::deserialize(const void* data, size_t size)
+{
+    Reader r(data, size);
+    Snapshot s;
+
+    char m[sizeof(magic)];
+    r.bytes(m, sizeof(m));
+    if(std::memcmp(m, magic, sizeof(magic)) != 0)
+        throw cpu_exception("Not a snapshot");
+    if(r.uint<uint32_t>() != version)
+        throw cpu_exception("Unsupported snapshot version");
+    if(r.uint<uint32_t>() != variant)
+        throw cpu_exception("Snapshot is of a different CHIP-8 variant");
+
+    r.bytes(s.ram, sizeof(s.ram));
+    for(uint64_t& word : s.display) word = r.uint<uint64_t>();
+    r.bytes(s.v, sizeof(s.v));
+    s.i = r.uint<uint16_t>();
+    s.pc = r.uint<uint16_t>();
+    for(uint16_t& addr : s.stack) addr = r.uint<uint16_t>();
+    s.sp = r.uint<uint8_t>();
+    s.delay_timer = r.uint<uint8_t>();
+    s.sound_timer = r.uint<uint8_t>();
+
+    std::istringstream rng(std::to_string(r.uint<uint32_t>()));
+    rng >> s.rng;
+
+    for(bool& held : s.is_held) held = r.uint<uint8_t>();
+    s.paused = r.uint<uint8_t>();
+    s.cycle = r.uint<uint64_t>();
+    s.frame = r.uint<uint64_t>();
+    s.frame_phase = r.uint<uint32_t>();
+    s.flags = static_cast<Flags>(r.uint<uint32_t>());
+    s.clock_speed_hz = r.uint<uint32_t>();
+    for(uint32_t& argb : s.palette) argb = r.uint<uint32_t>();
+    s.hires = r.uint<uint8_t>();
+    s.planes = r.uint<uint8_t>();
+    r.bytes(s.flag_registers, sizeof(s.flag_registers));
+    r.bytes(s.audio_pattern, sizeof(s.audio_pattern));
+    s.audio_pitch = r.uint<uint8_t>();
+
+    if(!r.at_end()) throw cpu_exception("Snapshot data has trailing bytes");
+    if(s.sp > STACK_MAX_SIZE || s.clock_speed_hz == 0 || 
+       s.frame_phase >= s.clock_speed_hz || s.planes >= COLOURS)
+        throw cpu_exception("Snapshot state is invalid");
+
+    return s;
+}
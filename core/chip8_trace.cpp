@@ -0,0 +1,278 @@
+#include <atomic>       //std::memory_order_*
+#include <chrono>       //std::chrono::milliseconds
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstring>      //std::memcpy, size_t
+#include <memory>       //std::make_unique
+#include <thread>       //std::thread, std::this_thread
+#include <utility>      //std::move
+#include <vector>       //std::vector
+
+#include "chip8.h"
+#include "chip8_encoding.h"
+#include "chip8_trace.h"
+
+using namespace chip8;
+using namespace chip8::encoding;
+
+namespace
+{
+    constexpr Format format = {
+        {'C', 'H', 'O', 'P', '8', 'T', 'R', 'C'}, 1, "trace"
+    };
+
+    //Each event begins with a tag. STATE is followed by the cycle, pc, I
+    //and V0 to VF in full. A step is followed by, in order: a varint
+    //(LEB128) of the cycles since the previous event less CYCLES, if the
+    //tag's CYCLES field is all ones (otherwise it holds them); its pc, if
+    //not the previous step's plus 2; its opcode; and Vx, VF and I, where
+    //changed from what was last recorded. Values are little-endian.
+    enum : uint8_t
+    {
+        TAG_CYCLES = 0x07,
+        TAG_PC = 0x08,
+        TAG_VX = 0x10,
+        TAG_VF = 0x20,
+        TAG_I = 0x40,
+        TAG_STATE = 0x80
+    };
+
+    //Encoded bytes are passed to the sink in runs of about this many
+    constexpr size_t SINK_SIZE = 0x10000;
+}
+
+
+CPU& CPU::set_tracer(Tracer* tracer)
+{
+    if(tracer_) tracer_->detach();
+    tracer_ = tracer;
+    if(tracer_) tracer_->attach(*this);
+    return *this;
+}
+
+CPU::Tracer::Tracer(Sink sink)
+        : ring_{std::make_unique<Entry[]>(RING_SIZE)}, tail_{},
+          room_{RING_SIZE}, is_begun_{}, published_{0}, head_{0},
+          is_stopping_{false}, sink_{std::move(sink)}, cpu_{}
+{
+    writer_ = std::thread(&Tracer::write, this);
+}
+
+CPU::Tracer::~Tracer()
+{
+    if(cpu_) cpu_->set_tracer(nullptr);
+    is_stopping_.store(true, std::memory_order_release);
+    writer_.join();
+}
+
+void CPU::Tracer::attach(CPU& cpu)
+{
+    //Of one CPU at a time: another recording into it stops
+    if(cpu_ && cpu_ != &cpu) cpu_->set_tracer(nullptr);
+    detach();
+    cpu_ = &cpu;
+
+    //Steps are recorded from this state onwards: its Entries are published
+    //together, so room is made for both first
+    if(room_ - tail_ < 2) make_room(2);
+    for(unsigned int e = 0; e < 2; ++e)
+    {
+        Entry& entry = ring_[tail_ & (RING_SIZE - 1)];
+        if(e == 0) entry = {cpu.scheduler_.cycle(), STATE_PC, cpu.pc_,
+                            cpu.i_, 0, 0};
+        else std::memcpy(&entry, cpu.v_, sizeof(entry));
+        ++tail_;
+    }
+    publish();
+}
+
+void CPU::Tracer::detach()
+{
+    if(!cpu_) return;
+
+    //An instruction that threw is recorded as it left the registers
+    if(is_begun_) end();
+    publish();
+    cpu_ = nullptr;
+}
+
+void CPU::Tracer::make_room(unsigned int size)
+{
+    publish();
+    uint64_t head;
+    while(tail_ + size - (head = head_.load(std::memory_order_acquire))
+          > RING_SIZE)
+    {
+        std::this_thread::yield();
+    }
+    room_ = head + RING_SIZE;
+}
+
+void CPU::Tracer::publish()
+{
+    published_.store(tail_, std::memory_order_release);
+}
+
+void CPU::Tracer::write()
+{
+    std::vector<uint8_t> out;
+    out.reserve(SINK_SIZE + 0x40);
+    put_header(out, format);
+
+    //What the reader will last have decoded
+    uint64_t cycle = 0;
+    uint16_t next_pc = 0;
+    uint16_t i = 0;
+    uint8_t v[0x10] = {};
+
+    uint64_t head = 0;
+    for(;;)
+    {
+        //Stopping is read first, so all published before it is seen
+        const bool is_stopping = is_stopping_.load(std::memory_order_acquire);
+        const uint64_t published = published_.load(std::memory_order_acquire);
+        if(head == published)
+        {
+            if(!out.empty()) sink_(out.data(), out.size());
+            out.clear();
+            if(is_stopping) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        for(; head != published; ++head)
+        {
+            const Entry& entry = ring_[head & (RING_SIZE - 1)];
+            if(entry.pc == STATE_PC)
+            {
+                cycle = entry.cycle;
+                next_pc = entry.opcode;
+                i = entry.i;
+                std::memcpy(v, &ring_[++head & (RING_SIZE - 1)], sizeof(v));
+
+                out.push_back(TAG_STATE);
+                put(out, cycle);
+                put(out, next_pc);
+                put(out, i);
+                out.insert(out.end(), v, v + sizeof(v));
+                continue;
+            }
+
+            const size_t at = out.size();
+            out.push_back(0);
+            uint8_t tag = 0;
+
+            const uint64_t cycles = entry.cycle - cycle;
+            if(cycles < TAG_CYCLES) tag |= cycles;
+            else
+            {
+                tag |= TAG_CYCLES;
+                put_varint(out, cycles - TAG_CYCLES);
+            }
+            cycle = entry.cycle;
+
+            if(entry.pc != next_pc)
+            {
+                tag |= TAG_PC;
+                put(out, entry.pc);
+            }
+            next_pc = entry.pc + BYTES_PER_OPCODE;
+            put(out, entry.opcode);
+
+            //Vx first: if x is F, VF is then unchanged
+            const unsigned int x = (entry.opcode >> 8) & 0xF;
+            if(entry.vx != v[x])
+            {
+                tag |= TAG_VX;
+                out.push_back(v[x] = entry.vx);
+            }
+            if(entry.vf != v[0xF])
+            {
+                tag |= TAG_VF;
+                out.push_back(v[0xF] = entry.vf);
+            }
+            if(entry.i != i)
+            {
+                tag |= TAG_I;
+                put(out, i = entry.i);
+            }
+            out[at] = tag;
+        }
+        head_.store(head, std::memory_order_release);
+
+        if(out.size() >= SINK_SIZE)
+        {
+            sink_(out.data(), out.size());
+            out.clear();
+        }
+    }
+}
+
+
+TraceReader::TraceReader(const void* data, size_t size)
+        : p_{static_cast<const uint8_t*>(data)}, end_{p_ + size}, last_{}
+{
+    get_header(p_, end_, format);
+}
+
+bool TraceReader::next(TraceEvent& out)
+{
+    if(p_ == end_) return false;
+
+    //An event cut short ends the trace, as if recorded up to the one before
+    const uint8_t* p = p_;
+    const uint8_t tag = *p++;
+    TraceEvent event = last_;
+    if(tag & TAG_STATE)
+    {
+        if(tag != TAG_STATE) throw invalid(format);
+        if(!has(p, end_, sizeof(uint64_t) + 2 * sizeof(uint16_t) +
+                         sizeof(event.v)))
+        {
+            p_ = end_;
+            return false;
+        }
+        event.type = TraceEvent::STATE;
+        event.cycle = get<uint64_t>(p);
+        event.pc = get<uint16_t>(p);
+        event.i = get<uint16_t>(p);
+        std::memcpy(event.v, p, sizeof(event.v));
+        p += sizeof(event.v);
+        event.changed = 0;
+    }
+    else
+    {
+        uint64_t cycles = tag & TAG_CYCLES;
+        if(cycles == TAG_CYCLES)
+        {
+            uint64_t more;
+            if(!get_varint(p, end_, more, format)) { p_ = end_; return false; }
+            cycles += more;
+        }
+
+        const size_t size = ((tag & TAG_PC) ? 2 : 0) + 2 +
+            ((tag & TAG_VX) ? 1 : 0) + ((tag & TAG_VF) ? 1 : 0) +
+            ((tag & TAG_I) ? 2 : 0);
+        if(!has(p, end_, size)) { p_ = end_; return false; }
+
+        //last_.pc is that of the step after the previous one
+        event.type = TraceEvent::STEP;
+        event.cycle += cycles;
+        if(tag & TAG_PC) event.pc = get<uint16_t>(p);
+        event.opcode = get<uint16_t>(p);
+        event.changed = 0;
+        const unsigned int x = (event.opcode >> 8) & 0xF;
+        if(tag & TAG_VX) event.v[x] = *p++, event.changed |= 1U << x;
+        if(tag & TAG_VF) event.v[0xF] = *p++, event.changed |= 1U << 0xF;
+        if(tag & TAG_I)
+        {
+            event.i = get<uint16_t>(p);
+            event.changed |= TraceEvent::CHANGED_I;
+        }
+    }
+    p_ = p;
+
+    out = event;
+    last_ = event;
+    if(event.type == TraceEvent::STEP) last_.pc += BYTES_PER_OPCODE;
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef CHIP8_TRACE_H_OLIVECC
+#define CHIP8_TRACE_H_OLIVECC
+
+#include <atomic>       //std::atomic
+#include <cstddef>      //size_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
+#include <functional>   //std::function
+#include <memory>       //std::unique_ptr
+#include <thread>       //std::thread
+
+#include "chip8.h"
+
+namespace chip8
+{
+    //An event of a trace, as decoded by TraceReader
+    struct TraceEvent
+    {
+        enum Type : uint8_t
+        {
+            STATE,                  //Registers in full (e.g. on restore())
+            STEP                    //An instruction executed
+        };
+
+        Type type;
+        uint64_t cycle;             //Total cycles executed, counting a STEP's
+        uint16_t pc;                //Of the instruction; STATE: of the next
+        uint16_t opcode;            //STEP: its first two bytes
+
+        //Registers as last recorded, after the step: only Vx, VF and I are
+        //recorded after each step, so others written by it (e.g. V0 of
+        //F265) are as of the last STATE or step to record them
+        uint8_t v[0x10];
+        uint16_t i;
+        uint32_t changed;           //STEP: bit r for Vr, CHANGED_I for I
+        enum : uint32_t { CHANGED_I = 1U << 0x10 };
+    };
+
+    //Execution trace of a CPU, recorded while attached to it with
+    //CPU::set_tracer() in builds with CHIP8_TRACE defined (elsewhere nothing
+    //is recorded, and the run loop has no instrumentation).
+    //
+    //While attached, every instruction is interpreted (any engine or static
+    //program is bypassed, and no superinstructions are dispatched), and
+    //each is recorded into a ring by the thread running the CPU: a few
+    //stores per instruction. A thread of the Tracer's own encodes the ring
+    //as it fills, as deltas from the previous step (typically 3 to 5 bytes
+    //a step), and passes the bytes to the sink, so traces of any length
+    //stream through a fixed amount of memory. If the ring is full, the CPU
+    //waits for it, so nothing is lost.
+    class CPU::Tracer
+    {
+    public:
+        //Receives the encoded trace in order, on the Tracer's thread: e.g.
+        //appends it to a file. Must not throw.
+        using Sink = std::function<void(const uint8_t*, size_t)>;
+
+    private:
+        //Fields the CPU records: STATE is written as two Entries, the
+        //second holding V0 to VF
+        struct Entry
+        {
+            uint64_t cycle;
+            uint16_t pc;            //Or STATE_PC, with pc in opcode
+            uint16_t opcode;
+            uint16_t i;
+            uint8_t vx;
+            uint8_t vf;
+        };
+        static_assert(sizeof(Entry) == 0x10, "Entry holds V0 to VF");
+        enum : uint16_t { STATE_PC = 0xFFFF };  //Never fetched: past RAM's end
+
+        //Ring: written by the CPU's thread up to tail_, published to the
+        //writer every BLOCK entries (and on detach()), and read by the
+        //writer up to head_
+        enum : uint64_t { RING_SIZE = 1 << 16, BLOCK = 1 << 8 };
+        std::unique_ptr<Entry[]> ring_;
+        uint64_t tail_;
+        uint64_t room_;             //tail_ may advance to this unchecked
+        bool is_begun_;             //An Entry of tail_ awaits end()
+        alignas(64) std::atomic<uint64_t> published_;
+        alignas(64) std::atomic<uint64_t> head_;
+        std::atomic<bool> is_stopping_;
+
+        Sink sink_;
+        std::thread writer_;
+        CPU* cpu_;
+
+        friend class CPU;
+        void attach(CPU&);          //Or, after restore(), record its state
+        void detach();
+        void begin(uint16_t addr)
+        {
+            if(tail_ == room_) make_room();
+            Entry& entry = ring_[tail_ & (RING_SIZE - 1)];
+            entry.cycle = cpu_->scheduler_.cycle();
+            entry.pc = addr;
+            entry.opcode = (cpu_->peek(addr) << 8) | cpu_->peek(addr + 1);
+            is_begun_ = true;
+        }
+        void end()
+        {
+            Entry& entry = ring_[tail_ & (RING_SIZE - 1)];
+            entry.i = cpu_->i_;
+            entry.vx = cpu_->v_[(entry.opcode >> 8) & 0xF];
+            entry.vf = cpu_->v_[0xF];
+            is_begun_ = false;
+            if(!(++tail_ & (BLOCK - 1))) publish();
+        }
+        void make_room(unsigned int size = 1);  //Waits for the writer
+        void publish();
+        void write();               //The writer's thread
+
+    public:
+        explicit Tracer(Sink);
+        ~Tracer();                  //Detaches, and passes all to the sink
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+    };
+
+    //Decodes a trace in place (e.g. from a memory-mapped file), one event at
+    //a time. A trace truncated between events (e.g. its host was killed)
+    //ends early; malformed data is thrown as cpu_exception.
+    class TraceReader
+    {
+    private:
+        const uint8_t* p_;
+        const uint8_t* const end_;
+        TraceEvent last_;
+
+    public:
+        TraceReader(const void* data, size_t size);
+
+        bool next(TraceEvent&);     //False once the trace has ended
+    };
+}
+#endif //CHIP8_TRACE_H_OLIVECC
@@ -0,0 +1,453 @@
+#include "chip8.h"
+#include "emu_io.h"         //emu_io::load_rom_file only: no SDL required
+
+#include <algorithm>        //std::min, std::max
+#include <chrono>           //std::chrono::steady_clock, std::chrono::duration
+#include <cstdint>          //uint8_t, uint16_t, uint64_t
+#include <cstdio>           //std::printf, std::snprintf, std::sscanf
+#include <cstdlib>          //std::strtod, std::strtoul
+#include <cstring>          //std::strcmp, std::strstr, std::strrchr
+#include <functional>       //std::function
+#include <map>              //std::map
+#include <string>           //std::string
+#include <vector>           //std::vector
+
+//Benchmarks both engines, printing a JSON document to stdout with one result
+//per line (nanoseconds per emulated cycle, best of several repetitions):
+//  op/*      dispatch cost of each opcode handler, in a run of that opcode
+//  sprite/*  Dxyz throughput at several heights, with and without wrapping
+//  loop/*    synthetic tight loops
+//  debug/*   a tight loop stopping at a breakpoint or break condition, and
+//            resumed (or reset): breaks per thousand cycles must agree
+//            between engines
+//  rom/*     end-to-end throughput of ROMs named on the command line, with
+//            scripted key presses
+//
+//  bench [--engine interpreter|jit|both] [--filter TEXT] [--reps N]
+//        [--min-time SECONDS] [ROM...] > results.json
+//  bench --compare BASE.json NEW.json [--threshold PERCENT]
+//
+//--compare prints the change in each result common to both documents, and
+//exits with status 1 if any has slowed by more than the threshold (5%).
+namespace
+{
+    namespace C8 = chip8;
+    using Clock = std::chrono::steady_clock;
+
+    struct Benchmark
+    {
+        std::string name;
+        std::vector<uint8_t> program;
+        C8::Flags flags;
+        bool press_keys;    //Hold a changing key between frames
+        std::function<void(C8::CPU&)> debug;    //Sets breaks, if any
+        bool reset_on_break;                    //Else resumed
+    };
+
+    //Assembles a program: a preamble, then a loop of a body of opcodes
+    //(generated from their address) ending in a jump back, then a tail
+    class Assembler
+    {
+    private:
+        std::vector<uint8_t> bytes_;
+
+    public:
+        static constexpr unsigned int BODY_LENGTH = 0x300;
+
+        uint16_t here() const
+        {
+            return static_cast<uint16_t>(C8::PROGRAM_BEGIN + bytes_.size());
+        }
+
+        Assembler& op(uint16_t opcode)
+        {
+            bytes_.push_back(opcode >> 8);
+            bytes_.push_back(opcode & 0xFF);
+            return *this;
+        }
+
+        //body(address, end): end is the address of the jump back
+        Assembler& loop(std::function<uint16_t(uint16_t, uint16_t)> body)
+        {
+            const uint16_t begin = here();
+            const uint16_t end = begin + 2 * BODY_LENGTH;
+            while(here() < end) op(body(here(), end));
+            return op(0x1000 | begin);
+        }
+
+        std::vector<uint8_t> program() const { return bytes_; }
+    };
+
+    std::vector<Benchmark> builtin_benchmarks()
+    {
+        std::vector<Benchmark> benchmarks;
+        auto add = [&](const std::string& name, const Assembler& a,
+                       C8::Flags flags = C8::NO_FLAGS)
+        {
+            benchmarks.push_back({name, a.program(), flags, false, {}, false});
+        };
+        auto run_of = [](uint16_t opcode)
+        {
+            return [opcode](uint16_t, uint16_t) { return opcode; };
+        };
+        //Cycling through V0-VE, so that dependent operations don't chain
+        auto run_of_xy = [](uint16_t opcode)
+        {
+            return [opcode](uint16_t addr, uint16_t)
+            {
+                const unsigned int n = addr / 2;
+                return static_cast<uint16_t>(
+                    opcode | ((n % 15) << 8) | (((n + 1) % 15) << 4));
+            };
+        };
+
+        //Per-opcode dispatch: skips are not taken, except ExA1 (no key held)
+        //Consecutive 6xkk are fused by the interpreter, so are measured fused
+        add("op/00E0", Assembler().loop(run_of(0x00E0)));
+        add("op/1nnn", Assembler().loop(
+            [](uint16_t addr, uint16_t) { return 0x1000 | (addr + 2); }));
+        add("op/2nnn+00EE", Assembler().loop(
+            [](uint16_t, uint16_t end) { return 0x2000 | (end + 2); })
+            .op(0x00EE));
+        add("op/3xkk", Assembler().op(0x6000).loop(run_of(0x3001)));
+        add("op/4xkk", Assembler().op(0x6000).loop(run_of(0x4000)));
+        add("op/5xy0", Assembler().op(0x6101).loop(run_of(0x5010)));
+        add("op/6xkk", Assembler().loop(run_of_xy(0x6000)));
+        add("op/7xkk", Assembler().loop(run_of_xy(0x7001)));
+        const uint16_t alu[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+        for(uint16_t z : alu)
+        {
+            char name[16];
+            std::snprintf(name, sizeof(name), "op/8xy%X", z);
+            add(name, Assembler().loop(run_of_xy(0x8000 | z)));
+        }
+        add("op/9xy0", Assembler().op(0x6101).loop(run_of(0x9000)));
+        add("op/Annn", Assembler().loop(run_of(0xA300)));
+        add("op/Bnnn", Assembler().op(0x6000).loop(
+            [](uint16_t addr, uint16_t) { return 0xB000 | (addr + 2); }));
+        add("op/Cxkk", Assembler().loop(run_of_xy(0xC0FF)));
+        add("op/Ex9E", Assembler().op(0x6000).loop(run_of(0xE09E)));
+        add("op/ExA1", Assembler().op(0x6000).loop(run_of(0xE0A1)));
+        add("op/Fx07", Assembler().loop(run_of(0xF007)));
+        add("op/Fx15", Assembler().op(0x6000).loop(run_of(0xF015)));
+        add("op/Fx18", Assembler().op(0x6000).loop(run_of(0xF018)));
+        add("op/Fx1E", Assembler().op(0x6000).loop(run_of(0xF01E)));
+        add("op/Fx29", Assembler().loop(run_of(0xF029)));
+        add("op/Fx33", Assembler().op(0xAF00).loop(run_of(0xF033)));
+        add("op/Fx55", Assembler().op(0xAF00).loop(run_of(0xFF55)),
+            C8::NEW_FXU5);
+        add("op/Fx65", Assembler().op(0xAF00).loop(run_of(0xFF65)),
+            C8::NEW_FXU5);
+
+        //Sprites from the font and interpreter area, at (8, 4), or at (60, 30)
+        //to wrap horizontally (and vertically if taller than 2)
+        for(unsigned int z : {1, 4, 8, 15})
+        {
+            for(bool wrap : {false, true})
+            {
+                char name[32];
+                std::snprintf(name, sizeof(name), "sprite/D%u%s", z,
+                    wrap ? "/wrap" : "");
+                add(name, Assembler().op(0xA000)
+                    .op(wrap ? 0x603C : 0x6008).op(wrap ? 0x611E : 0x6104)
+                    .loop(run_of(0xD010 | z)));
+            }
+        }
+
+        //Busy-wait on the delay timer, as most games do to keep time
+        Assembler timer;
+        timer.op(0x603C)    //V0 := 60
+             .op(0xF015)    //DT := V0
+             .op(0xF107)    //V1 := DT
+             .op(0x3100)    //Skip if V1 == 0
+             .op(0x1204)    //Jump to V1 := DT
+             .op(0x1200);
+        add("loop/timer_wait", timer);
+
+        //Score display: BCD of a counter, read back and drawn
+        Assembler bcd;
+        bcd.op(0xAF00)      //I := F00
+           .op(0xF333)      //BCD V3
+           .op(0xF265)      //V0-V2 := digits
+           .op(0x7301)      //V3 += 1
+           .op(0xF029)      //I := font digit V0
+           .op(0xD455)      //Draw at (V4, V5)
+           .op(0x1200);
+        add("loop/bcd", bcd);
+
+        //Chain of calls 12 deep, each returning immediately after
+        const unsigned int depth = 12;
+        Assembler calls;
+        calls.op(0x2204).op(0x1200);
+        for(unsigned int d = 0; d < depth; ++d)
+        {
+            if(d + 1 < depth) calls.op(0x2000 | (calls.here() + 4));
+            calls.op(0x00EE);
+        }
+        add("loop/call_chain", calls);
+
+        //Arithmetic with a conditional branch
+        Assembler arith;
+        arith.op(0x6000).op(0x6100).op(0x6205)
+             .op(0x7001)    //V0 += 1
+             .op(0x8104)    //V1 += V0
+             .op(0x8215)    //V2 -= V1
+             .op(0x3000)    //Skip if V0 == 0
+             .op(0x1206)
+             .op(0x1200);
+        add("loop/arithmetic", arith);
+
+        //A counting loop the JIT iterates within a block, but for breaks
+        Assembler count;
+        count.op(0x7301)    //V3 += 1
+             .op(0x1200);
+        add("debug/breakpoint", count);
+        benchmarks.back().debug = [](C8::CPU& cpu)
+        {
+            cpu.set_breakpoint(C8::PROGRAM_BEGIN);
+        };
+        add("debug/condition", count);
+        benchmarks.back().debug = [](C8::CPU& cpu)
+        {
+            cpu.add_break_condition({0x3, C8::BreakCondition::EQUAL, 0x2A});
+        };
+
+        //Reset at each break, one instruction in: every cycle breaks, as
+        //each run after reset() breaks afresh
+        add("debug/reset", count);
+        benchmarks.back().debug = [](C8::CPU& cpu)
+        {
+            cpu.set_breakpoint(C8::PROGRAM_BEGIN + 2);
+        };
+        benchmarks.back().reset_on_break = true;
+
+        return benchmarks;
+    }
+
+    //Runs n cycles, in frames when keys are to be pressed, and resuming from
+    //each break, counted in breaks. Key presses keep programs awaiting input
+    //(Fx0A) from idling, though cycles while paused are still counted
+    uint64_t run(C8::CPU& cpu, const Benchmark& benchmark, unsigned long n,
+        unsigned long& frame, uint64_t& breaks)
+    {
+        if(!benchmark.press_keys && !benchmark.debug)
+            return cpu.run_cycles(n).cycles;
+
+        const unsigned int stop_on =
+            benchmark.press_keys ? C8::STOP_FRAME : C8::STOP_BREAK;
+        uint64_t executed = 0;
+        while(executed < n)
+        {
+            const C8::RunResult result = cpu.run_cycles(n - executed, stop_on);
+            executed += result.cycles;
+            if(result.reason & C8::STOP_BREAK)
+            {
+                ++breaks;
+                if(benchmark.reset_on_break) cpu.reset();
+            }
+            if(!(result.reason & C8::STOP_FRAME)) continue;
+
+            //Each key in turn, held for 4 frames then released for 4
+            const unsigned int key = (frame / 8) % 0x10;
+            cpu.pump_input(static_cast<C8::Keys>(key), (frame % 8) < 4);
+            ++frame;
+        }
+        return executed;
+    }
+
+    struct Measurement
+    {
+        uint64_t cycles;        //Per repetition
+        double ns_per_cycle;    //Best of all repetitions
+        double breaks_per_kcycle;
+    };
+
+    Measurement measure(const Benchmark& benchmark, C8::Engine engine,
+        unsigned int reps, double min_time)
+    {
+        C8::CPU cpu(benchmark.program.data(), benchmark.program.size(),
+                    benchmark.flags);
+        cpu.seed_rng(0);
+        cpu.set_engine(engine);
+        if(benchmark.debug) benchmark.debug(cpu);
+        unsigned long frame = 0;
+        uint64_t breaks = 0;
+        uint64_t total = 0;
+
+        auto timed = [&](unsigned long n, uint64_t& executed)
+        {
+            const Clock::time_point begin = Clock::now();
+            executed = run(cpu, benchmark, n, frame, breaks);
+            total += executed;
+            return std::chrono::duration<double>(Clock::now() - begin).count();
+        };
+
+        //Warm up (including recompilation), then size repetitions to last
+        //at least min_time
+        uint64_t executed;
+        unsigned long n = 1 << 12;
+        while(timed(n, executed) < min_time && n < (1UL << 40)) n *= 2;
+
+        Measurement m{executed, 1e300, 0};
+        for(unsigned int rep = 0; rep < reps; ++rep)
+        {
+            const double seconds = timed(n, executed);
+            m.ns_per_cycle = std::min(m.ns_per_cycle, 1e9 * seconds / executed);
+        }
+        m.breaks_per_kcycle = 1e3 * breaks / total;
+        return m;
+    }
+
+    const char* engine_name(C8::Engine engine)
+    {
+        return (engine == C8::Engine::JIT) ? "jit" : "interpreter";
+    }
+
+    //<name + ' ' + engine, ns per cycle>, from a document printed by bench
+    bool load_results(const char* path, std::map<std::string, double>& out)
+    {
+        std::FILE* file = std::fopen(path, "r");
+        if(!file) return false;
+
+        char line[512];
+        while(std::fgets(line, sizeof(line), file))
+        {
+            char name[128], engine[32];
+            unsigned long long cycles;
+            double ns;
+            if(std::sscanf(line, " {\"name\": \"%127[^\"]\", "
+                "\"engine\": \"%31[^\"]\", \"cycles\": %llu, "
+                "\"ns_per_cycle\": %lf", name, engine, &cycles, &ns) == 4)
+            {
+                out[std::string(name) + ' ' + engine] = ns;
+            }
+        }
+
+        std::fclose(file);
+        return true;
+    }
+
+    int compare(const char* base_path, const char* new_path, double threshold)
+    {
+        std::map<std::string, double> base, latest;
+        if(!load_results(base_path, base) || !load_results(new_path, latest))
+        {
+            std::fprintf(stderr, "cannot read results\n");
+            return 2;
+        }
+
+        unsigned int regressions = 0;
+        for(const auto& result : latest)
+        {
+            auto found = base.find(result.first);
+            if(found == base.end()) continue;
+
+            const double change =
+                100.0 * (result.second / found->second - 1.0);
+            const bool regressed = change > threshold;
+            regressions += regressed;
+            std::printf("%-40s %10.4f %10.4f %+8.2f%%%s\n",
+                result.first.c_str(), found->second, result.second, change,
+                regressed ? "  REGRESSION" :
+                    (change < -threshold ? "  improved" : ""));
+        }
+
+        std::printf("%u regression(s) beyond %.2f%%\n", regressions, threshold);
+        return regressions ? 1 : 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc >= 4 && !std::strcmp(argv[1], "--compare"))
+    {
+        double threshold = 5.0;
+        if(argc >= 6 && !std::strcmp(argv[4], "--threshold"))
+            threshold = std::strtod(argv[5], nullptr);
+        return compare(argv[2], argv[3], threshold);
+    }
+
+    std::vector<C8::Engine> engines =
+        {C8::Engine::INTERPRETER, C8::Engine::JIT};
+    const char* filter = "";
+    unsigned int reps = 5;
+    double min_time = 0.05;
+    std::vector<Benchmark> benchmarks = builtin_benchmarks();
+
+    for(int arg = 1; arg < argc; ++arg)
+    {
+        const char* option = argv[arg];
+        const char* value = (arg + 1 < argc) ? argv[arg + 1] : "";
+
+        if(!std::strcmp(option, "--engine"))
+        {
+            if(!std::strcmp(value, "interpreter"))
+                engines = {C8::Engine::INTERPRETER};
+            else if(!std::strcmp(value, "jit"))
+                engines = {C8::Engine::JIT};
+            else if(std::strcmp(value, "both"))
+            {
+                std::fprintf(stderr, "unknown engine: %s\n", value);
+                return 2;
+            }
+            ++arg;
+        }
+        else if(!std::strcmp(option, "--filter")) filter = value, ++arg;
+        else if(!std::strcmp(option, "--reps"))
+            reps = std::max(1UL, std::strtoul(value, nullptr, 0)), ++arg;
+        else if(!std::strcmp(option, "--min-time"))
+            min_time = std::strtod(value, nullptr), ++arg;
+        else
+        {
+            std::vector<uint8_t> program(C8::PROGRAM_SIZE);
+            try
+            {
+                program.resize(emu_io::load_rom_file(option, program.data(),
+                                                     program.size()));
+            }
+            catch(const emu_io::io_exception& e)
+            {
+                std::fprintf(stderr, "%s: %s\n", option, e.what());
+                return 2;
+            }
+            const char* base = std::strrchr(option, '/');
+            const std::string name = base ? base + 1 : option;
+            benchmarks.push_back({"rom/" + name, program, C8::NO_FLAGS, true,
+                                  {}, false});
+        }
+    }
+
+    std::printf("{\n  \"format\": \"chop8-bench-1\",\n  \"benchmarks\": [");
+    const char* separator = "\n";
+    for(const Benchmark& benchmark : benchmarks)
+    {
+        if(!std::strstr(benchmark.name.c_str(), filter)) continue;
+
+        for(C8::Engine engine : engines)
+        {
+            std::printf("%s    {\"name\": \"%s\", \"engine\": \"%s\", ",
+                separator, benchmark.name.c_str(), engine_name(engine));
+            separator = ",\n";
+            try
+            {
+                const Measurement m =
+                    measure(benchmark, engine, reps, min_time);
+                std::printf("\"cycles\": %llu, \"ns_per_cycle\": %.4f, "
+                    "\"mips\": %.2f",
+                    static_cast<unsigned long long>(m.cycles), m.ns_per_cycle,
+                    1e3 / m.ns_per_cycle);
+                if(benchmark.debug)
+                    std::printf(", \"breaks_per_kcycle\": %.2f",
+                                m.breaks_per_kcycle);
+                std::printf("}");
+            }
+            catch(const C8::cpu_exception& e)
+            {
+                std::printf("\"error\": \"%s\"}", e.what());
+            }
+            std::fflush(stdout);
+        }
+    }
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
@@ -1,8 +1,12 @@
-#include <cstdint>  //uint32_t
-#include <cstdlib>  //std::malloc
-#include <memory>   //std::unique_ptr, std::make_unique
+#include <algorithm>    //std::min, std::max, std::fill
+#include <atomic>       //std::atomic
+#include <cstdint>      //uint32_t, uint64_t
+#include <cstdlib>      //std::malloc
+#include <cstring>      //std::memcpy
+#include <memory>       //std::unique_ptr, std::make_unique
 
 #include "emu_io.h"
+#include "emu_thread.h"
 #include "SDL.h"
 
 using namespace emu_io;
@@ -15,33 +19,23 @@ namespace
     }
 }
 
-void emu_io::load_rom_file(const char* path, void* buffer, size_t max_size)
-{
-    const char* read_binary = "rb";
-    std::FILE* program_file = std::fopen(path, read_binary);
-
-    if(!program_file)
-    {
-        throw io_exception("ROM file not found");
-    }
-
-    std::fseek(program_file, 0, SEEK_END);
-    size_t file_size = std::ftell(program_file);
-    auto program_size = std::min(file_size, max_size);
-
-    std::fseek(program_file, 0, SEEK_SET);
-    std::fread(buffer, 1, program_size, program_file);
-
-    std::fclose(program_file);
-}
-
 class IO::IO_impl
 {
 private:
     static constexpr unsigned int sample_rate = 44100;
+    static constexpr unsigned int tone_period = 92;     //Samples (~479 Hz)
+    static constexpr size_t max_queued = 16384;         //Samples (~0.37 s)
     const Uint8* kb_state_;
-    float audio_off[sample_rate / 60] = { 0 };
-    float audio_on [sample_rate / 60];
+
+    //Written by the producer of samples (see IO::queue_tone), read by the
+    //audio callback on SDL's audio thread
+    SpscQueue<float, max_queued> samples_;
+    std::atomic<size_t> latency_;                       //Samples
+    std::atomic<unsigned long> underruns_;
+    std::atomic<unsigned long> overruns_;
+    size_t min_latency_;                                //Device's buffer
+    unsigned int phase_ = 0;                            //Producer's
+    bool is_playing_ = false;                           //Callback's
 
     SDL_Window* window_;
     SDL_Renderer* renderer_;
@@ -50,12 +44,34 @@ private:
     uint32_t* canvas_;
     const unsigned int width_;
     const unsigned int height_;
-    bool is_audible = false;
+
+    static void SDLCALL audio_callback(void* impl, Uint8* stream, int len)
+    {
+        static_cast<IO_impl*>(impl)->play(reinterpret_cast<float*>(stream), 
+            static_cast<size_t>(len) / sizeof(float));
+    }
+
+    //Playback (re)starts once the latency target is queued, so the queue
+    //holds that much whenever the device takes samples from it
+    void play(float* out, size_t n)
+    {
+        if(!is_playing_ && samples_.size() >= latency_.load()) 
+            is_playing_ = true;
+
+        const size_t played = is_playing_ ? samples_.pop(out, n) : 0;
+        if(is_playing_ && played < n)
+        {
+            underruns_.fetch_add(1, std::memory_order_relaxed);
+            is_playing_ = false;
+        }
+        std::fill(out + played, out + n, 0.0f);
+    }
 
 public:
     IO_impl(const char* title, 
         unsigned int width, unsigned int height) 
-        : width_{width}, height_{height}, kb_state_{SDL_GetKeyboardState(NULL)}
+        : width_{width}, height_{height}, kb_state_{SDL_GetKeyboardState(NULL)},
+          latency_{0}, underruns_{0}, overruns_{0}
     {
         SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS);
 
@@ -86,26 +102,25 @@ public:
         if(canvas_ == nullptr) io_fail_init();
 
         SDL_AudioSpec audio_spec{};
-        SDL_AudioSpec dummy;
+        SDL_AudioSpec obtained;
         audio_spec.freq = sample_rate;
         audio_spec.format = AUDIO_F32;
         audio_spec.channels = 1;
-        audio_spec.samples = 2048;
-        audio_spec.callback = NULL;
+        audio_spec.samples = 512;
+        audio_spec.callback = audio_callback;
+        audio_spec.userdata = this;
         
-        audio_device_ = SDL_OpenAudioDevice(NULL, 0, &audio_spec, &dummy, 
+        audio_device_ = SDL_OpenAudioDevice(NULL, 0, &audio_spec, &obtained, 
             NO_FLAGS);
         if(audio_device_ == 0) io_fail_init();
+        min_latency_ = std::min<size_t>(obtained.samples, max_queued / 2);
+        set_audio_latency(0.05);
         SDL_PauseAudioDevice(audio_device_, 0);
-
-        for(unsigned int i = 0; i < sample_rate / 60; ++i)
-        {
-            audio_on[i] = (((i / 46) % 2 == 0) ? 1 : -1);
-        }
     }
 
     ~IO_impl()
     {
+        SDL_CloseAudioDevice(audio_device_);
         SDL_DestroyTexture(texture_);
         SDL_DestroyRenderer(renderer_);
         SDL_DestroyWindow(window_);
@@ -114,21 +129,100 @@ public:
     }
 
     IO_impl& render(const uint32_t* buffer)
+    {
+        return render(buffer, ~uint64_t{0});
+    }
+
+    IO_impl& render(const uint32_t* buffer, uint64_t rows)
     {
         static_assert(sizeof(Uint32) == sizeof(uint32_t));
 
-        SDL_UpdateTexture(texture_, NULL, buffer, width_ * sizeof(Uint32)); 
-        SDL_RenderClear(renderer_);
-        SDL_RenderCopy(renderer_, texture_, NULL, NULL);
-        SDL_RenderPresent(renderer_);
+        if(height_ > 64) rows = ~uint64_t{0};
+        if(height_ < 64) rows &= (uint64_t{1} << height_) - 1;
 
-        float (&audio_buf)[sample_rate / 60] = (is_audible ? audio_on : audio_off);
-        SDL_QueueAudio(audio_device_, audio_buf, sizeof(audio_buf));
+        //Each run of changed rows is locked and written in full, as locked
+        //pixels needn't hold the texture's contents
+        bool changed = false;
+        for(unsigned int y = 0; y < height_; )
+        {
+            if(!((rows >> y) & 0x1)) { ++y; continue; }
+
+            unsigned int end = y + 1;
+            while(end < height_ && ((rows >> end) & 0x1)) ++end;
+
+            SDL_Rect run {0, static_cast<int>(y), 
+                static_cast<int>(width_), static_cast<int>(end - y)};
+            void* pixels;
+            int pitch;
+            if(SDL_LockTexture(texture_, &run, &pixels, &pitch) == 0)
+            {
+                for(unsigned int r = y; r < end; ++r)
+                {
+                    std::memcpy(static_cast<uint8_t*>(pixels) + 
+                        (r - y) * pitch, buffer + r * width_, 
+                        width_ * sizeof(Uint32));
+                }
+                SDL_UnlockTexture(texture_);
+            }
+            changed = true;
+            y = end;
+        }
+
+        if(changed)
+        {
+            SDL_RenderClear(renderer_);
+            SDL_RenderCopy(renderer_, texture_, NULL, NULL);
+            SDL_RenderPresent(renderer_);
+        }
 
         return *this;
     }
 
-    IO_impl& set_audible(bool val) { is_audible = val; return *this; }
+    unsigned int get_sample_rate() const { return sample_rate; }
+
+    IO_impl& set_audio_latency(double seconds)
+    {
+        const double samples = std::max(seconds, 0.0) * sample_rate;
+        latency_.store(std::max(min_latency_, static_cast<size_t>(
+            std::min<double>(samples, max_queued / 2))));
+        return *this;
+    }
+
+    //Samples beyond twice the latency target are dropped, so a producer 
+    //running faster than the device delays audio by no more than that
+    IO_impl& queue_tone(bool is_audible, size_t n)
+    {
+        const size_t limit = 2 * latency_.load();
+        const size_t queued = samples_.size();
+        const size_t room = (limit > queued) ? limit - queued : 0;
+        if(n > room)
+        {
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+            n = room;
+        }
+
+        float chunk[256];
+        while(n > 0)
+        {
+            const size_t size = std::min(n, sizeof(chunk) / sizeof(float));
+            for(size_t i = 0; i < size; ++i)
+            {
+                chunk[i] = (is_audible ? 
+                    ((phase_ < tone_period / 2) ? 1.0f : -1.0f) : 0.0f);
+                phase_ = (phase_ + 1) % tone_period;
+            }
+            samples_.push(chunk, size);
+            n -= size;
+        }
+
+        return *this;
+    }
+
+    AudioStats audio_stats() const
+    {
+        return {underruns_.load(std::memory_order_relaxed), 
+                overruns_.load(std::memory_order_relaxed)};
+    }
 
     template<typename T, typename F>
     IO_impl& render(const T* buffer, F to_argb)
@@ -149,6 +243,17 @@ public:
         //Note that emu_io::Keys values are directly derived from SDL_Scancode
         return kb_state_[static_cast<SDL_Scancode>(key)]; 
     }
+
+    uint16_t key_mask(const Keys (&keys)[16])
+    {
+        uint16_t mask = 0;
+        for(unsigned int k = 0; k < 16; ++k)
+        {
+            if(kb_state_[static_cast<SDL_Scancode>(keys[k])]) 
+                mask |= 1 << k;
+        }
+        return mask;
+    }
 };
 
 
@@ -164,12 +269,34 @@ IO& IO::render(const uint32_t* buffer)
     return *this;
 }
 
-IO& IO::set_audible(bool val)
+IO& IO::render(const uint32_t* buffer, uint64_t rows)
 {
-    pImpl_->set_audible(val);
+    pImpl_->render(buffer, rows);
     return *this;
 }
 
+unsigned int IO::get_sample_rate() const
+{
+    return pImpl_->get_sample_rate();
+}
+
+IO& IO::set_audio_latency(double seconds)
+{
+    pImpl_->set_audio_latency(seconds);
+    return *this;
+}
+
+IO& IO::queue_tone(bool is_audible, size_t samples)
+{
+    pImpl_->queue_tone(is_audible, samples);
+    return *this;
+}
+
+AudioStats IO::audio_stats() const
+{
+    return pImpl_->audio_stats();
+}
+
 IO& IO::update_input()
 {
     pImpl_->update_input();
@@ -180,3 +307,8 @@ bool IO::is_key_held(Keys key)
 {
     return pImpl_->is_key_held(key);
 }
+
+uint16_t IO::key_mask(const Keys (&keys)[16])
+{
+    return pImpl_->key_mask(keys);
+}
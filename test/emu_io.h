@@ -2,10 +2,17 @@
 #define EMU_IO_H_OLIVECC
 
 #include <algorithm>    //std::max
-#include <cstdint>      //uint32_t
+#include <cstdint>      //uint8_t, uint16_t, uint32_t, uint64_t
 #include <cstdio>       //std::fopen, std::fclose, std::fread
 #include <memory>       //std::unique_ptr
 #include <stdexcept>    //std::runtime_error
+#include <string>       //std::string
+#include <vector>       //std::vector
+
+namespace chip8
+{
+    enum Flags : unsigned int;  //chip8.h
+}
 
 namespace emu_io
 {
@@ -248,7 +255,94 @@ namespace emu_io
         ~io_exception() = default;
     };
 
-    void load_rom_file(const char* path, void* buffer, size_t max_size);
+    //Read a ROM into buffer, returning its size: throws if it can't be read
+    //in full, or exceeds max_size
+    size_t load_rom_file(const char* path, void* buffer, size_t max_size);
+
+    //Flags given on a command line: a number (bitwise OR of chip8::Flags), 
+    //or a comma-separated list of names, e.g. "new_8xyu,new_fxu5". False if
+    //invalid.
+    bool parse_flags(const char* s, chip8::Flags& out);
+    std::string flag_names();   //Those accepted, comma-separated, for usage
+
+    //Contents of a file, read-only: memory-mapped where supported (POSIX), 
+    //so large files are paged in as they are read, else read in full
+    class MappedFile
+    {
+    private:
+        const uint8_t* data_;
+        size_t size_;
+        std::vector<uint8_t> buffer_;   //Iff not mapped
+
+    public:
+        //How the mapping will be read, advised to the kernel
+        enum class Access : unsigned int
+        {
+            SEQUENTIAL,     //Front to back: read ahead, and drop behind
+            ANY             //E.g. lookups: pages kept, read ahead as usual
+        };
+
+        explicit MappedFile(const char* path,
+                            Access access = Access::SEQUENTIAL);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+    };
+
+    //Many ROMs in one file, memory-mapped once (e.g. a corpus for regression
+    //runs, rather than a file per ROM): a header, an index of the ROMs 
+    //sorted by content hash, then their bytes, contiguously. Entries are 
+    //read from the mapping as they are accessed. Immutable once opened, so 
+    //may be shared by any quantity of threads.
+    //
+    //Little-endian: "CHOP8PAK", uint32 version, uint32 quantity of ROMs, then
+    //per ROM, uint64 hash, uint64 offset (of its bytes, from the start of 
+    //the file), uint32 length, uint32 flags.
+    class RomPack
+    {
+    public:
+        struct Entry
+        {
+            uint64_t hash;          //As given to write_rom_pack()
+            uint32_t length;        //Bytes
+            uint32_t flags;         //Recommended, e.g. chip8::Flags
+            const uint8_t* data;    //Within the mapping
+        };
+
+    private:
+        MappedFile file_;
+        size_t size_;
+
+    public:
+        explicit RomPack(const char* path);
+        RomPack(const RomPack&) = delete;
+        RomPack& operator=(const RomPack&) = delete;
+
+        size_t size() const { return size_; }
+        Entry operator[](size_t index) const;   //In order of hash
+        //Binary search of the index: false if no ROM has hash
+        bool find(uint64_t hash, Entry&) const;
+    };
+
+    struct PackedRom
+    {
+        uint64_t hash;              //Of its content, e.g. chip8::program_hash()
+        uint32_t flags;
+        std::vector<uint8_t> bytes;
+    };
+
+    //Write roms as a RomPack: ROMs sharing a hash are stored once (as the
+    //first of them)
+    void write_rom_pack(const char* path, std::vector<PackedRom> roms);
+
+    struct AudioStats
+    {
+        unsigned long underruns;    //Times the device found too few samples
+        unsigned long overruns;     //Times samples were dropped
+    };
 
     //Simple class managing video, input, sound
     class IO
@@ -268,12 +362,26 @@ namespace emu_io
         }
 
         IO& render(const uint32_t* buffer);
+        //Upload only the rows in mask rows (bit y for row y; all rows if the
+        //height exceeds 64), nothing if none
+        IO& render(const uint32_t* buffer, uint64_t rows);
 
-        IO& set_audible(bool);
+        //Sound is a square-wave tone, queued as runs of samples with it on
+        //or off (at get_sample_rate()) at the pace they are emulated, e.g. 
+        //from a thread besides the one rendering (but only one). They are 
+        //played with the latency set, after which further samples queued 
+        //are dropped; if they run out, silence is played until the latency
+        //set is queued again.
+        unsigned int get_sample_rate() const;
+        IO& set_audio_latency(double seconds);  //Default 0.05 s
+        IO& queue_tone(bool is_audible, size_t samples);
+        AudioStats audio_stats() const;
 
         IO& update_input(void);
 
         bool is_key_held(Keys key);
+        //Bit k set iff keys[k] held: one call for a whole keypad
+        uint16_t key_mask(const Keys (&keys)[16]);
     };
 }
 #endif //EMU_IO_H_OLIVECC
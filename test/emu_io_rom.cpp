@@ -0,0 +1,292 @@
+#include <algorithm>    //std::stable_sort, std::unique
+#include <cstdio>       //std::fopen, std::fseek, std::ftell, std::fread, 
+                        //std::fwrite, std::fgetc, std::ferror, std::fclose
+#include <cstdint>      //uint8_t, uint32_t, uint64_t, UINT32_MAX
+#include <cstdlib>      //std::strtoull
+#include <cstring>      //std::memcmp, std::strchr
+#include <string>       //std::string
+
+#include "chip8.h"      //chip8::Flags
+#include "emu_io.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>      //open, O_RDONLY
+#include <sys/mman.h>   //mmap, munmap, madvise
+#include <sys/stat.h>   //fstat
+#include <unistd.h>     //close
+#define EMU_IO_MMAP
+#endif
+
+//Kept apart from emu_io.cpp, so that drivers without IO needn't link SDL
+
+using namespace emu_io;
+
+size_t emu_io::load_rom_file(const char* path, void* buffer, size_t max_size)
+{
+    const char* read_binary = "rb";
+    std::FILE* program_file = std::fopen(path, read_binary);
+
+    if(!program_file)
+    {
+        throw io_exception("ROM file not found");
+    }
+
+    //Read to the end, rather than to a size found by seeking, so a ROM 
+    //filling buffer exactly is told apart from one too large
+    const size_t program_size = std::fread(buffer, 1, max_size, program_file);
+    const bool is_larger = (program_size == max_size) &&
+                           (std::fgetc(program_file) != EOF);
+    const bool is_error = std::ferror(program_file);
+    std::fclose(program_file);
+
+    if(is_error)
+    {
+        throw io_exception("ROM file can't be read");
+    }
+    if(is_larger)
+    {
+        throw io_exception("ROM file is too large");
+    }
+
+    return program_size;
+}
+
+namespace
+{
+    struct FlagName
+    {
+        const char* name;
+        chip8::Flags flag;
+    };
+    const FlagName flag_table[] = {
+        {"key_up_fx0a",     chip8::KEY_UP_FX0A},
+        {"old_press_fx0a",  chip8::OLD_PRESS_FX0A},
+        {"new_8xyu",        chip8::NEW_8XYU},
+        {"new_fxu5",        chip8::NEW_FXU5}
+    };
+}
+
+bool emu_io::parse_flags(const char* s, chip8::Flags& out)
+{
+    char* end;
+    const unsigned long long number = std::strtoull(s, &end, 0);
+    if(*s != '\0' && *end == '\0')
+    {
+        out = static_cast<chip8::Flags>(number);
+        return true;
+    }
+
+    unsigned int flags = chip8::NO_FLAGS;
+    while(*s)
+    {
+        const char* comma = std::strchr(s, ',');
+        const std::string name =
+            comma ? std::string(s, comma - s) : std::string(s);
+        const FlagName* found = nullptr;
+        for(const FlagName& entry : flag_table)
+        {
+            if(name == entry.name) found = &entry;
+        }
+        if(!found) return false;
+        flags |= found->flag;
+        s = comma ? comma + 1 : s + name.size();
+    }
+    out = static_cast<chip8::Flags>(flags);
+    return true;
+}
+
+std::string emu_io::flag_names()
+{
+    std::string names;
+    for(const FlagName& entry : flag_table)
+    {
+        if(!names.empty()) names += ", ";
+        names += entry.name;
+    }
+    return names;
+}
+
+MappedFile::MappedFile(const char* path, Access access)
+    : data_{}, size_{}
+{
+#ifdef EMU_IO_MMAP
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0) throw io_exception("File not found");
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw io_exception("File can't be read");
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    if(size_ > 0)
+    {
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED)
+        {
+            close(fd);
+            throw io_exception("File can't be mapped");
+        }
+        madvise(mapped, size_, (access == Access::SEQUENTIAL)
+                               ? MADV_SEQUENTIAL : MADV_NORMAL);
+        data_ = static_cast<const uint8_t*>(mapped);
+    }
+    close(fd);
+#else
+    static_cast<void>(access);      //Read in full
+    std::FILE* file = std::fopen(path, "rb");
+    if(!file) throw io_exception("File not found");
+
+    std::fseek(file, 0, SEEK_END);
+    buffer_.resize(std::ftell(file));
+    std::fseek(file, 0, SEEK_SET);
+    size_ = std::fread(buffer_.data(), 1, buffer_.size(), file);
+    std::fclose(file);
+
+    data_ = buffer_.data();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef EMU_IO_MMAP
+    if(data_) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+namespace
+{
+    constexpr char pack_magic[8] = {'C', 'H', 'O', 'P', '8', 'P', 'A', 'K'};
+    constexpr uint32_t pack_version = 1;
+    constexpr size_t pack_header_size = 16;
+    constexpr size_t pack_entry_size = 24;
+
+    uint64_t get_le(const uint8_t* p, unsigned int bytes)
+    {
+        uint64_t value = 0;
+        for(unsigned int b = bytes; b-- > 0; ) value = (value << 8) | p[b];
+        return value;
+    }
+
+    void put_le(std::vector<uint8_t>& out, uint64_t value, unsigned int bytes)
+    {
+        for(unsigned int b = 0; b < bytes; ++b) out.push_back(value >> (8 * b));
+    }
+}
+
+RomPack::RomPack(const char* path)
+    : file_{path, MappedFile::Access::ANY}, size_{}
+{
+    const uint8_t* data = file_.data();
+    const size_t file_size = file_.size();
+
+    if(file_size < pack_header_size || 
+       std::memcmp(data, pack_magic, sizeof(pack_magic)))
+    {
+        throw io_exception("Not a ROM pack");
+    }
+    if(get_le(data + 8, 4) != pack_version)
+    {
+        throw io_exception("ROM pack version unsupported");
+    }
+    const uint64_t size = get_le(data + 12, 4);
+    if(size > (file_size - pack_header_size) / pack_entry_size)
+    {
+        throw io_exception("ROM pack index truncated");
+    }
+    size_ = static_cast<size_t>(size);
+
+    //Checked once here, so entries needn't be as they are accessed
+    for(size_t index = 0; index < size_; ++index)
+    {
+        const uint8_t* entry = data + pack_header_size + 
+                               index * pack_entry_size;
+        const uint64_t offset = get_le(entry + 8, 8);
+        const uint64_t length = get_le(entry + 16, 4);
+        if(offset > file_size || length > file_size - offset)
+        {
+            throw io_exception("ROM pack entry out of bounds");
+        }
+        if(index > 0 && get_le(entry, 8) <= get_le(entry - pack_entry_size, 8))
+        {
+            throw io_exception("ROM pack index unsorted");
+        }
+    }
+}
+
+RomPack::Entry RomPack::operator[](size_t index) const
+{
+    const uint8_t* entry = file_.data() + pack_header_size + 
+                           index * pack_entry_size;
+    return {get_le(entry, 8), static_cast<uint32_t>(get_le(entry + 16, 4)),
+            static_cast<uint32_t>(get_le(entry + 20, 4)),
+            file_.data() + get_le(entry + 8, 8)};
+}
+
+bool RomPack::find(uint64_t hash, Entry& out) const
+{
+    const uint8_t* index = file_.data() + pack_header_size;
+    size_t low = 0;
+    size_t high = size_;
+    while(low < high)
+    {
+        const size_t middle = low + (high - low) / 2;
+        if(get_le(index + middle * pack_entry_size, 8) < hash) low = middle + 1;
+        else high = middle;
+    }
+
+    if(low == size_ || get_le(index + low * pack_entry_size, 8) != hash)
+        return false;
+    out = (*this)[low];
+    return true;
+}
+
+void emu_io::write_rom_pack(const char* path, std::vector<PackedRom> roms)
+{
+    auto by_hash = [](const PackedRom& a, const PackedRom& b)
+        { return a.hash < b.hash; };
+    auto same_hash = [](const PackedRom& a, const PackedRom& b)
+        { return a.hash == b.hash; };
+    std::stable_sort(roms.begin(), roms.end(), by_hash);
+    roms.erase(std::unique(roms.begin(), roms.end(), same_hash), roms.end());
+    if(roms.size() > UINT32_MAX)
+    {
+        throw io_exception("Too many ROMs for a pack");
+    }
+
+    std::vector<uint8_t> head(pack_magic, pack_magic + sizeof(pack_magic));
+    put_le(head, pack_version, 4);
+    put_le(head, roms.size(), 4);
+    uint64_t offset = pack_header_size + roms.size() * pack_entry_size;
+    for(const PackedRom& rom : roms)
+    {
+        if(rom.bytes.size() > UINT32_MAX)
+        {
+            throw io_exception("ROM too large for a pack");
+        }
+        put_le(head, rom.hash, 8);
+        put_le(head, offset, 8);
+        put_le(head, rom.bytes.size(), 4);
+        put_le(head, rom.flags, 4);
+        offset += rom.bytes.size();
+    }
+
+    std::FILE* file = std::fopen(path, "wb");
+    if(!file)
+    {
+        throw io_exception("ROM pack can't be created");
+    }
+    bool ok = std::fwrite(head.data(), 1, head.size(), file) == head.size();
+    for(const PackedRom& rom : roms)
+    {
+        ok = ok && std::fwrite(rom.bytes.data(), 1, rom.bytes.size(), file)
+                   == rom.bytes.size();
+    }
+    ok = (std::fclose(file) == 0) && ok;
+    if(!ok)
+    {
+        throw io_exception("ROM pack can't be written");
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef EMU_THREAD_H_OLIVECC
+#define EMU_THREAD_H_OLIVECC
+
+#include <algorithm>    //std::min
+#include <atomic>       //std::atomic, std::memory_order_*
+#include <cstddef>      //size_t
+
+//Lock-free handoff between a front-end's emulation and render threads
+namespace emu_io
+{
+    //Latest value from one writer to one reader, neither ever waiting: the
+    //writer fills back() and publishes it, the reader takes the most recent
+    //published value into front(). Values published but not taken are
+    //replaced, so a slow reader skips them.
+    template<typename T>
+    class TripleBuffer
+    {
+    private:
+        static constexpr unsigned int INDEX = 0x3;
+        static constexpr unsigned int FRESH = 0x4;  //Published, not taken
+
+        T buffers_[3];
+        unsigned int back_;                         //Writer's
+        alignas(64) std::atomic<unsigned int> middle_;
+        alignas(64) unsigned int front_;            //Reader's
+
+    public:
+        TripleBuffer() : buffers_{}, back_{0}, middle_{1}, front_{2} {}
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+        //Writer
+        T& back() { return buffers_[back_]; }
+        void publish()
+        {
+            back_ = INDEX & middle_.exchange(back_ | FRESH,
+                                             std::memory_order_acq_rel);
+        }
+
+        //Reader: true iff a value was published since the last take()
+        bool take()
+        {
+            if(!(middle_.load(std::memory_order_relaxed) & FRESH))
+                return false;
+            front_ = INDEX & middle_.exchange(front_,
+                                              std::memory_order_acq_rel);
+            return true;
+        }
+        const T& front() const { return buffers_[front_]; }
+    };
+
+    //Bounded first-in first-out queue from one writer to one reader
+    template<typename T, size_t N>
+    class SpscQueue
+    {
+    private:
+        static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+        T items_[N];
+        alignas(64) std::atomic<size_t> head_;      //Next to pop
+        alignas(64) std::atomic<size_t> tail_;      //Next to push
+
+    public:
+        SpscQueue() : items_{}, head_{0}, tail_{0} {}
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        //False iff full
+        bool push(const T& item)
+        {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if(tail - head_.load(std::memory_order_acquire) == N)
+                return false;
+            items_[tail & (N - 1)] = item;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        //False iff empty
+        bool pop(T& item)
+        {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if(head == tail_.load(std::memory_order_acquire)) return false;
+            item = items_[head & (N - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        //Bulk: as many of n items as fit (or are queued), returning how many
+        size_t push(const T* items, size_t n)
+        {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            n = std::min(n, N - (tail - head_.load(std::memory_order_acquire)));
+            for(size_t i = 0; i < n; ++i)
+                items_[(tail + i) & (N - 1)] = items[i];
+            tail_.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        size_t pop(T* items, size_t n)
+        {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            n = std::min(n, tail_.load(std::memory_order_acquire) - head);
+            for(size_t i = 0; i < n; ++i)
+                items[i] = items_[(head + i) & (N - 1)];
+            head_.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        //Items queued: exact on either side of the queue, besides items the
+        //other is concurrently pushing or popping
+        size_t size() const
+        {
+            return tail_.load(std::memory_order_acquire) - 
+                   head_.load(std::memory_order_acquire);
+        }
+    };
+}
+#endif //EMU_THREAD_H_OLIVECC
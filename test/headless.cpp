@@ -0,0 +1,480 @@
+#include "chip8.h"
+#include "chip8_farm.h"     //chip8::Farm (--pack PACK all)
+#include "chip8_movie.h"    //chip8::display_hash
+#include "chip8_profile.h"  //chip8::CPU::Profiler (--profile)
+#include "chip8_trace.h"    //chip8::CPU::Tracer (--trace)
+#include "emu_io.h"         //emu_io::load_rom_file, RomPack, ...: no SDL required
+
+#include <algorithm>        //std::min, std::sort
+#include <cctype>           //std::isxdigit
+#include <cinttypes>        //PRIu64, PRIx64
+#include <cstdint>          //uint8_t, uint16_t, uint64_t
+#include <cstdio>           //std::printf, std::fprintf, std::fopen, ...
+#include <cstdlib>          //std::strtoull, std::strtoul
+#include <cstring>          //std::strcmp, std::strncmp, std::strchr, ...
+#include <map>              //std::map
+#include <memory>           //std::shared_ptr, std::unique_ptr, std::make_*
+#include <string>           //std::string
+#include <utility>          //std::pair
+#include <vector>           //std::vector
+
+//Runs a ROM headlessly, as fast as the host allows, printing hashes of the
+//display and the final state. Input is read from a script of lines
+//"<frame> <keys>", holding the keys in the hexadecimal mask <keys> (bit k for
+//key k) from that frame onwards, or "@<cycle> <keys>", from that cycle 
+//onwards ('#' begins a comment). ROMs may instead be taken from a ROM pack
+//(see emu_io::RomPack), by hash, or all of them at once, run on a Farm.
+namespace
+{
+    namespace C8 = chip8;
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: headless ROM [--frames N | --cycles N] [--flags F]\n"
+            "                    [--seed S] [--clock HZ] [--input FILE]\n"
+            "                    [--hash-every N] [--jit] [--pack PACK]\n"
+            "                    [--profile FILE] [--trace FILE]\n"
+            "                    [--break ADDR] [--watch ADDR[+SIZE]]\n"
+            "                    [--break-if COND]\n"
+            "  F: bitwise OR of chip8::Flags, or a comma-separated list of\n"
+            "     %s\n"
+            "  N defaults to 600 frames; --hash-every counts frames\n"
+            "  With --pack, ROM is the hash of a ROM in PACK, run with its\n"
+            "  recommended flags unless F is given; or 'all', running every\n"
+            "  ROM in PACK across all cores (by frames, with input by frame\n"
+            "  only) and printing a line per ROM\n"
+            "  --profile (builds with CHIP8_PROFILE only) writes cycles per\n"
+            "  call stack to FILE for flame graph tools, and the hottest\n"
+            "  opcode families, handlers and addresses to stderr\n"
+            "  --trace (builds with CHIP8_TRACE only) records every\n"
+            "  instruction executed to FILE, as read by the trace tool\n"
+            "  --break, --watch and --break-if (each repeatable) print the\n"
+            "  state wherever the run breaks, and continue: COND compares a\n"
+            "  register with ==, !=, < or >, e.g. v3==0x2A or i>0x300\n",
+            emu_io::flag_names().c_str());
+    }
+
+    bool parse_number(const char* s, unsigned long long& out)
+    {
+        char* end;
+        out = std::strtoull(s, &end, 0);
+        return *s != '\0' && *end == '\0';
+    }
+
+    //"<address>[+<size>]", within RAM
+    bool parse_watch(const char* s, std::pair<uint16_t, uint16_t>& out)
+    {
+        const char* plus = std::strchr(s, '+');
+        unsigned long long addr, size = 1;
+        if(!parse_number(plus ? std::string(s, plus - s).c_str() : s, addr) ||
+           (plus && !parse_number(plus + 1, size)) ||
+           size == 0 || addr + size > C8::RAM_SIZE)
+        {
+            return false;
+        }
+        out = {static_cast<uint16_t>(addr), static_cast<uint16_t>(size)};
+        return true;
+    }
+
+    //"v<x><comparison><value>" or "i<comparison><value>"
+    bool parse_condition(const char* s, C8::BreakCondition& out)
+    {
+        if((*s == 'v' || *s == 'V') && std::isxdigit(s[1]))
+        {
+            const char digit[2] = {s[1], '\0'};
+            out.reg = std::strtoul(digit, nullptr, 16);
+            s += 2;
+        }
+        else if(*s == 'i' || *s == 'I')
+        {
+            out.reg = C8::BreakCondition::REG_I;
+            s += 1;
+        }
+        else return false;
+
+        const std::pair<const char*, C8::BreakCondition::Compare> compares[] {
+            {"==",  C8::BreakCondition::EQUAL},
+            {"!=",  C8::BreakCondition::NOT_EQUAL},
+            {"<",   C8::BreakCondition::LESS},
+            {">",   C8::BreakCondition::GREATER}
+        };
+        for(const auto& compare : compares)
+        {
+            const size_t length = std::strlen(compare.first);
+            unsigned long long value;
+            if(!std::strncmp(s, compare.first, length) &&
+               parse_number(s + length, value) && value <= 0xFFFF)
+            {
+                out.compare = compare.second;
+                out.value = static_cast<uint16_t>(value);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //<first frame or cycle, keys held>
+    bool load_script(const char* path, std::map<uint64_t, uint16_t>& script,
+                     std::map<uint64_t, uint16_t>& cycle_script)
+    {
+        std::FILE* file = std::fopen(path, "r");
+        if(!file) return false;
+
+        char line[256];
+        bool ok = true;
+        while(ok && std::fgets(line, sizeof(line), file))
+        {
+            if(char* comment = std::strchr(line, '#')) *comment = '\0';
+
+            unsigned long long at;
+            unsigned int keys;
+            const bool is_cycle = 
+                std::sscanf(line, " @%llu %x", &at, &keys) == 2;
+            const int read = is_cycle ? 2 : 
+                std::sscanf(line, "%llu %x", &at, &keys);
+            if(read == 2 && keys <= 0xFFFF)
+                (is_cycle ? cycle_script : script)[at] = keys;
+            else if(read != EOF) ok = false;
+        }
+
+        std::fclose(file);
+        return ok;
+    }
+
+    //Every ROM in a pack, as a Farm job: its bytes are shared with the 
+    //mapping, kept open by the jobs
+    int run_pack(const std::shared_ptr<const emu_io::RomPack>& pack,
+                 const C8::Job& base, bool is_flags_given)
+    {
+        C8::Farm farm;
+        for(size_t index = 0; index < pack->size(); ++index)
+        {
+            const emu_io::RomPack::Entry rom = (*pack)[index];
+            C8::Job job = base;
+            job.id = index;
+            job.program = std::shared_ptr<const uint8_t>(pack, rom.data);
+            job.program_size = rom.length;
+            if(!is_flags_given) job.flags = static_cast<C8::Flags>(rom.flags);
+            farm.submit(job);
+        }
+
+        std::vector<C8::Result> results(pack->size());
+        C8::Result result;
+        while(farm.wait(result)) results[result.id] = result;
+
+        int status = 0;
+        for(size_t index = 0; index < results.size(); ++index)
+        {
+            const C8::Result& r = results[index];
+            std::printf("rom=%016" PRIx64 " frames=%lu cycles=%" PRIu64
+                " hash=%016" PRIx64, (*pack)[index].hash, r.frames, r.cycles,
+                C8::display_hash(r.display));
+            if(r.broke) std::printf(" break address=%03X", r.break_address);
+            if(r.faulted)
+            {
+                std::printf(" fault address=%03X what=%s", r.error_address,
+                            r.error.c_str());
+                status = 2;
+            }
+            std::printf("\n");
+        }
+        return status;
+    }
+
+    bool write_profile(const C8::CPU::Profiler& profiler, const char* path)
+    {
+        std::FILE* file = std::fopen(path, "w");
+        if(!file) return false;
+        for(const std::string& line : profiler.collapsed_stacks())
+            std::fprintf(file, "%s\n", line.c_str());
+        std::fclose(file);
+
+        std::fprintf(stderr, "profile families:");
+        for(unsigned int n = 0; n < 0x10; ++n)
+        {
+            std::fprintf(stderr, " %Xxxx=%" PRIu64, n, 
+                         profiler.family_count(n));
+        }
+
+        std::fprintf(stderr, "\nprofile handlers:");
+        const auto handlers = profiler.handler_counts();
+        for(size_t h = 0; h < handlers.size() && h < 10; ++h)
+        {
+            std::fprintf(stderr, " %s=%" PRIu64, handlers[h].first.c_str(),
+                         handlers[h].second);
+        }
+
+        std::vector<std::pair<uint64_t, unsigned int>> addresses;
+        for(unsigned int addr = 0; addr < C8::RAM_SIZE; ++addr)
+        {
+            if(profiler.address_count(addr))
+                addresses.emplace_back(profiler.address_count(addr), addr);
+        }
+        std::sort(addresses.rbegin(), addresses.rend());
+        std::fprintf(stderr, "\nprofile addresses:");
+        for(size_t a = 0; a < addresses.size() && a < 10; ++a)
+        {
+            std::fprintf(stderr, " %03X=%" PRIu64, addresses[a].second,
+                         addresses[a].first);
+        }
+        std::fprintf(stderr, "\n");
+        return true;
+    }
+
+    void print_state(const C8::CPU& cpu, uint64_t frames, 
+                     const char* label = "final")
+    {
+        const C8::Snapshot s = cpu.snapshot();
+        std::printf("%s frames=%" PRIu64 " cycles=%" PRIu64
+            " pc=%03X i=%03X sp=%u v=", label,
+            frames, s.cycle, s.pc, s.i, static_cast<unsigned int>(s.sp));
+        for(uint8_t v : s.v) std::printf("%02X", v);
+        std::printf(" dt=%u st=%u paused=%d hash=%016" PRIx64 "\n",
+            s.delay_timer, s.sound_timer, s.paused ? 1 : 0,
+            C8::display_hash(s.display));
+    }
+
+    //Where a run stopped on a breakpoint, break condition or watchpoint
+    void print_break(const C8::CPU& cpu, uint64_t frames, unsigned int reason)
+    {
+        if(reason & C8::STOP_WATCH)
+        {
+            const C8::WatchHit hit = cpu.last_watch();
+            std::printf("watch pc=%03X addr=%03X %s\n", hit.pc, hit.addr,
+                        (hit.access & C8::WATCH_WRITE) ? "write" : "read");
+        }
+        print_state(cpu, frames, "break");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) { usage(); return 1; }
+
+    unsigned long long frames = 600;
+    unsigned long long cycles = 0;      //Zero: run for frames instead
+    unsigned long long seed = 0;
+    unsigned long long clock = C8::DEFAULT_CLOCK_SPEED_HZ;
+    unsigned long long hash_every = 0;
+    C8::Flags flags = C8::NO_FLAGS;
+    bool is_flags_given = false;
+    bool jit = false;
+    const char* pack_path = nullptr;
+    const char* profile_path = nullptr;
+    const char* trace_path = nullptr;
+    std::vector<uint16_t> breakpoints;
+    std::vector<std::pair<uint16_t, uint16_t>> watchpoints;
+    std::vector<C8::BreakCondition> conditions;
+    std::map<uint64_t, uint16_t> script;
+    std::map<uint64_t, uint16_t> cycle_script;
+
+    for(int arg = 2; arg < argc; ++arg)
+    {
+        const char* option = argv[arg];
+        const char* value = (arg + 1 < argc) ? argv[arg + 1] : "";
+        bool ok = true;
+
+        if(!std::strcmp(option, "--jit")) { jit = true; continue; }
+        else if(!std::strcmp(option, "--frames"))
+            ok = parse_number(value, frames), cycles = 0;
+        else if(!std::strcmp(option, "--cycles"))
+            ok = parse_number(value, cycles) && cycles > 0;
+        else if(!std::strcmp(option, "--seed"))
+            ok = parse_number(value, seed);
+        else if(!std::strcmp(option, "--clock"))
+            ok = parse_number(value, clock) && clock > 0;
+        else if(!std::strcmp(option, "--hash-every"))
+            ok = parse_number(value, hash_every);
+        else if(!std::strcmp(option, "--flags"))
+            ok = emu_io::parse_flags(value, flags), is_flags_given = true;
+        else if(!std::strcmp(option, "--input"))
+            ok = load_script(value, script, cycle_script);
+        else if(!std::strcmp(option, "--pack"))
+            pack_path = value;
+        else if(!std::strcmp(option, "--profile"))
+            ok = C8::HAS_PROFILE, profile_path = value;
+        else if(!std::strcmp(option, "--trace"))
+            ok = C8::HAS_TRACE, trace_path = value;
+        else if(!std::strcmp(option, "--break"))
+        {
+            unsigned long long addr;
+            ok = parse_number(value, addr) && addr < C8::RAM_SIZE;
+            breakpoints.push_back(static_cast<uint16_t>(addr));
+        }
+        else if(!std::strcmp(option, "--watch"))
+        {
+            watchpoints.emplace_back();
+            ok = parse_watch(value, watchpoints.back());
+        }
+        else if(!std::strcmp(option, "--break-if"))
+        {
+            conditions.emplace_back();
+            ok = parse_condition(value, conditions.back());
+        }
+        else ok = false;
+
+        if(!ok)
+        {
+            std::fprintf(stderr, "invalid option: %s %s\n", option, value);
+            usage();
+            return 1;
+        }
+        ++arg;
+    }
+
+    uint8_t buffer[C8::PROGRAM_SIZE] = {};
+    size_t size = 0;
+    try
+    {
+        if(!pack_path)
+        {
+            size = emu_io::load_rom_file(argv[1], buffer, C8::PROGRAM_SIZE);
+        }
+        else
+        {
+            auto pack = std::make_shared<const emu_io::RomPack>(pack_path);
+            if(!std::strcmp(argv[1], "all"))
+            {
+                if(cycles || hash_every || jit || !cycle_script.empty())
+                {
+                    std::fprintf(stderr, "a pack is run by frames only\n");
+                    return 1;
+                }
+                if(!watchpoints.empty() || !conditions.empty())
+                {
+                    std::fprintf(stderr, "a pack is run to breakpoints only\n");
+                    return 1;
+                }
+
+                C8::Job job;
+                job.seed = static_cast<uint32_t>(seed);
+                job.clock_speed_hz = static_cast<unsigned int>(clock);
+                job.frames = static_cast<unsigned long>(frames);
+                job.flags = flags;
+                job.breakpoints = breakpoints;
+                //Keys held from each change onwards, to the end of the run
+                //unless released
+                uint16_t keys = 0;
+                for(const auto& change : script)
+                {
+                    if(change.first >= frames) break;
+                    job.input.resize(change.first, keys);
+                    keys = change.second;
+                }
+                job.input.resize(keys ? frames : job.input.size(), keys);
+                return run_pack(pack, job, is_flags_given);
+            }
+
+            char* end;
+            const uint64_t hash = std::strtoull(argv[1], &end, 16);
+            emu_io::RomPack::Entry rom;
+            if(*argv[1] == '\0' || *end != '\0' || !pack->find(hash, rom))
+            {
+                std::fprintf(stderr, "%s: no such ROM in %s\n",
+                             argv[1], pack_path);
+                return 1;
+            }
+            size = std::min<size_t>(rom.length, C8::PROGRAM_SIZE);
+            std::memcpy(buffer, rom.data, size);
+            if(!is_flags_given) flags = static_cast<C8::Flags>(rom.flags);
+        }
+    }
+    catch(const emu_io::io_exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", pack_path ? pack_path : argv[1],
+                     e.what());
+        return 1;
+    }
+
+    //Streamed to the file as it runs, and completed as the CPU is destroyed
+    std::unique_ptr<std::FILE, int(*)(std::FILE*)> trace_file(
+        trace_path ? std::fopen(trace_path, "wb") : nullptr, std::fclose);
+    if(trace_path && !trace_file)
+    {
+        std::fprintf(stderr, "%s: can't be written\n", trace_path);
+        return 1;
+    }
+    std::unique_ptr<C8::CPU::Tracer> tracer;
+    if(trace_path)
+    {
+        std::FILE* file = trace_file.get();
+        tracer = std::make_unique<C8::CPU::Tracer>(
+            [file](const uint8_t* data, size_t bytes)
+            { std::fwrite(data, 1, bytes, file); });
+    }
+
+    C8::CPU::Profiler profiler;
+    C8::CPU cpu(buffer, size, flags);
+    cpu.seed_rng(static_cast<uint32_t>(seed));
+    cpu.set_clock_speed_hz(static_cast<unsigned int>(clock));
+    if(jit) cpu.set_engine(C8::Engine::JIT);
+    if(profile_path) cpu.set_profiler(&profiler);
+    if(tracer) cpu.set_tracer(tracer.get());
+    for(uint16_t addr : breakpoints) cpu.set_breakpoint(addr);
+    for(const auto& watchpoint : watchpoints)
+        cpu.set_watchpoint(watchpoint.first, watchpoint.second);
+    for(const C8::BreakCondition& condition : conditions)
+        cpu.add_break_condition(condition);
+    const unsigned int stop_on = cpu.is_debugged() 
+        ? (C8::STOP_BREAK | C8::STOP_WATCH) : C8::STOP_NONE;
+
+    //Changes at exact cycles are queued up front, applied by the run loop
+    for(const auto& change : cycle_script)
+    {
+        for(unsigned int key = 0; key < 0x10; ++key)
+        {
+            cpu.queue_input({change.first, static_cast<C8::Keys>(key),
+                             static_cast<bool>((change.second >> key) & 0x1)});
+        }
+    }
+
+    //Run frame by frame, so that input changes on frame boundaries
+    uint64_t frame = 0;
+    uint64_t executed = 0;
+    try
+    {
+        while(cycles ? (executed < cycles) : (frame < frames))
+        {
+            auto change = script.find(frame);
+            if(change != script.end())
+            {
+                cpu.set_keys(change->second);
+            }
+
+            const C8::RunResult result = cycles
+                ? cpu.run_cycles(cycles - executed, C8::STOP_FRAME | stop_on)
+                : cpu.run_until_frame(stop_on);
+            executed += result.cycles;
+            if(result.reason & (C8::STOP_BREAK | C8::STOP_WATCH))
+            {
+                print_break(cpu, frame, result.reason);
+                if(!(result.reason & C8::STOP_FRAME)) continue;
+            }
+            if(!(result.reason & C8::STOP_FRAME)) break;
+            ++frame;
+
+            if(hash_every && frame % hash_every == 0)
+            {
+                std::printf("frame=%" PRIu64 " cycles=%" PRIu64
+                    " hash=%016" PRIx64 "\n",
+                    frame, executed, C8::display_hash(cpu.display()));
+            }
+        }
+    }
+    catch(const C8::cpu_exception& e)
+    {
+        print_state(cpu, frame);
+        std::printf("fault address=%03X what=%s\n", e.last_address, e.what());
+        if(profile_path) write_profile(profiler, profile_path);
+        return 2;
+    }
+
+    print_state(cpu, frame);
+    if(profile_path && !write_profile(profiler, profile_path))
+    {
+        std::fprintf(stderr, "%s: can't be written\n", profile_path);
+        return 1;
+    }
+    return 0;
+}
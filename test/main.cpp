@@ -1,84 +1,301 @@
 #include "chip8.h"
+#include "chip8_movie.h"
 #include "emu_io.h"
+#include "emu_thread.h"
 
-#include <chrono>           //std::chrono::steady_clock, std::chrono::duration, 
-                            //std::chrono::duration_cast
-#include <thread>           //std::this_thread::sleep_for
-#include <unordered_map>
+#include <algorithm>        //std::min, std::max
+#include <atomic>           //std::atomic
+#include <chrono>           //std::chrono::steady_clock, std::chrono::duration
+#include <cstdio>           //std::fopen, std::fwrite, std::fprintf
+#include <cstdlib>          //std::strtod
+#include <cstring>          //std::strcmp, std::memcpy
+#include <deque>            //std::deque
+#include <functional>       //std::ref
+#include <memory>           //std::unique_ptr
+#include <random>           //std::random_device
+#include <thread>           //std::thread, std::this_thread::sleep_for
+#include <utility>          //std::pair
+#include <vector>           //std::vector
+
+//The core runs on its own thread, paced to real time, publishing each frame
+//it completes through a triple buffer. The main thread polls input, which
+//it sends back through a queue stamped with the time it was polled, and
+//renders the latest frame, so neither waits on the other (e.g. on vsync).
+namespace
+{
+    namespace C8 = chip8;
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    //Host time caught up on at once, at most: beyond it (e.g. after the
+    //process was suspended), emulated time is dropped rather than raced
+    //through
+    constexpr seconds max_catch_up {0.1};
+
+    struct Frame
+    {
+        uint64_t display[C8::DISPLAY_WORDS];
+    };
+
+    //Keys held from time onwards
+    struct Input
+    {
+        clock::time_point time;
+        uint16_t keys;
+    };
+
+    struct Shared
+    {
+        emu_io::TripleBuffer<Frame> frames;
+        emu_io::SpscQueue<Input, 256> input;
+        std::atomic<bool> is_running {true};
+    };
+
+    //Input as the cycle it was applied on, and the display's hash once a
+    //second, for replay.cpp to verify
+    class Recorder
+    {
+    private:
+        std::FILE* file_;
+        C8::MovieWriter movie_;
+        uint64_t next_checkpoint_;
+        std::deque<std::pair<uint64_t, uint16_t>> keys_;   //Cycle, mask
+
+        //Input is queued ahead of the cycles it applies on, so is recorded
+        //once they have run, in order with the checkpoints
+        void flush(uint64_t cycle)
+        {
+            for(; !keys_.empty() && keys_.front().first <= cycle;
+                keys_.pop_front())
+            {
+                movie_.keys(keys_.front().first, keys_.front().second);
+            }
+        }
+
+        void write()
+        {
+            const std::vector<uint8_t> bytes = movie_.take();
+            std::fwrite(bytes.data(), 1, bytes.size(), file_);
+        }
+
+        void checkpoint(const C8::CPU& cpu)
+        {
+            flush(cpu.scheduler().cycle());
+            movie_.checkpoint(cpu.scheduler().cycle(),
+                              C8::display_hash(cpu.display()));
+        }
+
+    public:
+        Recorder(std::FILE* file, const C8::MovieHeader& header)
+            : file_{file}, movie_{header},
+              next_checkpoint_{C8::FRAMES_PER_SECOND} {}
+
+        void keys(uint64_t cycle, uint16_t mask)
+        {
+            keys_.emplace_back(cycle, mask);
+        }
+
+        void frame(const C8::CPU& cpu)
+        {
+            if(cpu.scheduler().frame() < next_checkpoint_) return;
+
+            checkpoint(cpu);
+            next_checkpoint_ = cpu.scheduler().frame() + C8::FRAMES_PER_SECOND;
+            write();
+        }
+
+        void end(const C8::CPU& cpu)
+        {
+            checkpoint(cpu);
+            movie_.end(cpu.scheduler().cycle());
+            write();
+            std::fclose(file_);
+        }
+    };
+
+    void emulate(C8::CPU& cpu, Shared& shared, emu_io::IO& io, 
+                 Recorder* recorder)
+    {
+        const double hz = cpu.get_clock_speed_hz();
+        uint16_t keys = 0;
+        double owed = 0.0;          //Cycles of host time not yet emulated
+        auto previous_time = clock::now();
+
+        //The tone only changes on a frame (as the sound timer counts down)
+        //or as it is set, where runs stop, so is queued up to each stop as 
+        //it was since the last, to the sample
+        const uint64_t sample_rate = io.get_sample_rate();
+        const uint64_t clock_hz = cpu.get_clock_speed_hz();
+        uint64_t samples = 0;       //Queued, of the cycles run
+        bool is_sound = false;
+
+        while(shared.is_running.load(std::memory_order_relaxed))
+        {
+            const auto time = clock::now();
+            const seconds elapsed =
+                std::min<seconds>(time - previous_time, max_catch_up);
+            owed += elapsed.count() * hz;
+            const uint64_t cycles = static_cast<uint64_t>(owed);
+            owed -= cycles;
+
+            //Input applies from the cycle emulating the time it was polled
+            //(or the first of this batch, if that has already been emulated)
+            const uint64_t begin = cpu.scheduler().cycle();
+            Input input;
+            while(shared.input.pop(input))
+            {
+                const double offset =
+                    seconds(input.time - previous_time).count() * hz;
+                const uint64_t cycle = begin + static_cast<uint64_t>(
+                    std::max(0.0, std::min<double>(offset, cycles)));
+
+                for(unsigned int key = 0; key < 0x10; ++key)
+                {
+                    const bool is_held = (input.keys >> key) & 0x1;
+                    if(is_held == static_cast<bool>((keys >> key) & 0x1))
+                        continue;
+                    cpu.queue_input({cycle, static_cast<C8::Keys>(key),
+                                     is_held});
+                }
+                if(recorder) recorder->keys(cycle, input.keys);
+                keys = input.keys;
+            }
+            previous_time = time;
+
+            for(uint64_t done = 0; done < cycles; )
+            {
+                const C8::RunResult result = cpu.run_cycles(
+                    cycles - done, C8::STOP_FRAME | C8::STOP_SOUND);
+                done += result.cycles;
+
+                const uint64_t sample = 
+                    cpu.scheduler().cycle() * sample_rate / clock_hz;
+                io.queue_tone(is_sound, sample - samples);
+                samples = sample;
+                is_sound = cpu.is_sound();
+
+                if(!(result.reason & C8::STOP_FRAME)) continue;
+
+                Frame& frame = shared.frames.back();
+                std::memcpy(frame.display, cpu.display(),
+                            sizeof(frame.display));
+                shared.frames.publish();
+
+                if(recorder) recorder->frame(cpu);
+            }
+
+            //Nothing is published until the next frame completes
+            std::this_thread::sleep_for(
+                seconds((cpu.scheduler().cycles_to_frame() - owed) / hz));
+        }
+    }
+}
 
 int main(int argc, char** argv)
 {
-    if(argc == 1) return 1;
+    //chop8 ROM [--record MOVIE] [--latency MS]
+    if(argc < 2) return 1;
+    const char* movie_path = nullptr;
+    double latency = 0.05;
+    for(int arg = 2; arg < argc; ++arg)
+    {
+        if(!std::strcmp(argv[arg], "--record") && arg + 1 < argc)
+            movie_path = argv[++arg];
+        else if(!std::strcmp(argv[arg], "--latency") && arg + 1 < argc)
+            latency = std::strtod(argv[++arg], nullptr) / 1000.0;
+        else return 1;
+    }
 
-    namespace C8 = chip8;
     using Ck = C8::Keys;
     using Ik = emu_io::Keys;
-    
-    uint8_t buffer[C8::PROGRAM_SIZE];
-    emu_io::load_rom_file(argv[1], buffer, C8::PROGRAM_SIZE);
-
-    //<chip8::Keys, emu_io::Keys>
-    std::unordered_map<Ck, Ik> map {
-        {Ck::KEY_1, Ik::KEY_1},
-        {Ck::KEY_2, Ik::KEY_2},
-        {Ck::KEY_3, Ik::KEY_3},
-        {Ck::KEY_C, Ik::KEY_4},
-        {Ck::KEY_4, Ik::KEY_Q},
-        {Ck::KEY_5, Ik::KEY_W},
-        {Ck::KEY_6, Ik::KEY_E},
-        {Ck::KEY_D, Ik::KEY_R},
-        {Ck::KEY_7, Ik::KEY_A},
-        {Ck::KEY_8, Ik::KEY_S},
-        {Ck::KEY_9, Ik::KEY_D},
-        {Ck::KEY_E, Ik::KEY_F},
-        {Ck::KEY_A, Ik::KEY_Z},
-        {Ck::KEY_0, Ik::KEY_X},
-        {Ck::KEY_B, Ik::KEY_C},
-        {Ck::KEY_F, Ik::KEY_V}
+
+    //Zero-padded, so the whole buffer identifies the program in a movie
+    uint8_t buffer[C8::PROGRAM_SIZE] = {};
+    try
+    {
+        emu_io::load_rom_file(argv[1], buffer, C8::PROGRAM_SIZE);
+    }
+    catch(const emu_io::io_exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", argv[1], e.what());
+        return 1;
+    }
+
+    //emu_io::Keys of each chip8::Keys, in order, for IO::key_mask()
+    constexpr Ik keymap[static_cast<unsigned int>(Ck::QUANTITY_OF_KEYS)] = {
+        Ik::KEY_X,                                      //0
+        Ik::KEY_1,  Ik::KEY_2,  Ik::KEY_3,              //1, 2, 3
+        Ik::KEY_Q,  Ik::KEY_W,  Ik::KEY_E,              //4, 5, 6
+        Ik::KEY_A,  Ik::KEY_S,  Ik::KEY_D,              //7, 8, 9
+        Ik::KEY_Z,  Ik::KEY_C,                          //A, B
+        Ik::KEY_4,  Ik::KEY_R,  Ik::KEY_F,  Ik::KEY_V   //C, D, E, F
     };
 
-    using clock = std::chrono::steady_clock;
-    using milliseconds = std::chrono::duration<double, std::milli>;
-    using std::chrono::duration_cast;
-
-    constexpr milliseconds dt {1000.0/C8::DEFAULT_CLOCK_SPEED_HZ};
-    auto previous_time = clock::now();
-    auto new_time = previous_time;
-    milliseconds accumulator = milliseconds(0);
-    
-    C8::CPU cpu(buffer, C8::PROGRAM_SIZE, C8::NEW_OPCODES);
+    const C8::Flags flags = C8::NEW_OPCODES;
+    const uint32_t seed = (std::random_device{})();
+    C8::CPU cpu(buffer, C8::PROGRAM_SIZE, flags);
+    cpu.seed_rng(seed);
+    uint32_t palette[C8::COLOURS];
+    for(unsigned int c = 0; c < C8::COLOURS; ++c) palette[c] = cpu.get_argb(c);
+
+    std::unique_ptr<Recorder> recorder;
+    if(movie_path)
+    {
+        std::FILE* file = std::fopen(movie_path, "wb");
+        if(!file) return 1;
+        recorder = std::make_unique<Recorder>(file, C8::MovieHeader{
+            C8::program_hash(buffer, C8::PROGRAM_SIZE), flags, seed,
+            cpu.get_clock_speed_hz()});
+    }
+
     emu_io::IO& io = emu_io::IO::instance("CHOP-8", C8::WIDTH, C8::HEIGHT);
+    io.set_audio_latency(latency);
+    Shared shared;
+    std::thread emulation(emulate, std::ref(cpu), std::ref(shared),
+                          std::ref(io), recorder.get());
+
+    uint32_t framebuffer[C8::WIDTH * C8::HEIGHT];
+    uint64_t shown[C8::DISPLAY_WORDS] = {};
+    uint64_t rows = C8::ALL_ROWS;       //Changed since the last frame shown
+    uint16_t keys = 0;
 
-    do 
+    for(io.update_input(); !io.is_key_held(Ik::KEY_ESCAPE); io.update_input())
     {
-        new_time = clock::now();
-        accumulator += duration_cast<milliseconds>(new_time - previous_time);
-        previous_time = new_time;
+        //Changes are resent until the queue has room, so none are lost
+        const uint16_t held = io.key_mask(keymap);
+        if(held != keys && shared.input.push({clock::now(), held}))
+            keys = held;
 
-        while(accumulator >= dt)
+        if(!shared.frames.take())
         {
-            using U = unsigned int;
-            for(U u = static_cast<U>(Ck::KEY_0); 
-                u < static_cast<U>(Ck::QUANTITY_OF_KEYS);
-                u++)
-            {
-                Ck k = static_cast<Ck>(u);
-                cpu.pump_input(k, io.is_key_held(map.at(k)));
-            }
-
-            cpu.execute();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
 
-            accumulator -= dt;
+        //Only changed rows are expanded and uploaded
+        const Frame& frame = shared.frames.front();
+        for(unsigned int word = 0; word < C8::DISPLAY_WORDS; ++word)
+        {
+            const unsigned int y = (word / C8::ROW_WORDS) % C8::HEIGHT;
+            if(frame.display[word] != shown[word]) rows |= uint64_t{1} << y;
         }
+        std::memcpy(shown, frame.display, sizeof(shown));
 
-        io.set_audible(cpu.is_sound());
-        io.render(cpu.framebuffer());
+        io.render(C8::expand_display(frame.display, palette, framebuffer,
+                                     rows), rows);
+        rows = 0;
+    }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    shared.is_running.store(false, std::memory_order_relaxed);
+    emulation.join();
+    if(recorder) recorder->end(cpu);
 
-        io.update_input();
-    } 
-    while(!(io.is_key_held(Ik::KEY_ESCAPE)));
+    const emu_io::AudioStats audio = io.audio_stats();
+    if(audio.underruns || audio.overruns)
+    {
+        std::fprintf(stderr, "audio: %lu underruns, %lu overruns\n",
+                     audio.underruns, audio.overruns);
+    }
 
     return 0;
 }
@@ -0,0 +1,117 @@
+#include "chip8.h"
+#include "chip8_movie.h"    //chip8::program_hash
+#include "emu_io.h"         //emu_io::RomPack, load_rom_file, ...: no SDL
+
+#include <cinttypes>        //PRIx64, PRIx32
+#include <cstdint>          //uint8_t, uint32_t
+#include <cstdio>           //std::printf, std::fprintf, std::fopen, std::fgets
+#include <cstring>          //std::strcmp, std::strcspn
+#include <string>           //std::string
+#include <utility>          //std::move
+#include <vector>           //std::vector
+
+//Builds a ROM pack (see emu_io::RomPack) of ROM files, each with the flags
+//given before it, indexed by chip8::program_hash() of its bytes; or lists
+//one, a ROM per line: hash, length and flags, in hexadecimal.
+namespace
+{
+    namespace C8 = chip8;
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: pack OUT [--flags F] [--from LIST] ROM...\n"
+            "       pack --list PACK\n"
+            "  F: recommended flags of the ROMs after it (until the next\n"
+            "     --flags): bitwise OR of chip8::Flags, or a comma-separated\n"
+            "     list of %s\n"
+            "  LIST: file of ROM paths, one per line\n",
+            emu_io::flag_names().c_str());
+    }
+
+    void add_rom(const char* path, C8::Flags flags,
+                 std::vector<emu_io::PackedRom>& roms)
+    {
+        std::vector<uint8_t> bytes(C8::PROGRAM_SIZE);
+        try
+        {
+            bytes.resize(
+                emu_io::load_rom_file(path, bytes.data(), bytes.size()));
+        }
+        catch(const emu_io::io_exception& e)
+        {
+            throw emu_io::io_exception(
+                (std::string(path) + ": " + e.what()).c_str());
+        }
+        const uint64_t hash = C8::program_hash(bytes.data(), bytes.size());
+        roms.push_back({hash, flags, std::move(bytes)});
+    }
+
+    bool add_list(const char* path, C8::Flags flags,
+                  std::vector<emu_io::PackedRom>& roms)
+    {
+        std::FILE* file = std::fopen(path, "r");
+        if(!file) return false;
+
+        char line[4096];
+        while(std::fgets(line, sizeof(line), file))
+        {
+            line[std::strcspn(line, "\r\n")] = '\0';
+            if(*line) add_rom(line, flags, roms);
+        }
+
+        std::fclose(file);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3) { usage(); return 1; }
+
+    try
+    {
+        if(!std::strcmp(argv[1], "--list"))
+        {
+            const emu_io::RomPack pack(argv[2]);
+            for(size_t index = 0; index < pack.size(); ++index)
+            {
+                const emu_io::RomPack::Entry rom = pack[index];
+                std::printf("%016" PRIx64 " %04" PRIx32 " %" PRIx32 "\n",
+                            rom.hash, rom.length, rom.flags);
+            }
+            return 0;
+        }
+
+        std::vector<emu_io::PackedRom> roms;
+        C8::Flags flags = C8::NO_FLAGS;
+        for(int arg = 2; arg < argc; ++arg)
+        {
+            const char* option = argv[arg];
+            const char* value = (arg + 1 < argc) ? argv[arg + 1] : "";
+            bool ok = true;
+
+            if(!std::strcmp(option, "--flags"))
+                ok = emu_io::parse_flags(value, flags), ++arg;
+            else if(!std::strcmp(option, "--from"))
+                ok = add_list(value, flags, roms), ++arg;
+            else add_rom(option, flags, roms);
+
+            if(!ok)
+            {
+                std::fprintf(stderr, "invalid option: %s %s\n", option, value);
+                usage();
+                return 1;
+            }
+        }
+
+        emu_io::write_rom_pack(argv[1], std::move(roms));
+    }
+    catch(const emu_io::io_exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
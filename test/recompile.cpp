@@ -0,0 +1,413 @@
+#include "chip8.h"
+#include "chip8_disasm.h"
+#include "emu_io.h"         //emu_io::MappedFile, parse_flags: no SDL required
+
+#include <algorithm>        //std::min, std::max
+#include <cstdarg>          //va_list, va_start, va_end
+#include <cstdint>          //uint8_t, uint16_t
+#include <cstdio>           //std::printf, std::fprintf, std::vsnprintf
+#include <cstring>          //std::strcmp
+#include <map>              //std::map
+#include <set>              //std::set
+#include <string>           //std::string
+#include <vector>           //std::vector
+
+//Translates a ROM ahead of time into a C++ source file, printed to stdout,
+//defining a chip8::StaticProgram (see core/chip8_aot.h) to build into a host
+//with the core and pass to CPU::set_static_program(). Code is found by
+//recursive descent (see chip8::trace_program()), and each basic block
+//becomes a function, further split where an instruction is left to the
+//interpreter, as the dynamic recompiler does. With --disassemble, the code
+//found is listed instead.
+namespace
+{
+    namespace C8 = chip8;
+    using C8::Flow;
+    using C8::Instruction;
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: recompile ROM [--name NAME] [--flags F] > OUT.cpp\n"
+            "       recompile ROM --disassemble\n"
+            "  NAME: identifier of the chip8::StaticProgram defined\n"
+            "        (static_program by default)\n"
+            "  F: bitwise OR of chip8::Flags, or a comma-separated list of\n"
+            "     %s: the CPU running the\n"
+            "     program must be constructed with the same\n",
+            emu_io::flag_names().c_str());
+    }
+
+    bool is_identifier(const char* s)
+    {
+        auto is_start = [](char c)
+            { return c == '_' || (c >= 'A' && c <= 'Z') ||
+                     (c >= 'a' && c <= 'z'); };
+        if(!is_start(*s)) return false;
+        for(++s; *s; ++s)
+        {
+            if(!is_start(*s) && !(*s >= '0' && *s <= '9')) return false;
+        }
+        return true;
+    }
+
+    std::string format(const char* f, ...)
+    {
+        char text[256];
+        va_list args;
+        va_start(args, f);
+        std::vsnprintf(text, sizeof(text), f, args);
+        va_end(args);
+        return text;
+    }
+
+    //How an instruction is translated
+    enum class Kind
+    {
+        NATIVE,         //Inline, continuing the block
+        BRANCH,         //Inline, ending the block (1nnn, 2nnn, 00EE, Bnnn,
+                        //skips)
+        INTERPRETED,    //By its interpreter handler, continuing the block
+        ENDING,         //By its interpreter handler, ending the block (as
+                        //it may draw, write RAM, skip or raise an event)
+        LEFT            //To the interpreter, ending the block before it:
+                        //timers, which are only brought up to date after a
+                        //block, idle loops, 00FD and invalid opcodes
+    };
+
+    Kind kind_of(const Instruction& in)
+    {
+        const unsigned int kk = 0xFF & in.opcode;
+        if(in.flow == Flow::HALT) return Kind::LEFT;
+        if(in.flow == Flow::JUMP && in.target == in.addr) return Kind::LEFT;
+
+        switch(0xF & (in.opcode >> 12))
+        {
+        case(0x0): return (kk == 0xEE) ? Kind::BRANCH : Kind::ENDING;
+        case(0x1): case(0x2): case(0xB): return Kind::BRANCH;
+        case(0x3): case(0x4): case(0x5): case(0x9):
+            if(in.flow != Flow::SKIP) return Kind::ENDING;  //5xy2, 5xy3
+            //XO-CHIP skips' lengths depend on RAM at run time
+            return C8::HAS_XOCHIP ? Kind::ENDING : Kind::BRANCH;
+        case(0x6): case(0x7): case(0x8): case(0xA): return Kind::NATIVE;
+        case(0xC): return Kind::INTERPRETED;
+        case(0xD): case(0xE): return Kind::ENDING;
+        default: break;
+        }
+
+        switch(kk)
+        {
+        case(0x07): case(0x0A): case(0x15): case(0x18): return Kind::LEFT;
+        case(0x1E): case(0x29): return Kind::NATIVE;
+        case(0x65): return Kind::INTERPRETED;
+        default: return Kind::ENDING;
+        }
+    }
+
+    //Statements of a native instruction, mirroring its interpreter handler
+    std::string native(const Instruction& in, C8::Flags flags)
+    {
+        const unsigned int x  = 0xF  & (in.opcode >> 8);
+        const unsigned int y  = 0xF  & (in.opcode >> 4);
+        const unsigned int kk = 0xFF &  in.opcode;
+        const unsigned int u  = (flags & C8::NEW_8XYU) ? x : y;
+
+        switch(0xF & (in.opcode >> 12))
+        {
+        case(0x6): return format("r.v[0x%X] = 0x%02X;", x, kk);
+        case(0x7): return format("r.v[0x%X] += 0x%02X;", x, kk);
+        case(0xA): return format("r.i = 0x%03X;", 0xFFF & in.opcode);
+        case(0xF):
+            if(kk == 0x1E) return format("r.i += r.v[0x%X];", x);
+            return format("r.i = C8::font_address(r.v[0x%X]);", x);
+        default: break;     //8xyz
+        }
+
+        switch(0xF & in.opcode)
+        {
+        case(0x0): return format("r.v[0x%X] = r.v[0x%X];", x, y);
+        case(0x1): return format("r.v[0x%X] |= r.v[0x%X];", x, y);
+        case(0x2): return format("r.v[0x%X] &= r.v[0x%X];", x, y);
+        case(0x3): return format("r.v[0x%X] ^= r.v[0x%X];", x, y);
+        case(0x4): return format("{ const uint8_t old = r.v[0x%X]; "
+            "r.v[0x%X] += r.v[0x%X]; r.v[0xF] = (old > r.v[0x%X]) ? 1 : 0; }",
+            x, x, y, x);
+        case(0x5): return format("{ const uint8_t old = r.v[0x%X]; "
+            "r.v[0x%X] -= r.v[0x%X]; r.v[0xF] = (old < r.v[0x%X]) ? 0 : 1; }",
+            x, x, y, x);
+        case(0x6): return format("{ const uint8_t pre = r.v[0x%X]; "
+            "r.v[0x%X] = pre >> 1; "
+            "r.v[0xF] = (pre == (r.v[0x%X] << 1)) ? 0 : 1; }", u, x, x);
+        case(0x7): return format("r.v[0x%X] = r.v[0x%X] - r.v[0x%X]; "
+            "r.v[0xF] = (r.v[0x%X] < r.v[0x%X]) ? 0 : 1;", x, y, x, y, x);
+        case(0xE): return format("{ const uint8_t pre = r.v[0x%X]; "
+            "r.v[0x%X] = pre << 1; "
+            "r.v[0xF] = (pre == (r.v[0x%X] >> 1)) ? 0 : 1; }", u, x, x);
+        default: return "";     //Unassigned: no operation
+        }
+    }
+
+    //Final statement of a branch, for a block beginning at start
+    std::string branch(const Instruction& in, unsigned int start,
+                       bool& is_loop)
+    {
+        const unsigned int x   = 0xF   & (in.opcode >> 8);
+        const unsigned int y   = 0xF   & (in.opcode >> 4);
+        const unsigned int kk  = 0xFF  &  in.opcode;
+        const unsigned int nnn = 0xFFF &  in.opcode;
+        const unsigned int next = in.addr + in.length;
+
+        auto skip_if = [next](const std::string& condition)
+        {
+            return format("return r.leave(cpu, n + 1, (%s) ? 0x%03X : 0x%03X);",
+                          condition.c_str(), next + C8::BYTES_PER_OPCODE, next);
+        };
+
+        switch(0xF & (in.opcode >> 12))
+        {
+        case(0x0): return format("{ uint16_t pc; if(!Aot::ret(cpu, pc)) "
+            "return r.leave(cpu, n, 0x%03X); return r.leave(cpu, n + 1, pc); }",
+            in.addr);
+        case(0x1):
+            if(nnn != start)
+                return format("return r.leave(cpu, n + 1, 0x%03X);", nnn);
+            //Tight loop: iterate within the block until budget is spent
+            is_loop = true;
+            return format("if(++n == budget) return r.leave(cpu, n, 0x%03X);"
+                          "\n        goto entry;", nnn);
+        case(0x2): return format("if(!Aot::call(cpu, 0x%03X)) "
+            "return r.leave(cpu, n, 0x%03X);\n"
+            "        return r.leave(cpu, n + 1, 0x%03X);", next, in.addr, nnn);
+        case(0x3): return skip_if(format("r.v[0x%X] == 0x%02X", x, kk));
+        case(0x4): return skip_if(format("r.v[0x%X] != 0x%02X", x, kk));
+        case(0x5): return skip_if(format("r.v[0x%X] == r.v[0x%X]", x, y));
+        case(0x9): return skip_if(format("r.v[0x%X] != r.v[0x%X]", x, y));
+        default:   //Bnnn
+            return format("return r.leave(cpu, n + 1, 0x%03X + r.v[0x0]);",
+                          nnn);
+        }
+    }
+
+    struct Block
+    {
+        unsigned int begin;
+        unsigned int end;
+        std::string body;
+        bool is_loop;
+    };
+
+    //Block of code from start, or false if its first instruction is left
+    //to the interpreter
+    bool translate(const std::map<unsigned int, Instruction>& code,
+                   const std::set<unsigned int>& entries, unsigned int start,
+                   C8::Flags flags, Block& block)
+    {
+        block = {start, start, "", false};
+        auto statement = [&block](const std::string& s)
+            { block.body += "        " + s + "\n"; };
+
+        //Whether the block continues to addr: not past the end of the code
+        //found, nor into another block or an instruction left
+        auto continues = [&](unsigned int addr)
+        {
+            auto found = code.find(addr);
+            return found != code.end() && !entries.count(addr) &&
+                   kind_of(found->second) != Kind::LEFT;
+        };
+        if(kind_of(code.at(start)) == Kind::LEFT) return false;
+
+        for(unsigned int addr = start; ; )
+        {
+            const Instruction& in = code.at(addr);
+            const Kind kind = kind_of(in);
+            const unsigned int next = addr + in.length;
+
+            block.body += format("        //%03X  %04X  %s\n", addr,
+                                 in.opcode, C8::disassemble(in).c_str());
+            block.end = next;
+
+            switch(kind)
+            {
+            case(Kind::NATIVE):
+                statement(native(in, flags));
+                break;
+            case(Kind::INTERPRETED):
+            case(Kind::ENDING):
+                statement(format("if(!r.interpret(cpu, 0x%03X)) "
+                    "return r.leave(cpu, n, 0x%03X);", addr, addr));
+                if(kind == Kind::INTERPRETED) break;
+                statement("return r.leave(cpu, n + 1, Aot::pc(cpu));");
+                return true;
+            default:    //BRANCH
+                statement(branch(in, start, block.is_loop));
+                return true;
+            }
+
+            if(!continues(next))
+            {
+                statement(format("return r.leave(cpu, n + 1, 0x%03X);", next));
+                return true;
+            }
+            statement(format(
+                "if(++n == budget) return r.leave(cpu, n, 0x%03X);", next));
+            addr = next;
+        }
+    }
+
+    void print_listing(const C8::Listing& listing)
+    {
+        const std::set<unsigned int> leaders(listing.leaders.begin(),
+                                             listing.leaders.end());
+        for(const Instruction& in : listing.code)
+        {
+            if(leaders.count(in.addr)) std::printf("\n");
+            if(in.length > C8::BYTES_PER_OPCODE)
+            {
+                std::printf("%03X  %04X %04X  %s\n", in.addr, in.opcode,
+                            in.operand, C8::disassemble(in).c_str());
+            }
+            else
+            {
+                std::printf("%03X  %04X       %s\n", in.addr, in.opcode,
+                            C8::disassemble(in).c_str());
+            }
+        }
+        if(listing.has_computed_jumps)
+            std::printf("\n; code reached only by computed jumps not found\n");
+    }
+
+    void print_program(const char* rom, const uint8_t* program, size_t size,
+                       const C8::Listing& listing, C8::Flags flags,
+                       const char* name)
+    {
+        std::map<unsigned int, Instruction> code;
+        for(const Instruction& in : listing.code) code[in.addr] = in;
+
+        //Blocks begin at leaders, and after instructions ending a block
+        //early, to which the interpreter returns
+        std::set<unsigned int> entries(listing.leaders.begin(),
+                                       listing.leaders.end());
+        for(const Instruction& in : listing.code)
+        {
+            const Kind kind = kind_of(in);
+            const unsigned int next = in.addr + in.length;
+            if((kind == Kind::ENDING || kind == Kind::LEFT) && code.count(next))
+                entries.insert(next);
+        }
+
+        //The image covers every byte translated, including any past the
+        //end of the program (read as zero)
+        std::vector<Block> blocks;
+        size_t image_size = size;
+        for(unsigned int start : entries)
+        {
+            Block block;
+            if(!translate(code, entries, start, flags, block)) continue;
+            blocks.push_back(block);
+            image_size = std::max<size_t>(image_size, 
+                                          block.end - C8::PROGRAM_BEGIN);
+        }
+
+        std::printf(
+            "//Translated from %s by test/recompile.cpp: do not edit.\n"
+            "//Build with the core, for the same CHIP8_VARIANT.\n"
+            "#include <cstdint>\n\n"
+            "#include \"chip8.h\"\n"
+            "#include \"chip8_aot.h\"\n\n"
+            "static_assert(CHIP8_VARIANT == %d, "
+            "\"Translated for another variant\");\n\n"
+            "namespace\n{\n"
+            "    namespace C8 = chip8;\n"
+            "    using C8::CPU;\n"
+            "    using Aot = CPU::Aot;\n\n"
+            "    const uint8_t image[] = {",
+            rom, CHIP8_VARIANT);
+        for(size_t b = 0; b < image_size; ++b)
+        {
+            std::printf("%s0x%02X,", (b % 12) ? " " : "\n        ",
+                        (b < size) ? program[b] : 0);
+        }
+        std::printf("\n    };\n");
+
+        for(const Block& block : blocks)
+        {
+            //Unnamed if unused, for builds with warnings as errors
+            const bool is_budgeted =
+                block.body.find("budget") != std::string::npos;
+            std::printf("\n"
+                "    uint64_t block_%03X(CPU& cpu, uint32_t%s)\n"
+                "    {\n"
+                "        Aot::Regs r(cpu);\n"
+                "        uint32_t n = 0;\n", block.begin,
+                is_budgeted ? " budget" : "");
+            if(block.is_loop) std::printf("    entry:\n");
+            std::printf("%s    }\n", block.body.c_str());
+        }
+
+        std::printf("\n    const C8::StaticBlock blocks[] = {\n");
+        for(const Block& block : blocks)
+        {
+            std::printf("        {0x%03X, 0x%03X, block_%03X},\n",
+                        block.begin, block.end, block.begin);
+        }
+        std::printf("    };\n}\n\n"
+            "extern const C8::StaticProgram %s;\n"
+            "const C8::StaticProgram %s = {\n"
+            "    image, sizeof(image), CHIP8_VARIANT,\n"
+            "    static_cast<C8::Flags>(0x%X),\n"
+            "    blocks, sizeof(blocks) / sizeof(blocks[0])\n"
+            "};\n", name, name, static_cast<unsigned int>(flags));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) { usage(); return 1; }
+
+    const char* name = "static_program";
+    C8::Flags flags = C8::NO_FLAGS;
+    bool is_listing = false;
+
+    for(int arg = 2; arg < argc; ++arg)
+    {
+        const char* option = argv[arg];
+        const char* value = (arg + 1 < argc) ? argv[arg + 1] : "";
+        bool ok = true;
+
+        if(!std::strcmp(option, "--disassemble"))
+        {
+            is_listing = true;
+            continue;
+        }
+        else if(!std::strcmp(option, "--name"))
+            ok = is_identifier(name = value);
+        else if(!std::strcmp(option, "--flags"))
+            ok = emu_io::parse_flags(value, flags);
+        else ok = false;
+
+        if(!ok)
+        {
+            std::fprintf(stderr, "invalid option: %s %s\n", option, value);
+            usage();
+            return 1;
+        }
+        ++arg;
+    }
+
+    try
+    {
+        const emu_io::MappedFile rom(argv[1]);
+        const size_t size = std::min<size_t>(rom.size(), C8::PROGRAM_SIZE);
+        const C8::Listing listing = C8::trace_program(rom.data(), size);
+
+        if(is_listing) print_listing(listing);
+        else print_program(argv[1], rom.data(), size, listing, flags, name);
+    }
+    catch(const emu_io::io_exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", argv[1], e.what());
+        return 1;
+    }
+
+    return 0;
+}
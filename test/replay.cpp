@@ -0,0 +1,97 @@
+#include "chip8.h"
+#include "chip8_movie.h"
+#include "emu_io.h"         //emu_io::MappedFile, load_rom_file: no SDL
+
+#include <chrono>           //std::chrono::steady_clock, std::chrono::duration
+#include <cinttypes>        //PRIu64, PRIx64
+#include <cstdio>           //std::printf, std::fprintf
+#include <cstdlib>          //std::strtoul
+#include <cstring>          //std::strcmp
+
+//Replays a movie recorded by the SDL driver (main.cpp --record) as fast as
+//the host allows, verifying its display checkpoints. The movie is streamed
+//from a memory-mapped file. Exits with 3 if any checkpoint mismatched, or
+//if repeated replays disagree.
+namespace
+{
+    namespace C8 = chip8;
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: replay MOVIE ROM [--jit] [--repeat N]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3) { usage(); return 1; }
+
+    bool jit = false;
+    unsigned long repeat = 1;
+    for(int arg = 3; arg < argc; ++arg)
+    {
+        if(!std::strcmp(argv[arg], "--jit")) jit = true;
+        else if(!std::strcmp(argv[arg], "--repeat") && arg + 1 < argc)
+            repeat = std::strtoul(argv[++arg], nullptr, 0);
+        else { usage(); return 1; }
+    }
+    if(repeat == 0) { usage(); return 1; }
+
+    //Zero-padded, as given to the CPU by the SDL driver
+    uint8_t buffer[C8::PROGRAM_SIZE] = {};
+    try
+    {
+        emu_io::load_rom_file(argv[2], buffer, C8::PROGRAM_SIZE);
+        const emu_io::MappedFile file(argv[1]);
+
+        using clock = std::chrono::steady_clock;
+        const auto begin = clock::now();
+
+        C8::ReplayResult first {};
+        bool consistent = true;
+        for(unsigned long r = 0; r < repeat; ++r)
+        {
+            C8::MovieReader movie(file.data(), file.size());
+            const C8::ReplayResult result = C8::replay(movie, buffer,
+                C8::PROGRAM_SIZE, jit ? C8::Engine::JIT
+                                      : C8::Engine::INTERPRETER);
+            if(r == 0) first = result;
+            else if(result.cycles != first.cycles ||
+                    result.display_hash != first.display_hash ||
+                    result.mismatches != first.mismatches)
+            {
+                consistent = false;
+            }
+        }
+
+        const double seconds = std::chrono::duration<double>(
+            clock::now() - begin).count();
+        std::printf("cycles=%" PRIu64 " hash=%016" PRIx64
+            " checkpoints=%lu mismatches=%lu",
+            first.cycles, first.display_hash, first.checkpoints,
+            first.mismatches);
+        if(first.mismatches)
+            std::printf(" first_mismatch=%" PRIu64, first.first_mismatch);
+        std::printf(" replays=%lu seconds=%.3f%s\n", repeat, seconds,
+            consistent ? "" : " INCONSISTENT");
+
+        return (first.mismatches || !consistent) ? 3 : 0;
+    }
+    catch(const emu_io::io_exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    catch(const C8::cpu_exception& e)
+    {
+        //Errors in the movie itself have no address
+        if(e.last_address < 0)
+        {
+            std::fprintf(stderr, "%s: %s\n", argv[1], e.what());
+            return 1;
+        }
+        std::printf("fault address=%03X what=%s\n", e.last_address, e.what());
+        return 2;
+    }
+}
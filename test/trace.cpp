@@ -0,0 +1,109 @@
+#include "chip8.h"
+#include "chip8_disasm.h"   //chip8::decode_instruction, disassemble
+#include "chip8_trace.h"    //chip8::TraceReader
+#include "emu_io.h"         //emu_io::MappedFile: no SDL required
+
+#include <cinttypes>        //PRIu64
+#include <cstdint>          //uint8_t, uint64_t
+#include <cstdio>           //std::printf, std::fprintf
+#include <cstdlib>          //std::strtoull
+#include <cstring>          //std::strcmp
+#include <deque>            //std::deque
+#include <string>           //std::string
+
+//Prints an execution trace recorded by the headless driver (--trace FILE),
+//an instruction per line: cycle, address, opcode, disassembly, and the
+//registers it changed. The trace is streamed from a memory-mapped file, so
+//may be of any length.
+namespace
+{
+    namespace C8 = chip8;
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: trace TRACE [--from CYCLE] [--last N]\n"
+            "  --from skips steps before CYCLE; --last prints only the\n"
+            "  final N steps (e.g. those before a fault)\n");
+    }
+
+    void print(const C8::TraceEvent& event)
+    {
+        if(event.type == C8::TraceEvent::STATE)
+        {
+            std::printf("%" PRIu64 " state pc=%03X i=%03X v=",
+                        event.cycle, event.pc, event.i);
+            for(uint8_t v : event.v) std::printf("%02X", v);
+            std::printf("\n");
+            return;
+        }
+
+        //Only the first two bytes were recorded (F000 nnnn reads as 0000)
+        const uint8_t bytes[2] = {static_cast<uint8_t>(event.opcode >> 8),
+                                  static_cast<uint8_t>(event.opcode)};
+        C8::Instruction instr =
+            C8::decode_instruction(bytes, sizeof(bytes), C8::PROGRAM_BEGIN);
+        instr.addr = event.pc;
+        std::printf("%" PRIu64 " %03X %04X  %-20s", event.cycle, event.pc,
+                    event.opcode, C8::disassemble(instr).c_str());
+        for(unsigned int r = 0; r < 0x10; ++r)
+        {
+            if(event.changed & (1U << r))
+                std::printf(" V%X=%02X", r, event.v[r]);
+        }
+        if(event.changed & C8::TraceEvent::CHANGED_I)
+            std::printf(" I=%03X", event.i);
+        std::printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) { usage(); return 1; }
+
+    unsigned long long from = 0;
+    unsigned long long last = 0;        //Zero: all
+    for(int arg = 2; arg < argc; ++arg)
+    {
+        char* end;
+        const char* value = (arg + 1 < argc) ? argv[arg + 1] : "";
+        unsigned long long* out =
+            !std::strcmp(argv[arg], "--from") ? &from :
+            !std::strcmp(argv[arg], "--last") ? &last : nullptr;
+        if(!out) { usage(); return 1; }
+        *out = std::strtoull(value, &end, 0);
+        if(*value == '\0' || *end != '\0') { usage(); return 1; }
+        ++arg;
+    }
+
+    try
+    {
+        const emu_io::MappedFile file(argv[1]);
+        C8::TraceReader trace(file.data(), file.size());
+
+        std::deque<C8::TraceEvent> kept;
+        C8::TraceEvent event;
+        while(trace.next(event))
+        {
+            if(event.type == C8::TraceEvent::STEP && event.cycle < from)
+                continue;
+            if(!last) { print(event); continue; }
+
+            kept.push_back(event);
+            if(kept.size() > last) kept.pop_front();
+        }
+        for(const C8::TraceEvent& kept_event : kept) print(kept_event);
+    }
+    catch(const emu_io::io_exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    catch(const C8::cpu_exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", argv[1], e.what());
+        return 1;
+    }
+
+    return 0;
+}